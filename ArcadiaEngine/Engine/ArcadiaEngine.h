@@ -50,12 +50,16 @@
 
 #include "WindowManager.h"
 #include "TextureManager.h"
+#include "GPUMemoryLedger.h"
 #include "GUIManager.h"
 #include "InputManager.h"
 #include "FontManager.h"
 #include "TimeSlice.h"
 #include "WinsockWrapper.h"
+#include "SocketBenchmarks.h"
 #include "MemoryManager.h"
+#include "FrameArena.h"
+#include "FrameAllocationMonitor.h"
 #include "DebugConsole.h"
 #include "AutoPlayManager.h"
 
@@ -162,6 +166,62 @@ inline void AddDebugConsoleCommands()
 		inputManager.AddTextInput(commandString);
 		return true;
 	});
+
+	//  BENCHMARK_SOCKETBUFFER: Times building 1 KB, 64 KB and 1 MB packets in a SocketBuffer against the original growth policy
+	debugConsole->AddDebugCommand("BENCHMARK_SOCKETBUFFER", [=](std::string commandString) -> bool
+	{
+		auto results = SocketBenchmarks::RunBufferGrowth();
+		for (auto iter = results.begin(); iter != results.end(); ++iter) debugConsole->AddDebugConsoleLine(*iter);
+		return true;
+	});
+
+	//  BENCHMARK_CIPHER: Measures ChaCha20 and RC4 cipher contexts in MB/s against EncryptBuffer, which keys RC4 for every buffer
+	debugConsole->AddDebugCommand("BENCHMARK_CIPHER", [=](std::string commandString) -> bool
+	{
+		auto results = SocketBenchmarks::RunCipherThroughput();
+		for (auto iter = results.begin(); iter != results.end(); ++iter) debugConsole->AddDebugConsoleLine(*iter);
+		return true;
+	});
+
+	//  GPU_MEMORY: Lists the video memory recorded in each GPUMemoryLedger pool. A number given sets the VRAM budget in megabytes.
+	debugConsole->AddDebugCommand("GPU_MEMORY", [=](std::string commandString) -> bool
+	{
+		if (!commandString.empty()) gpuMemoryLedger.SetBudget(int64_t(atoi(commandString.c_str())) * 1024 * 1024);
+
+		for (auto i = 0; i < int(gpuMemoryLedger.GetPoolCount()); ++i)
+			debugConsole->AddDebugConsoleLine(gpuMemoryLedger.GetPoolNameAtIndex(i) + ": " + std::to_string(gpuMemoryLedger.GetPoolAmountAtIndex(i)) + " bytes in " + std::to_string(gpuMemoryLedger.GetPoolResourceCountAtIndex(i)) + " resources (peak " + std::to_string(gpuMemoryLedger.GetPoolPeakAtIndex(i)) + ")");
+		debugConsole->AddDebugConsoleLine("Total: " + std::to_string(gpuMemoryLedger.GetTotalAmount()) + " of " + std::to_string(gpuMemoryLedger.GetBudget()) + " budgeted bytes");
+		return true;
+	});
+
+#if MEMORY_MANAGER_ACTIVE
+	//  MEMORY_OUTPUT: Writes the current memory pool statistics to a file (JSON if the file name ends in .json, otherwise CSV)
+	debugConsole->AddDebugCommand("MEMORY_OUTPUT", [=](std::string commandString) -> bool
+	{
+		if (commandString.empty()) { debugConsole->AddDebugConsoleLine("MEMORY_OUTPUT requires a file name"); return false; }
+
+		auto json = (commandString.length() > 5 && commandString.compare(commandString.length() - 5, 5, ".json") == 0);
+		memoryManager.OutputMemoryData(commandString.c_str(), json ? MEMORY_OUTPUT_JSON : MEMORY_OUTPUT_CSV);
+		debugConsole->AddDebugConsoleLine("Memory data written to " + commandString);
+		return true;
+	});
+
+	//  MEMORY_FRAME_OUTPUT: Writes memory pool statistics to a file every frame (JSON if the file name ends in .json, otherwise CSV). OFF stops it.
+	debugConsole->AddDebugCommand("MEMORY_FRAME_OUTPUT", [=](std::string commandString) -> bool
+	{
+		if (commandString.empty() || commandString == "OFF")
+		{
+			memoryManager.EndFrameOutput();
+			debugConsole->AddDebugConsoleLine("Per-frame memory output stopped");
+			return true;
+		}
+
+		auto json = (commandString.length() > 5 && commandString.compare(commandString.length() - 5, 5, ".json") == 0);
+		if (!memoryManager.BeginFrameOutput(commandString.c_str(), json ? MEMORY_OUTPUT_JSON : MEMORY_OUTPUT_CSV)) return false;
+		debugConsole->AddDebugConsoleLine("Per-frame memory output started to " + commandString);
+		return true;
+	});
+#endif
 }
 
 inline void ResizeWindow(void)
@@ -343,9 +403,10 @@ inline bool InitializeEngine(const char* programTitle, float screenWidth, float
 
 inline void ShutdownEngine()
 {
-	//  Shut down the manager classes that need it
-	windowManager.Shutdown();
+	//  Shut down the manager classes that need it. The UI goes first, while the GL context its renderables free into still exists.
 	guiManager.Shutdown();
+	textureManager.Shutdown();
+	windowManager.Shutdown();
 
 #if USING_SDL
 	//  Disable text input
@@ -390,6 +451,14 @@ inline void PrimaryLoop()
 	auto quit = false;
 	while (!quit)
 	{
+		//  Release all of the previous frame's transient allocations
+		frameArena.Reset();
+
+#if FRAME_ALLOCATION_MONITOR_ACTIVE
+		//  Start counting this frame's heap and managed allocations
+		frameAllocationMonitor.BeginFrame();
+#endif
+
 		DetermineTimeSlice();
 
 		//  Get the current state of mouse and keyboard input
@@ -442,5 +511,15 @@ inline void PrimaryLoop()
 
 		//  End Step
 		guiManager.EndStep();
+
+#if FRAME_ALLOCATION_MONITOR_ACTIVE
+		//  Report (or assert on) this frame if it allocated after the warm-up period
+		frameAllocationMonitor.EndFrame();
+#endif
+
+#if MEMORY_MANAGER_ACTIVE
+		//  Roll this frame's memory accounting up into the shared totals (and write it out if per-frame output is on)
+		memoryManager.EndFrame();
+#endif
 	}
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <SDL_opengl.h>
 #include <GL/glew.h>
+#include "GPUMemoryLedger.h"
 #include "Program.h"
 #include "Vector3.h"
 #include "TimeSlice.h"
@@ -11,10 +12,11 @@
 struct BasicRenderable3D
 {
 private:
-	GLuint m_GeometryVAO;
-	GLuint m_GeometryVBO;
-	GLuint m_LinesVAO;
-	GLuint m_LinesVBO;
+	GLuint m_GeometryVAO = 0;
+	GLuint m_GeometryVBO = 0;
+	GLuint m_LinesVAO = 0;
+	GLuint m_LinesVBO = 0;
+	int m_GPUMemoryPoolID = -1;
 
 	GLuint m_TextureID = 0;
 	tdogl::Program* m_ShaderProgram = nullptr;
@@ -34,6 +36,21 @@ public:
 		m_LinesColor(1.0f, 1.0f, 1.0f, 1.0f)
 	{}
 
+	~BasicRenderable3D()
+	{
+		FreeGeometryVAO();
+		FreeLinesVAO();
+	}
+
+	//  Each renderable owns its vertex arrays and buffers, so it can't be copied
+	BasicRenderable3D(const BasicRenderable3D&) = delete;
+	BasicRenderable3D& operator=(const BasicRenderable3D&) = delete;
+
+	//  Sets the GPUMemoryLedger pool that this renderable's buffers are recorded under (call before setting up any VAO)
+	inline void SetGPUMemoryPool(const char* poolName) {
+		m_GPUMemoryPoolID = gpuMemoryLedger.InternPool(poolName);
+	}
+
 	inline void SetTextureID(GLuint textureID) {
 		m_TextureID = textureID;
 	}
@@ -81,6 +98,7 @@ public:
 
 	void SetupGeometryVAO(float* vertices, unsigned int floatsPerVertex, unsigned int verticesPerShape, unsigned int shapesPerObject, unsigned int floatsForPosition, unsigned int floatsForTextureMap, unsigned int renderType)
 	{
+		FreeGeometryVAO();
 		m_GeometryVertexCount = verticesPerShape * shapesPerObject;
 		m_RenderType = renderType;
 
@@ -93,7 +111,9 @@ public:
 		glBindBuffer(GL_ARRAY_BUFFER, m_GeometryVBO);
 
 		//  Set the vertex buffer data information and the vertex attribute pointer within
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * floatsPerVertex * verticesPerShape * shapesPerObject, vertices, GL_STATIC_DRAW);
+		auto bufferSize = sizeof(float) * floatsPerVertex * verticesPerShape * shapesPerObject;
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, vertices, GL_STATIC_DRAW);
+		TrackBuffers(m_GeometryVAO, m_GeometryVBO, bufferSize);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(GLuint(0), floatsForPosition, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), NULL);
 		glEnableVertexAttribArray(1);
@@ -104,6 +124,7 @@ public:
 
 	void SetupLinesVAO(float* vertices, unsigned int floatsPerVertex, unsigned int lineCount, unsigned int floatsForPosition)
 	{
+		FreeLinesVAO();
 		m_LinesVertexCount = 2 * lineCount;
 
 		//  Generate and Bind the geometry vertex array
@@ -115,13 +136,27 @@ public:
 		glBindBuffer(GL_ARRAY_BUFFER, m_LinesVBO);
 
 		//  Set the vertex buffer data information and the vertex attribute pointer within
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * floatsPerVertex * m_LinesVertexCount, vertices, GL_STATIC_DRAW);
+		auto bufferSize = sizeof(float) * floatsPerVertex * m_LinesVertexCount;
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, vertices, GL_STATIC_DRAW);
+		TrackBuffers(m_LinesVAO, m_LinesVBO, bufferSize);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(GLuint(0), floatsForPosition, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), NULL);
 
 		glBindVertexArray(0);
 	}
 
+	void FreeGeometryVAO()
+	{
+		FreeBuffers(m_GeometryVAO, m_GeometryVBO);
+		m_GeometryVertexCount = 0;
+	}
+
+	void FreeLinesVAO()
+	{
+		FreeBuffers(m_LinesVAO, m_LinesVBO);
+		m_LinesVertexCount = 0;
+	}
+
 	void RenderGeometry(Vector3<float>& position, Camera& camera)
 	{
 		if (m_ShowLines == true) return;
@@ -190,4 +225,29 @@ public:
 
 		if (m_ShaderProgram != nullptr) m_ShaderProgram->stopUsing();
 	}
+
+private:
+	void TrackBuffers(GLuint vertexArray, GLuint vertexBuffer, size_t bufferSize)
+	{
+		//  The buffer holds the vertex data, and the vertex array only its attribute state (which is recorded as taking no memory)
+		if (m_GPUMemoryPoolID < 0) m_GPUMemoryPoolID = GPU_MEMORY_POOL_ID("BasicRenderable3D");
+		gpuMemoryLedger.TrackResource(GPU_RESOURCE_BUFFER, uint64_t(vertexBuffer), bufferSize, m_GPUMemoryPoolID);
+		gpuMemoryLedger.TrackResource(GPU_RESOURCE_VERTEX_ARRAY, uint64_t(vertexArray), 0, m_GPUMemoryPoolID);
+	}
+
+	void FreeBuffers(GLuint& vertexArray, GLuint& vertexBuffer)
+	{
+		if (vertexBuffer != 0)
+		{
+			gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_BUFFER, uint64_t(vertexBuffer));
+			glDeleteBuffers(1, &vertexBuffer);
+			vertexBuffer = 0;
+		}
+		if (vertexArray != 0)
+		{
+			gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_VERTEX_ARRAY, uint64_t(vertexArray));
+			glDeleteVertexArrays(1, &vertexArray);
+			vertexArray = 0;
+		}
+	}
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "SocketBuffer.h"
+#include "SocketPlatform.h"
+
+#include <string>
+#include <vector>
+
+#define DATAGRAM_BATCH_DEFAULT_CAPACITY	64
+#define DATAGRAM_MAX_SIZE				8195
+
+//  A fixed set of datagram slots, each with its own storage and its own remote address, that a UDP socket fills or sends in
+//  one system call (recvmmsg / sendmmsg on Linux). Every slot is allocated once, up front, so a batch can be reused each frame.
+class DatagramBatch
+{
+public:
+	explicit DatagramBatch(int capacity = DATAGRAM_BATCH_DEFAULT_CAPACITY, int slotSize = DATAGRAM_MAX_SIZE);
+	~DatagramBatch();
+
+	DatagramBatch(const DatagramBatch&) = delete;
+	DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+	inline int GetCapacity() const { return m_Capacity; }
+	inline int GetSlotSize() const { return m_SlotSize; }
+	inline int GetCount() const { return m_Count; }
+	inline void Clear() { m_Count = 0; }
+
+	//  Received (or added) datagrams
+	inline char* GetData(int index) const { return m_SlotData + size_t(index) * size_t(m_SlotSize); }
+	inline int GetSize(int index) const { return m_Sizes[index]; }
+	inline const SOCKADDR_IN& GetAddress(int index) const { return m_Addresses[index]; }
+	std::string GetAddressIP(int index) const;
+	unsigned short GetAddressPort(int index) const;
+
+	//  Datagrams to send. The first returns the slot to write the data into (or nullptr if the batch is full or the size is too
+	//  large), and the others copy the data in.
+	char* AddDatagram(const SOCKADDR_IN& address, int size);
+	bool AddDatagram(const SOCKADDR_IN& address, const char* data, int size);
+	bool AddDatagram(const char* ipAddress, int port, const SocketBuffer* source);
+
+private:
+	friend class Socket;
+
+	//  Points each slot's system call header at its storage, sized for a receive or for the datagram it holds
+	void PrepareReceive();
+	void PrepareSend();
+
+	char* m_SlotData;
+	int m_SlotSize;
+	int m_Capacity;
+	int m_Count;
+	std::vector<int> m_Sizes;
+	std::vector<SOCKADDR_IN> m_Addresses;
+
+#if SOCKET_BATCHED_DATAGRAMS
+	std::vector<struct mmsghdr> m_Messages;
+	std::vector<SocketIOBuffer> m_IOBuffers;
+#endif
+};
+
+inline std::string DatagramBatch::GetAddressIP(int index) const
+{
+	char ipAddress[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &m_Addresses[index].sin_addr, ipAddress, INET_ADDRSTRLEN);
+	return std::string(ipAddress);
+}
+
+inline unsigned short DatagramBatch::GetAddressPort(int index) const
+{
+	return ntohs(m_Addresses[index].sin_port);
+}
+
+inline char* DatagramBatch::AddDatagram(const SOCKADDR_IN& address, int size)
+{
+	if (m_Count >= m_Capacity || size < 0 || size > m_SlotSize) return nullptr;
+	m_Addresses[m_Count] = address;
+	m_Sizes[m_Count] = size;
+	return GetData(m_Count++);
+}
+
+inline bool DatagramBatch::AddDatagram(const SOCKADDR_IN& address, const char* data, int size)
+{
+	auto slot = AddDatagram(address, size);
+	if (slot == nullptr) return false;
+	memcpy(slot, data, size);
+	return true;
+}
+
+inline bool DatagramBatch::AddDatagram(const char* ipAddress, int port, const SocketBuffer* source)
+{
+	SOCKADDR_IN address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	if (inet_pton(AF_INET, ipAddress, &address.sin_addr) != 1) return false;
+	return AddDatagram(address, source->m_BufferData, source->m_BufferUtilizedCount);
+}
+
+inline void DatagramBatch::PrepareReceive()
+{
+#if SOCKET_BATCHED_DATAGRAMS
+	for (auto i = 0; i < m_Capacity; ++i)
+	{
+		SetSocketIOBuffer(m_IOBuffers[i], GetData(i), m_SlotSize);
+		m_Messages[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+		m_Messages[i].msg_hdr.msg_flags = 0;
+		m_Messages[i].msg_len = 0;
+	}
+#endif
+}
+
+inline void DatagramBatch::PrepareSend()
+{
+#if SOCKET_BATCHED_DATAGRAMS
+	for (auto i = 0; i < m_Count; ++i)
+	{
+		SetSocketIOBuffer(m_IOBuffers[i], GetData(i), m_Sizes[i]);
+		m_Messages[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+		m_Messages[i].msg_hdr.msg_flags = 0;
+		m_Messages[i].msg_len = 0;
+	}
+#endif
+}
+
+inline DatagramBatch::DatagramBatch(int capacity, int slotSize) :
+	m_SlotData(nullptr),
+	m_SlotSize(std::max<int>(slotSize, 1)),
+	m_Capacity(std::max<int>(capacity, 1)),
+	m_Count(0)
+{
+	MEMORY_SCOPE("WinsockWrapper");
+	m_SlotData = new char[size_t(m_Capacity) * size_t(m_SlotSize)];
+	m_Sizes.resize(m_Capacity, 0);
+	m_Addresses.resize(m_Capacity);
+	memset(m_Addresses.data(), 0, sizeof(SOCKADDR_IN) * m_Capacity);
+
+#if SOCKET_BATCHED_DATAGRAMS
+	//  Each header permanently points at its slot's address and I/O buffer, so only the sizes change from call to call
+	m_Messages.resize(m_Capacity);
+	m_IOBuffers.resize(m_Capacity);
+	memset(m_Messages.data(), 0, sizeof(struct mmsghdr) * m_Capacity);
+	for (auto i = 0; i < m_Capacity; ++i)
+	{
+		m_Messages[i].msg_hdr.msg_name = &m_Addresses[i];
+		m_Messages[i].msg_hdr.msg_iov = &m_IOBuffers[i];
+		m_Messages[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+}
+
+inline DatagramBatch::~DatagramBatch()
+{
+	delete[] m_SlotData;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+//  Debug mode: counts every global operator new and MANAGE_MEMORY_NEW made on the main thread during each PrimaryLoop iteration,
+//  and reports (or asserts on) any frame that allocates once the warm-up period is over. Heap allocations are counted by the
+//  global operator new replacements in MemoryScope.h.
+#define FRAME_ALLOCATION_MONITOR_ACTIVE false
+
+#include <assert.h>
+#include <cstdint>
+#include <cstdio>
+
+#define FRAME_ALLOCATION_MONITOR_WARM_UP_FRAMES	120
+
+class FrameAllocationMonitor
+{
+public:
+	//  Plain data so the thread-local copy needs no dynamic initialization (it is touched from inside operator new)
+	struct FrameCounters
+	{
+		uint32_t m_HeapAllocations;
+		uint32_t m_ManagedAllocations;
+		size_t m_FirstAllocationSize;
+		bool m_Counting;
+	};
+
+	static FrameAllocationMonitor& GetInstance() { static FrameAllocationMonitor INSTANCE; return INSTANCE; }
+	static FrameCounters& GetThreadCounters() { thread_local FrameCounters COUNTERS = {}; return COUNTERS; }
+
+	static void CountHeapAllocation(size_t amount) { auto& counters = GetThreadCounters(); if (!counters.m_Counting) return; if (counters.m_HeapAllocations++ == 0) counters.m_FirstAllocationSize = amount; }
+	static void CountManagedAllocation() { auto& counters = GetThreadCounters(); if (counters.m_Counting) counters.m_ManagedAllocations++; }
+
+	void BeginFrame();
+	void EndFrame();
+
+	inline void SetWarmUpFrames(unsigned int warmUpFrames) { m_WarmUpFrames = warmUpFrames; }
+	inline void SetAssertOnAllocation(bool assertOnAllocation) { m_AssertOnAllocation = assertOnAllocation; }
+
+	inline unsigned int GetWarmUpFrames() const { return m_WarmUpFrames; }
+	inline bool GetAssertOnAllocation() const { return m_AssertOnAllocation; }
+	inline uint64_t GetAllocatingFrameCount() const { return m_AllocatingFrameCount; }
+	inline uint32_t GetLastFrameHeapAllocations() const { return m_LastFrameHeapAllocations; }
+	inline uint32_t GetLastFrameManagedAllocations() const { return m_LastFrameManagedAllocations; }
+
+private:
+	FrameAllocationMonitor();
+	~FrameAllocationMonitor();
+
+	unsigned int m_WarmUpFrames;
+	bool m_AssertOnAllocation;
+	uint64_t m_FrameNumber;
+	uint64_t m_AllocatingFrameCount;
+	uint32_t m_LastFrameHeapAllocations;
+	uint32_t m_LastFrameManagedAllocations;
+};
+
+inline void FrameAllocationMonitor::BeginFrame()
+{
+	auto& counters = GetThreadCounters();
+	counters.m_HeapAllocations = 0;
+	counters.m_ManagedAllocations = 0;
+	counters.m_FirstAllocationSize = 0;
+	counters.m_Counting = true;
+}
+
+inline void FrameAllocationMonitor::EndFrame()
+{
+	auto& counters = GetThreadCounters();
+	counters.m_Counting = false;
+	m_LastFrameHeapAllocations = counters.m_HeapAllocations;
+	m_LastFrameManagedAllocations = counters.m_ManagedAllocations;
+
+	if (++m_FrameNumber <= m_WarmUpFrames) return;
+	if (m_LastFrameHeapAllocations == 0 && m_LastFrameManagedAllocations == 0) return;
+
+	++m_AllocatingFrameCount;
+	printf("FrameAllocationMonitor: frame %llu made %u heap allocations (the first was %u bytes) and %u managed allocations.\n", (unsigned long long)(m_FrameNumber), m_LastFrameHeapAllocations, (unsigned int)(counters.m_FirstAllocationSize), m_LastFrameManagedAllocations);
+	assert(!m_AssertOnAllocation && "A frame allocated after the warm-up period");
+}
+
+inline FrameAllocationMonitor::FrameAllocationMonitor() :
+	m_WarmUpFrames(FRAME_ALLOCATION_MONITOR_WARM_UP_FRAMES),
+	m_AssertOnAllocation(false),
+	m_FrameNumber(0),
+	m_AllocatingFrameCount(0),
+	m_LastFrameHeapAllocations(0),
+	m_LastFrameManagedAllocations(0)
+{
+
+}
+
+inline FrameAllocationMonitor::~FrameAllocationMonitor()
+{
+
+}
+
+//  Instance to be utilized by anyone including this header
+FrameAllocationMonitor& frameAllocationMonitor = FrameAllocationMonitor::GetInstance();
\ No newline at end of file
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "MemoryManager.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#define FRAME_ARENA_INITIAL_SIZE	(1024 * 256) // 256KB
+
+//  A linear allocator for transient data that only needs to live until the end of the current frame. Allocation is a pointer
+//  bump and nothing is freed individually; PrimaryLoop resets the main thread's arena once per iteration. If a frame overflows
+//  the arena, the overflow is served from extra blocks and the arena grows to the high-water mark on the next reset, so a
+//  steady-state frame performs no general heap allocations at all.
+//
+//  Each thread owns its own arena. Only the main thread's arena is reset by PrimaryLoop, so any other thread must wrap its
+//  usage in a FrameArenaScope.
+class FrameArena
+{
+public:
+	struct Marker
+	{
+		size_t m_Offset;
+		size_t m_OverflowCount;
+	};
+
+	static FrameArena& GetInstance() { thread_local FrameArena INSTANCE; return INSTANCE; }
+
+	void* Allocate(size_t amount, size_t alignment = alignof(std::max_align_t));
+	template <typename T> T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+	void Deallocate(void* memory, size_t amount);
+
+	Marker GetMarker() const { return { m_Offset, m_OverflowBlocks.size() }; }
+	void RewindToMarker(const Marker& marker);
+	void Reset();
+
+	size_t GetCapacity() const { return m_Capacity; }
+	size_t GetUsedBytes() const { return m_Offset + m_OverflowBytes; }
+	size_t GetHighWaterMark() const { return m_HighWaterMark; }
+
+	void Shutdown();
+
+private:
+	FrameArena();
+	~FrameArena();
+
+	void* AllocateOverflow(size_t amount, size_t alignment);
+
+	char* m_Block;
+	size_t m_Capacity;
+	size_t m_Offset;
+	std::vector<char*> m_OverflowBlocks;
+	size_t m_OverflowBytes;
+	size_t m_HighWaterMark;
+};
+
+//  Rewinds the current thread's frame arena to where it was when the scope was entered
+class FrameArenaScope
+{
+public:
+	FrameArenaScope() : m_Arena(FrameArena::GetInstance()), m_Marker(m_Arena.GetMarker()) {}
+	~FrameArenaScope() { m_Arena.RewindToMarker(m_Marker); }
+
+	FrameArenaScope(const FrameArenaScope&) = delete;
+	FrameArenaScope& operator=(const FrameArenaScope&) = delete;
+
+private:
+	FrameArena& m_Arena;
+	FrameArena::Marker m_Marker;
+};
+
+//  STL-compatible allocator that serves memory from the current thread's frame arena
+template <typename T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator() {}
+	template <typename U> FrameAllocator(const FrameAllocator<U>&) {}
+
+	T* allocate(size_t count) { return FrameArena::GetInstance().AllocateArray<T>(count); }
+	void deallocate(T* memory, size_t count) { FrameArena::GetInstance().Deallocate(memory, sizeof(T) * count); }
+
+	template <typename U> bool operator==(const FrameAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+inline void* FrameArena::Allocate(size_t amount, size_t alignment)
+{
+	auto alignedOffset = (m_Offset + alignment - 1) & ~(alignment - 1);
+	if (alignedOffset + amount > m_Capacity) return AllocateOverflow(amount, alignment);
+
+	m_Offset = alignedOffset + amount;
+	if (GetUsedBytes() > m_HighWaterMark) m_HighWaterMark = GetUsedBytes();
+	return m_Block + alignedOffset;
+}
+
+inline void FrameArena::Deallocate(void* memory, size_t amount)
+{
+	//  Only the most recent allocation can be handed back (which lets a growing container reuse its space)
+	auto bytes = static_cast<char*>(memory);
+	if (bytes >= m_Block && bytes < m_Block + m_Capacity && bytes + amount == m_Block + m_Offset) m_Offset = size_t(bytes - m_Block);
+}
+
+inline void FrameArena::RewindToMarker(const Marker& marker)
+{
+	//  Overflow blocks are only released on Reset, so a scope that overflowed simply leaves the arena where it is
+	if (m_OverflowBlocks.size() != marker.m_OverflowCount) return;
+	if (marker.m_Offset < m_Offset) m_Offset = marker.m_Offset;
+}
+
+inline void FrameArena::Reset()
+{
+	if (!m_OverflowBlocks.empty())
+	{
+		for (auto iter = m_OverflowBlocks.begin(); iter != m_OverflowBlocks.end(); ++iter) free((*iter));
+		m_OverflowBlocks.clear();
+		m_OverflowBytes = 0;
+
+		//  Grow the main block to the high-water mark so the next frame fits without overflowing
+		auto newCapacity = std::max<size_t>(m_Capacity, FRAME_ARENA_INITIAL_SIZE);
+		while (newCapacity < m_HighWaterMark) newCapacity *= 2;
+		auto newBlock = static_cast<char*>(malloc(newCapacity));
+		if (newBlock != nullptr)
+		{
+			MANAGE_MEMORY_DELETE("FrameArena", m_Capacity);
+			free(m_Block);
+			m_Block = newBlock;
+			m_Capacity = newCapacity;
+			MANAGE_MEMORY_NEW("FrameArena", m_Capacity);
+		}
+	}
+
+	m_Offset = 0;
+}
+
+inline void FrameArena::Shutdown()
+{
+	for (auto iter = m_OverflowBlocks.begin(); iter != m_OverflowBlocks.end(); ++iter) free((*iter));
+	m_OverflowBlocks.clear();
+	m_OverflowBytes = 0;
+
+	if (m_Block != nullptr)
+	{
+		MANAGE_MEMORY_DELETE("FrameArena", m_Capacity);
+		free(m_Block);
+		m_Block = nullptr;
+	}
+	m_Capacity = 0;
+	m_Offset = 0;
+}
+
+inline void* FrameArena::AllocateOverflow(size_t amount, size_t alignment)
+{
+	//  malloc alignment covers max_align_t, so only over-aligned requests need padding
+	auto blockSize = amount + ((alignment > alignof(std::max_align_t)) ? alignment : 0);
+	auto block = static_cast<char*>(malloc(blockSize));
+	if (block == nullptr) throw std::bad_alloc();
+	m_OverflowBlocks.push_back(block);
+	m_OverflowBytes += blockSize;
+	if (GetUsedBytes() > m_HighWaterMark) m_HighWaterMark = GetUsedBytes();
+
+	auto address = reinterpret_cast<uintptr_t>(block);
+	return block + (((address + alignment - 1) & ~uintptr_t(alignment - 1)) - address);
+}
+
+inline FrameArena::FrameArena() :
+	m_Block(static_cast<char*>(malloc(FRAME_ARENA_INITIAL_SIZE))),
+	m_Capacity(FRAME_ARENA_INITIAL_SIZE),
+	m_Offset(0),
+	m_OverflowBytes(0),
+	m_HighWaterMark(0)
+{
+	if (m_Block == nullptr) m_Capacity = 0;
+	else MANAGE_MEMORY_NEW("FrameArena", m_Capacity);
+}
+
+inline FrameArena::~FrameArena()
+{
+	Shutdown();
+}
+
+//  Instance to be utilized by anyone including this header (the main thread's arena, which PrimaryLoop resets every frame)
+FrameArena& frameArena = FrameArena::GetInstance();
\ No newline at end of file
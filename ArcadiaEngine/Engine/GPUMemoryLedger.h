@@ -0,0 +1,276 @@
+#pragma once
+
+#include <SDL_opengl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#define GPU_MEMORY_LEDGER_MAX_POOLS			32
+#define GPU_MEMORY_LEDGER_MAX_NAME_LENGTH	48
+
+//  Resolves a GPU pool name literal to its interned pool ID, once per call site
+#define GPU_MEMORY_POOL_ID(stringPoolType) ([]() { static const auto POOL_ID = gpuMemoryLedger.InternPool(stringPoolType); return POOL_ID; }())
+
+enum GPUResourceTypes { GPU_RESOURCE_TEXTURE = 0, GPU_RESOURCE_RENDERER_TEXTURE, GPU_RESOURCE_BUFFER, GPU_RESOURCE_VERTEX_ARRAY, GPU_RESOURCE_TYPE_COUNT };
+
+//  Keeps a record of the video memory used by every texture, buffer and vertex array the engine uploads, grouped into owner
+//  pools that mirror the MemoryManager's. Sizes are computed from what was uploaded (format, dimensions and mip levels for
+//  textures, and data size for buffers), since OpenGL has no portable way to ask the driver. All calls are expected to come
+//  from the thread that owns the OpenGL context.
+class GPUMemoryLedger
+{
+public:
+	static GPUMemoryLedger& GetInstance() { static GPUMemoryLedger INSTANCE; return INSTANCE; }
+
+	static size_t GetBytesPerPixel(GLenum format, GLenum type);
+	static size_t ComputeTextureBytes(GLenum format, GLenum type, int width, int height, int mipLevels = 1);
+	static int GetFullMipCount(int width, int height);
+
+	int InternPool(const char* poolName);
+
+	void TrackResource(int resourceType, uint64_t handle, size_t bytes, int poolID);
+	void ReleaseResource(int resourceType, uint64_t handle);
+
+	inline void SetBudget(int64_t budgetBytes) { m_BudgetBytes = budgetBytes; }
+	inline int64_t GetBudget() const { return m_BudgetBytes; }
+
+	unsigned int GetPoolCount() const { return (unsigned int)(m_PoolCount); }
+	std::string GetPoolNameAtIndex(int index) const;
+	int64_t GetPoolAmountAtIndex(int index) const;
+	int64_t GetPoolPeakAtIndex(int index) const;
+	int GetPoolResourceCountAtIndex(int index) const;
+	int64_t GetResourceTypeAmount(int resourceType) const { return (resourceType >= 0 && resourceType < GPU_RESOURCE_TYPE_COUNT) ? m_ResourceTypeAmounts[resourceType] : 0; }
+	int64_t GetResourceAmount(int resourceType, uint64_t handle) const;
+	int64_t GetTotalAmount() const { return m_TotalAmount; }
+	int64_t GetPeakAmount() const { return m_PeakAmount; }
+
+	void Shutdown();
+
+private:
+	struct ResourceEntry
+	{
+		size_t m_Bytes;
+		int m_PoolID;
+	};
+
+	GPUMemoryLedger();
+	~GPUMemoryLedger();
+
+	std::unordered_map<uint64_t, ResourceEntry> m_Resources[GPU_RESOURCE_TYPE_COUNT];
+	int64_t m_ResourceTypeAmounts[GPU_RESOURCE_TYPE_COUNT];
+
+	int m_PoolCount;
+	char m_PoolNames[GPU_MEMORY_LEDGER_MAX_POOLS][GPU_MEMORY_LEDGER_MAX_NAME_LENGTH];
+	int64_t m_PoolAmounts[GPU_MEMORY_LEDGER_MAX_POOLS];
+	int64_t m_PoolPeaks[GPU_MEMORY_LEDGER_MAX_POOLS];
+	int m_PoolResourceCounts[GPU_MEMORY_LEDGER_MAX_POOLS];
+
+	int64_t m_TotalAmount;
+	int64_t m_PeakAmount;
+	int64_t m_BudgetBytes;
+};
+
+inline size_t GPUMemoryLedger::GetBytesPerPixel(GLenum format, GLenum type)
+{
+	//  Packed types hold every component of a pixel in a single value
+	switch (type)
+	{
+	case GL_UNSIGNED_BYTE_3_3_2:
+	case GL_UNSIGNED_BYTE_2_3_3_REV:		return 1;
+	case GL_UNSIGNED_SHORT_5_6_5:
+	case GL_UNSIGNED_SHORT_5_6_5_REV:
+	case GL_UNSIGNED_SHORT_4_4_4_4:
+	case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+	case GL_UNSIGNED_SHORT_5_5_5_1:
+	case GL_UNSIGNED_SHORT_1_5_5_5_REV:		return 2;
+	case GL_UNSIGNED_INT_8_8_8_8:
+	case GL_UNSIGNED_INT_8_8_8_8_REV:
+	case GL_UNSIGNED_INT_10_10_10_2:
+	case GL_UNSIGNED_INT_2_10_10_10_REV:	return 4;
+	default:								break;
+	}
+
+	size_t componentSize = 1;
+	switch (type)
+	{
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:		componentSize = 2;	break;
+	case GL_INT:
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:				componentSize = 4;	break;
+	default:					componentSize = 1;	break;
+	}
+
+	size_t componentCount = 4;
+	switch (format)
+	{
+	case GL_RED:
+	case GL_ALPHA:
+	case GL_LUMINANCE:
+	case GL_DEPTH_COMPONENT:	componentCount = 1;	break;
+	case GL_LUMINANCE_ALPHA:	componentCount = 2;	break;
+#ifdef GL_RG
+	case GL_RG:					componentCount = 2;	break;
+#endif
+	case GL_RGB:
+	case GL_BGR:				componentCount = 3;	break;
+	default:					componentCount = 4;	break;
+	}
+
+	return componentCount * componentSize;
+}
+
+inline size_t GPUMemoryLedger::ComputeTextureBytes(GLenum format, GLenum type, int width, int height, int mipLevels)
+{
+	//  A mip level count of zero or less means the full chain down to 1x1
+	if (mipLevels <= 0) mipLevels = GetFullMipCount(width, height);
+
+	auto bytesPerPixel = GetBytesPerPixel(format, type);
+	size_t totalBytes = 0;
+	for (auto i = 0; i < mipLevels; ++i)
+	{
+		totalBytes += size_t(std::max<int>(width, 1)) * size_t(std::max<int>(height, 1)) * bytesPerPixel;
+		width /= 2;
+		height /= 2;
+	}
+	return totalBytes;
+}
+
+inline int GPUMemoryLedger::GetFullMipCount(int width, int height)
+{
+	auto mipCount = 1;
+	for (auto largestSide = std::max<int>(width, height); largestSide > 1; largestSide /= 2) ++mipCount;
+	return mipCount;
+}
+
+inline int GPUMemoryLedger::InternPool(const char* poolName)
+{
+	for (auto i = 0; i < m_PoolCount; ++i)
+		if (strncmp(m_PoolNames[i], poolName, GPU_MEMORY_LEDGER_MAX_NAME_LENGTH - 1) == 0) return i;
+
+	if (m_PoolCount >= GPU_MEMORY_LEDGER_MAX_POOLS)
+	{
+		printf("GPUMemoryLedger has run out of pools. The %s pool will be tracked under the %s pool.\n", poolName, m_PoolNames[GPU_MEMORY_LEDGER_MAX_POOLS - 1]);
+		return GPU_MEMORY_LEDGER_MAX_POOLS - 1;
+	}
+
+	auto nameLength = std::min<size_t>(strlen(poolName), GPU_MEMORY_LEDGER_MAX_NAME_LENGTH - 1);
+	memcpy(m_PoolNames[m_PoolCount], poolName, nameLength);
+	m_PoolNames[m_PoolCount][nameLength] = '\0';
+	return m_PoolCount++;
+}
+
+inline void GPUMemoryLedger::TrackResource(int resourceType, uint64_t handle, size_t bytes, int poolID)
+{
+	if (resourceType < 0 || resourceType >= GPU_RESOURCE_TYPE_COUNT || poolID < 0 || poolID >= m_PoolCount) return;
+
+	//  Re-uploading to a resource that is already tracked replaces its old size
+	ReleaseResource(resourceType, handle);
+
+	m_Resources[resourceType][handle] = { bytes, poolID };
+	m_ResourceTypeAmounts[resourceType] += int64_t(bytes);
+	m_PoolAmounts[poolID] += int64_t(bytes);
+	m_PoolPeaks[poolID] = std::max<int64_t>(m_PoolPeaks[poolID], m_PoolAmounts[poolID]);
+	m_PoolResourceCounts[poolID]++;
+
+	auto wasOverBudget = (m_BudgetBytes > 0 && m_TotalAmount > m_BudgetBytes);
+	m_TotalAmount += int64_t(bytes);
+	m_PeakAmount = std::max<int64_t>(m_PeakAmount, m_TotalAmount);
+	if (m_BudgetBytes > 0 && !wasOverBudget && m_TotalAmount > m_BudgetBytes) printf("GPUMemoryLedger has gone over its budget of %lld bytes (now %lld bytes, with %s adding %lld).\n", (long long)(m_BudgetBytes), (long long)(m_TotalAmount), m_PoolNames[poolID], (long long)(bytes));
+}
+
+inline void GPUMemoryLedger::ReleaseResource(int resourceType, uint64_t handle)
+{
+	if (resourceType < 0 || resourceType >= GPU_RESOURCE_TYPE_COUNT) return;
+
+	auto findIter = m_Resources[resourceType].find(handle);
+	if (findIter == m_Resources[resourceType].end()) return;
+
+	auto& entry = (*findIter).second;
+	m_ResourceTypeAmounts[resourceType] -= int64_t(entry.m_Bytes);
+	m_PoolAmounts[entry.m_PoolID] -= int64_t(entry.m_Bytes);
+	m_PoolResourceCounts[entry.m_PoolID]--;
+	m_TotalAmount -= int64_t(entry.m_Bytes);
+	m_Resources[resourceType].erase(findIter);
+}
+
+inline std::string GPUMemoryLedger::GetPoolNameAtIndex(int index) const
+{
+	if (index >= 0 && index < m_PoolCount) return std::string(m_PoolNames[index]);
+
+	printf("GPUMemoryLedger error: Attempting to find invalid pool.\n");
+	return "";
+}
+
+inline int64_t GPUMemoryLedger::GetPoolAmountAtIndex(int index) const
+{
+	if (index >= 0 && index < m_PoolCount) return m_PoolAmounts[index];
+
+	printf("GPUMemoryLedger error: Attempting to find invalid pool.\n");
+	return 0;
+}
+
+inline int64_t GPUMemoryLedger::GetPoolPeakAtIndex(int index) const
+{
+	if (index >= 0 && index < m_PoolCount) return m_PoolPeaks[index];
+
+	printf("GPUMemoryLedger error: Attempting to find invalid pool.\n");
+	return 0;
+}
+
+inline int GPUMemoryLedger::GetPoolResourceCountAtIndex(int index) const
+{
+	if (index >= 0 && index < m_PoolCount) return m_PoolResourceCounts[index];
+
+	printf("GPUMemoryLedger error: Attempting to find invalid pool.\n");
+	return 0;
+}
+
+inline int64_t GPUMemoryLedger::GetResourceAmount(int resourceType, uint64_t handle) const
+{
+	if (resourceType < 0 || resourceType >= GPU_RESOURCE_TYPE_COUNT) return 0;
+
+	auto findIter = m_Resources[resourceType].find(handle);
+	return (findIter == m_Resources[resourceType].end()) ? 0 : int64_t((*findIter).second.m_Bytes);
+}
+
+inline void GPUMemoryLedger::Shutdown()
+{
+	if (m_TotalAmount > 0) printf("GPUMemoryLedger still tracking %lld bytes of video memory. Perhaps it wasn't shut down last.\n", (long long)(m_TotalAmount));
+
+	for (auto i = 0; i < GPU_RESOURCE_TYPE_COUNT; ++i)
+	{
+		m_Resources[i].clear();
+		m_ResourceTypeAmounts[i] = 0;
+	}
+	for (auto i = 0; i < GPU_MEMORY_LEDGER_MAX_POOLS; ++i)
+	{
+		m_PoolAmounts[i] = 0;
+		m_PoolResourceCounts[i] = 0;
+	}
+	m_TotalAmount = 0;
+}
+
+inline GPUMemoryLedger::GPUMemoryLedger() :
+	m_PoolCount(0),
+	m_TotalAmount(0),
+	m_PeakAmount(0),
+	m_BudgetBytes(0)
+{
+	memset(m_ResourceTypeAmounts, 0, sizeof(m_ResourceTypeAmounts));
+	memset(m_PoolNames, 0, sizeof(m_PoolNames));
+	memset(m_PoolAmounts, 0, sizeof(m_PoolAmounts));
+	memset(m_PoolPeaks, 0, sizeof(m_PoolPeaks));
+	memset(m_PoolResourceCounts, 0, sizeof(m_PoolResourceCounts));
+}
+
+inline GPUMemoryLedger::~GPUMemoryLedger()
+{
+}
+
+//  Instance to be utilized by anyone including this header
+GPUMemoryLedger& gpuMemoryLedger = GPUMemoryLedger::GetInstance();
\ No newline at end of file
@@ -20,7 +20,7 @@ public:
 	inline void SetRightClickCallback(const GUIFunctionCallback& callback) { m_RightClickCallback = callback; }
 	inline void SetFont(const Font* font) { m_Font = font; }
 	inline void SetFont(std::string fontName) { SetFont(fontManager.GetFont(fontName.c_str())); }
-	inline void SetText(const std::string text) { m_Text = text; }
+	inline void SetText(const std::string text) { m_Text.assign(text.c_str(), text.size()); }
 	inline void SetPressedSizeRatio(float ratio) { m_PressedSizeRatio = ratio; }
 	inline void SetTemplate(const char* templateName) { if (strlen(templateName) == 0) { m_Templated = false; return; } m_Templated = true;  m_TemplateBox = GUITemplatedBox("Button", templateName, 2); }
 
@@ -33,7 +33,7 @@ private:
 	GUIFunctionCallback	m_RightClickCallback;
 	bool m_Pressed;
 	const Font* m_Font;
-	std::string m_Text;
+	std::pmr::string m_Text;
 	float m_PressedSizeRatio;
 
 	bool m_Templated;
@@ -73,7 +73,7 @@ inline GUIButton::GUIButton(bool templated) :
 	m_RightClickCallback(nullptr),
 	m_Pressed(false),
 	m_Font(nullptr),
-	m_Text(""),
+	m_Text("", GetNodeMemoryResource()),
 	m_PressedSizeRatio(0.95f),
 	m_Templated(templated)
 {
@@ -12,18 +12,18 @@ public:
 	explicit GUILabel(const char* text = "");
 	~GUILabel();
 
-	inline std::string GetText() const { return m_Text; }
+	inline std::string GetText() const { return std::string(m_Text.c_str(), m_Text.size()); }
 
 	void SetFont(const Font* font) { m_Font = font; }
 	void SetFont(std::string fontName) { m_Font = fontManager.GetFont(fontName.c_str()); }
-	void SetText(const std::string text) { m_Text = text; }
+	void SetText(const std::string text) { m_Text.assign(text.c_str(), text.size()); }
 	void SetJustification(int justify) { m_Justification = justify; }
 
 	void Render(int xOffset = 0, int yOffset = 0) override;
 
 private:
 	const Font* m_Font;
-	std::string m_Text;
+	std::pmr::string m_Text;
 	int m_Justification;
 };
 
@@ -47,7 +47,7 @@ inline GUILabel* GUILabel::CreateLabel(const Font* font, const char* text, int x
 
 inline GUILabel::GUILabel(const char* text) :
 	m_Font(nullptr),
-	m_Text(text),
+	m_Text(text, GetNodeMemoryResource()),
 	m_Justification(UI_JUSTIFY_LEFT)
 {
 
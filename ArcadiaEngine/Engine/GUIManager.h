@@ -2,6 +2,7 @@
 
 #include "GUIObjectNode.h"
 #include <stack>
+#include <utility>
 
 class GUIManager
 {
@@ -11,6 +12,7 @@ public:
 	GUIObjectNode* GetBaseNode() const { return m_BaseNode; }
 	std::stack<GUIObjectNode*>& GetDestroyList() { return m_NodesToDestroy; }
 	void AddChild(GUIObjectNode* node) const { if (m_BaseNode != nullptr) m_BaseNode->AddChild(node); }
+	template <typename T, typename... Args> T* CreateSceneDialogue(Args&&... args);
 
 	void DestroyNode(GUIObjectNode* nodeToDestroy);
 	void Input() const;
@@ -30,6 +32,21 @@ private:
 	std::stack<GUIObjectNode*> m_NodesToDestroy;
 };
 
+//  Builds a dialogue (and every node, string and child list it creates while being constructed) inside a scene arena that the
+//  dialogue owns, so tearing the dialogue down releases all of that memory in one piece
+template <typename T, typename... Args>
+inline T* GUIManager::CreateSceneDialogue(Args&&... args)
+{
+	auto sceneArena = new SceneArena;
+	T* dialogue = nullptr;
+	{
+		SceneArenaScope sceneArenaScope(sceneArena);
+		dialogue = new T(std::forward<Args>(args)...);
+	}
+	dialogue->m_OwnedSceneArena = sceneArena;
+	return dialogue;
+}
+
 inline void GUIManager::DestroyNode(GUIObjectNode* nodeToDestroy)
 {
 	if (nodeToDestroy->m_SetToDestroy == true) return;
@@ -73,9 +90,15 @@ inline void GUIManager::EndStep()
 	while (!m_NodesToDestroy.empty())
 	{
 		auto node = m_NodesToDestroy.top();
-		node->Destroy();
-		delete node;
 		m_NodesToDestroy.pop();
+		node->Destroy();
+
+		//  Nodes living in a scene arena are only destructed here. Children are always destroyed before their parents, so by the
+		//  time the node owning the arena goes, nothing else in it is still alive and the whole arena can be released at once.
+		auto ownedSceneArena = node->m_OwnedSceneArena;
+		if (node->m_SceneArena != nullptr) node->~GUIObjectNode();
+		else delete node;
+		delete ownedSceneArena;
 	}
 }
 
@@ -2,20 +2,32 @@
 
 #include "TextureManager.h"
 #include "MemoryManager.h"
+#include "FrameArena.h"
+#include "SceneArena.h"
 #include "TextureAnimation.h"
 #include "Color.h"
 
+#include <cstddef>
+#include <memory_resource>
+#include <string>
 #include <vector>
 #include <assert.h>
 #include <stack>
 
+//  Every node is preceded by a record of the scene arena it was allocated from, kept at full alignment
+#define GUI_NODE_ALLOCATION_HEADER_SIZE	alignof(std::max_align_t)
+
 enum UI_Justifications { UI_JUSTIFY_LEFT = 0, UI_JUSTIFY_RIGHT, UI_JUSTIFY_CENTER, UI_JUSTIFICATION_COUNT };
 
 class GUIObjectNode
 {
 protected:
-	std::vector<GUIObjectNode*> m_Children;
-	std::vector<GUIObjectNode*> m_NewChildren;
+	std::pmr::vector<GUIObjectNode*> m_Children;
+	std::pmr::vector<GUIObjectNode*> m_NewChildren;
+
+	//  The resource this node's own containers and strings draw from (the pool of the active scene arena when the node was built,
+	//  if any), which takes back what they free so text and child lists that keep changing reuse their memory
+	inline std::pmr::memory_resource* GetNodeMemoryResource() const { return m_Children.get_allocator().resource(); }
 
 public:
 	static GUIObjectNode* CreateObjectNode(const char* imageFile);
@@ -24,6 +36,10 @@ public:
 	GUIObjectNode();
 	virtual ~GUIObjectNode();
 
+	//  UI nodes built while a scene arena is active live in that arena, and all others go through the size-class pool allocator
+	static void* operator new(size_t size);
+	static void operator delete(void* memory, size_t size);
+
 	virtual void Input(int xOffset = 0, int yOffset = 0);
 	virtual void Update();
 	virtual void Render(int xOffset = 0, int yOffset = 0);
@@ -49,7 +65,7 @@ public:
 	inline void SetParent(GUIObjectNode* parent) { m_Parent = parent; }
 	inline void SetColor(float r, float g, float b, float a) { m_Color.colorValues[0] = r; m_Color.colorValues[1] = g; m_Color.colorValues[2] = b; m_Color.colorValues[3] = a; }
 	inline void SetColorBytes(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) { SetColor(float(r) / 255.0f, float(g) / 255.0f, float(b) / 255.0f, float(a) / 255.0f); }
-	inline void SetObjectName(std::string objectName) { m_ObjectName = objectName; }
+	inline void SetObjectName(std::string objectName) { m_ObjectName.assign(objectName.c_str(), objectName.size()); }
 	inline void SetClickX(int clickX) { m_ClickX = clickX; }
 	inline void SetClickY(int clickY) { m_ClickY = clickY; }
 	inline void SetRenderLast(bool last) { m_RenderLast = last; }
@@ -62,7 +78,7 @@ public:
 	inline int GetTextureID() const { return m_TextureID; }
 	inline TextureAnimation* GetTextureAnimation() const { return m_TextureAnimation; }
 	inline bool GetVisible() const { return m_Visible; }
-	inline const std::string& GetObjectName(void) const { return m_ObjectName; }
+	inline const std::pmr::string& GetObjectName(void) const { return m_ObjectName; }
 	inline GUIObjectNode* GetParent() { return m_Parent; }
 	inline const GUIObjectNode* GetParent() const { return m_Parent; }
 	inline float getColorR() const { return m_Color.colorValues[0]; }
@@ -91,8 +107,10 @@ public:
 	bool m_ExplicitObject;
 	Color m_Color;
 	bool m_RenderLast;
+	SceneArena* m_SceneArena;
+	SceneArena* m_OwnedSceneArena;
 
-	std::string m_ObjectName;
+	std::pmr::string m_ObjectName;
 	int m_ClickX;
 	int m_ClickY;
 };
@@ -118,6 +136,8 @@ inline GUIObjectNode* GUIObjectNode::CreateObjectNode(TextureAnimation* anim)
 }
 
 inline GUIObjectNode::GUIObjectNode() :
+	m_Children(SceneArena::GetActiveResource()),
+	m_NewChildren(SceneArena::GetActiveResource()),
 	m_ZOrder(0),
 	m_X(0),
 	m_Y(0),
@@ -131,7 +151,10 @@ inline GUIObjectNode::GUIObjectNode() :
 	m_SetToDestroy(false),
 	m_ExplicitObject(false),
 	m_Color(1.0f, 1.0f, 1.0f, 1.0f),
-	m_ObjectName(""),
+	m_RenderLast(false),
+	m_SceneArena(SceneArena::GetActive()),
+	m_OwnedSceneArena(nullptr),
+	m_ObjectName("", SceneArena::GetActiveResource()),
 	m_ClickX(0),
 	m_ClickY(0)
 {
@@ -143,6 +166,28 @@ inline GUIObjectNode::~GUIObjectNode()
 	if (m_ExplicitObject) MANAGE_MEMORY_DELETE("MenuUI_ObjectNode", sizeof(GUIObjectNode));
 }
 
+inline void* GUIObjectNode::operator new(size_t size)
+{
+	//  The arena is recorded ahead of the node rather than looked up again on delete, as whichever arena is active by then (if
+	//  any) need not be the one the node came from
+	auto sceneArena = SceneArena::GetActive();
+	auto blockSize = size + GUI_NODE_ALLOCATION_HEADER_SIZE;
+	auto block = static_cast<char*>((sceneArena != nullptr) ? sceneArena->Allocate(blockSize) : memoryPoolAllocator.Allocate(blockSize));
+	*reinterpret_cast<SceneArena**>(block) = sceneArena;
+	return block + GUI_NODE_ALLOCATION_HEADER_SIZE;
+}
+
+inline void GUIObjectNode::operator delete(void* memory, size_t size)
+{
+	if (memory == nullptr) return;
+
+	//  Scene arena memory is never handed back one node at a time; it is released along with the arena itself
+	auto block = static_cast<char*>(memory) - GUI_NODE_ALLOCATION_HEADER_SIZE;
+	if (*reinterpret_cast<SceneArena**>(block) != nullptr) return;
+
+	memoryPoolAllocator.Free(block, size + GUI_NODE_ALLOCATION_HEADER_SIZE);
+}
+
 
 inline void GUIObjectNode::Input(int xOffset, int yOffset)
 {
@@ -198,8 +243,8 @@ inline void GUIObjectNode::Render(int xOffset, int yOffset)
 			}
 		}
 
-		//  Pass the render call to all children
-		std::vector<GUIObjectNode*> lastRenders;
+		//  Pass the render call to all children (deferring any that render last into a frame-transient list)
+		FrameVector<GUIObjectNode*> lastRenders;
 		for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
 		{
 			if ((*iter)->GetRenderLast())
@@ -248,7 +293,7 @@ inline bool GUIObjectNode::SortChild(GUIObjectNode* child)
 
 inline bool GUIObjectNode::GetClickPosition(const std::string& objectName, int& xPos, int& yPos)
 {
-	if (m_ObjectName.compare(objectName) == 0)
+	if (m_ObjectName.compare(objectName.c_str()) == 0)
 	{
 		xPos = GetTrueX() + m_ClickX;
 		yPos = GetTrueY() + m_ClickY;
@@ -312,11 +357,11 @@ inline void GUIObjectNode::RemoveChild(GUIObjectNode* child)
 inline GUIObjectNode* GUIObjectNode::GetChildByName(std::string childName)
 {
 	for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
-		if ((*iter)->GetObjectName() == childName)
+		if ((*iter)->GetObjectName().compare(childName.c_str()) == 0)
 			return (*iter);
 
 	for (auto iter = m_NewChildren.begin(); iter != m_NewChildren.end(); ++iter)
-		if ((*iter)->GetObjectName() == childName)
+		if ((*iter)->GetObjectName().compare(childName.c_str()) == 0)
 			return (*iter);
 
 	return nullptr;
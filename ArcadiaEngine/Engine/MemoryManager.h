@@ -1,60 +1,379 @@
 #pragma once
 
+#include "MemoryPoolAllocator.h"
+#include "FrameAllocationMonitor.h"
+
 #define MEMORY_MANAGER_ACTIVE true
 
 #if !MEMORY_MANAGER_ACTIVE
 #define MANAGE_MEMORY_NEW(stringType, sizetAmount) NULL;
 #define MANAGE_MEMORY_DELETE(stringType, sizetAmount) NULL;
 #else
-#define MANAGE_MEMORY_NEW(stringPoolType, sizetAmount) memoryManager.ManageMemoryNew(stringPoolType, sizetAmount);
-#define MANAGE_MEMORY_DELETE(stringPoolType, sizetAmount) memoryManager.ManageMemoryDelete(stringPoolType, sizetAmount);
+//  When call site tracking is on, every MANAGE_MEMORY_NEW also records the file and line it was made from
+#define MEMORY_MANAGER_TRACK_CALL_SITES false
+
+#if MEMORY_MANAGER_TRACK_CALL_SITES
+#define MANAGE_MEMORY_NEW(stringPoolType, sizetAmount) memoryManager.ManageMemoryNew(MEMORY_POOL_ID(stringPoolType), sizetAmount, MEMORY_CALL_SITE_ID(stringPoolType));
+#else
+#define MANAGE_MEMORY_NEW(stringPoolType, sizetAmount) memoryManager.ManageMemoryNew(MEMORY_POOL_ID(stringPoolType), sizetAmount);
+#endif
+#define MANAGE_MEMORY_DELETE(stringPoolType, sizetAmount) memoryManager.ManageMemoryDelete(MEMORY_POOL_ID(stringPoolType), sizetAmount);
+
+//  Resolves a pool name literal to its interned pool ID. The name is hashed at compile time and interned once per call site.
+#define MEMORY_POOL_ID(stringPoolType) ([]() { constexpr auto POOL_HASH = MemoryManager::HashPoolName(stringPoolType); static const auto POOL_ID = memoryManager.InternMemoryPool(POOL_HASH, stringPoolType); return POOL_ID; }())
+
+//  Resolves the current file and line to an interned call site ID, once per call site
+#define MEMORY_CALL_SITE_ID(stringPoolType) ([]() { static const auto CALL_SITE_ID = memoryManager.InternCallSite(MEMORY_POOL_ID(stringPoolType), __FILE__, __LINE__); return CALL_SITE_ID; }())
 
-#include <map>
+#define MEMORY_MANAGER_MAX_POOLS			64
+#define MEMORY_MANAGER_MAX_NAME_LENGTH		48
+#define MEMORY_MANAGER_FLUSH_INTERVAL		64
+#define MEMORY_MANAGER_HISTOGRAM_BUCKETS	16
+#define MEMORY_MANAGER_MAX_CALL_SITES		512
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <mutex>
+#include <string>
+
+enum MemoryOutputFormats { MEMORY_OUTPUT_CSV = 0, MEMORY_OUTPUT_JSON, MEMORY_OUTPUT_FORMAT_COUNT };
+
+//  A flat copy of every pool's statistics at one point in time. Pool names point into the MemoryManager, which never moves them.
+struct MemorySnapshot
+{
+	struct PoolStats
+	{
+		const char* m_Name;
+		int64_t m_LiveBytes;
+		int64_t m_PeakBytes;
+		uint64_t m_AllocationCount;
+	};
+
+	uint64_t m_FrameNumber;
+	int m_PoolCount;
+	int64_t m_TotalBytes;
+	int64_t m_PeakTotalBytes;
+	PoolStats m_Pools[MEMORY_MANAGER_MAX_POOLS];
+};
+
+//  The change in every pool between two snapshots (pools are only ever appended, so index i is the same pool in both)
+struct MemorySnapshotDiff
+{
+	struct PoolDelta
+	{
+		const char* m_Name;
+		int64_t m_LiveBytesDelta;
+		uint64_t m_AllocationCountDelta;
+	};
+
+	uint64_t m_FrameCount;
+	int m_PoolCount;
+	int m_ChangedPoolCount;
+	int64_t m_TotalBytesDelta;
+	PoolDelta m_Pools[MEMORY_MANAGER_MAX_POOLS];
+};
 
 class MemoryManager
 {
 public:
 	static MemoryManager& GetInstance() { static MemoryManager INSTANCE; return INSTANCE; }
 
-	void ManageMemoryNew(std::string poolType, size_t Amount);
-	void ManageMemoryDelete(std::string poolType, size_t Amount);
-	void OutputMemoryData(const char* fileName);
+	//  FNV-1a hash of a pool name, usable at compile time
+	static constexpr uint32_t HashPoolName(const char* poolName)
+	{
+		uint32_t hash = 2166136261u;
+		while (*poolName != '\0') hash = (hash ^ uint32_t(uint8_t(*poolName++))) * 16777619u;
+		return hash;
+	}
+
+	//  Size histogram buckets double from 16 bytes, with the last bucket holding everything larger
+	static size_t GetHistogramBucketLimit(int bucket) { return size_t(16) << bucket; }
+	static int GetHistogramBucket(size_t amount);
 
-	unsigned int GetMemoryPoolCount() const { return int(m_MemoryPoolList.size()); }
+	int InternMemoryPool(uint32_t poolHash, const char* poolName);
+	int InternMemoryPool(const char* poolName) { return InternMemoryPool(HashPoolName(poolName), poolName); }
+	int InternCallSite(int poolID, const char* fileName, int lineNumber);
+
+	void ManageMemoryNew(int poolID, size_t amount, int callSiteID = -1);
+	void RecordMemoryNew(int poolID, size_t amount, int callSiteID = -1);
+	void ManageMemoryDelete(int poolID, size_t amount);
+	void FlushThreadCounters();
+	void EndFrame();
+
+	void OutputMemoryData(const char* fileName, int format = MEMORY_OUTPUT_CSV);
+	bool BeginFrameOutput(const char* fileName, int format = MEMORY_OUTPUT_CSV);
+	void EndFrameOutput();
+
+	void TakeSnapshot(MemorySnapshot& snapshot);
+	static void DiffSnapshots(const MemorySnapshot& before, const MemorySnapshot& after, MemorySnapshotDiff& diff);
+
+	unsigned int GetMemoryPoolCount() const { return (unsigned int)(m_MemoryPoolCount.load(std::memory_order_acquire)); }
 	std::string GetMemoryPoolNameAtIndex(int index) const;
 	int GetMemoryPoolAmountAtIndex(int index) const;
+	int64_t GetMemoryPoolPeakAtIndex(int index) const;
+	uint64_t GetMemoryPoolAllocationCountAtIndex(int index) const;
+	uint64_t GetMemoryPoolHistogramAtIndex(int index, int bucket) const;
+	int64_t GetTotalMemoryUsed() const { return m_TotalMemoryUsed.load(std::memory_order_relaxed); }
+	int64_t GetPeakMemoryUsed() const { return m_PeakMemoryUsed.load(std::memory_order_relaxed); }
+	uint64_t GetFrameNumber() const { return m_FrameNumber; }
 
 	void Shutdown();
 
 private:
+	//  Per-thread pending deltas, rolled up into the shared atomic totals every MEMORY_MANAGER_FLUSH_INTERVAL operations
+	struct ThreadCounters
+	{
+		int64_t m_PoolDeltas[MEMORY_MANAGER_MAX_POOLS];
+		int64_t m_PoolPeaks[MEMORY_MANAGER_MAX_POOLS];
+		uint32_t m_AllocationCounts[MEMORY_MANAGER_MAX_POOLS];
+		uint32_t m_Histograms[MEMORY_MANAGER_MAX_POOLS][MEMORY_MANAGER_HISTOGRAM_BUCKETS];
+		int64_t m_TotalDelta;
+		int64_t m_TotalPeak;
+		int m_PendingCount;
+
+		ThreadCounters();
+		~ThreadCounters();
+	};
+
+	//  A thread's counters are destroyed before the static objects made on it, and those can still free memory as they go. The
+	//  state is a plain value that outlives the counters, so anything counted after them goes straight to the shared totals.
+	enum ThreadCountersStates { THREAD_COUNTERS_UNUSED = 0, THREAD_COUNTERS_ALIVE, THREAD_COUNTERS_DESTROYED };
+	static int& GetThreadCountersState() { thread_local int STATE = THREAD_COUNTERS_UNUSED; return STATE; }
+	static ThreadCounters& GetThreadCounters() { thread_local ThreadCounters COUNTERS; return COUNTERS; }
+	static bool GetThreadCountersDestroyed() { return (GetThreadCountersState() == THREAD_COUNTERS_DESTROYED); }
+	static void RaisePeak(std::atomic<int64_t>& peak, int64_t amount);
+	void FlushThreadCounters(ThreadCounters& counters);
+
+	void WriteCSVHeader(std::ostream& output) const;
+	void WriteCSV(std::ostream& output, bool includeCallSites) const;
+	void WriteJSON(std::ostream& output, bool includeCallSites) const;
+
 	MemoryManager();
 	~MemoryManager();
 
-	std::map<std::string, int> m_MemoryPoolList;
-	int m_TotalMemoryUsed;
+	std::mutex m_InternLock;
+	std::atomic<int> m_MemoryPoolCount;
+	uint32_t m_MemoryPoolHashes[MEMORY_MANAGER_MAX_POOLS];
+	char m_MemoryPoolNames[MEMORY_MANAGER_MAX_POOLS][MEMORY_MANAGER_MAX_NAME_LENGTH];
+	std::atomic<int64_t> m_MemoryPoolAmounts[MEMORY_MANAGER_MAX_POOLS];
+	std::atomic<int64_t> m_MemoryPoolPeaks[MEMORY_MANAGER_MAX_POOLS];
+	std::atomic<uint64_t> m_MemoryPoolAllocationCounts[MEMORY_MANAGER_MAX_POOLS];
+	std::atomic<uint64_t> m_MemoryPoolHistograms[MEMORY_MANAGER_MAX_POOLS][MEMORY_MANAGER_HISTOGRAM_BUCKETS];
+	std::atomic<int64_t> m_TotalMemoryUsed;
+	std::atomic<int64_t> m_PeakMemoryUsed;
+
+	std::atomic<int> m_CallSiteCount;
+	const char* m_CallSiteFiles[MEMORY_MANAGER_MAX_CALL_SITES];
+	int m_CallSiteLines[MEMORY_MANAGER_MAX_CALL_SITES];
+	int m_CallSitePools[MEMORY_MANAGER_MAX_CALL_SITES];
+	std::atomic<uint64_t> m_CallSiteAllocationCounts[MEMORY_MANAGER_MAX_CALL_SITES];
+	std::atomic<uint64_t> m_CallSiteAllocationBytes[MEMORY_MANAGER_MAX_CALL_SITES];
+
+	std::ofstream m_FrameOutput;
+	int m_FrameOutputFormat;
+	uint64_t m_FrameNumber;
 };
 
-inline void MemoryManager::ManageMemoryNew(std::string poolType, size_t amount)
+inline int MemoryManager::GetHistogramBucket(size_t amount)
+{
+	auto bucket = 0;
+	while (bucket < MEMORY_MANAGER_HISTOGRAM_BUCKETS - 1 && amount > GetHistogramBucketLimit(bucket)) ++bucket;
+	return bucket;
+}
+
+inline int MemoryManager::InternMemoryPool(uint32_t poolHash, const char* poolName)
+{
+	std::lock_guard<std::mutex> lock(m_InternLock);
+
+	auto poolCount = m_MemoryPoolCount.load(std::memory_order_relaxed);
+	for (auto i = 0; i < poolCount; ++i)
+		if (m_MemoryPoolHashes[i] == poolHash && strncmp(m_MemoryPoolNames[i], poolName, MEMORY_MANAGER_MAX_NAME_LENGTH - 1) == 0) return i;
+
+	if (poolCount >= MEMORY_MANAGER_MAX_POOLS)
+	{
+		printf("MemoryManager has run out of memory pools. The %s pool will be tracked under the %s pool.\n", poolName, m_MemoryPoolNames[MEMORY_MANAGER_MAX_POOLS - 1]);
+		return MEMORY_MANAGER_MAX_POOLS - 1;
+	}
+
+	m_MemoryPoolHashes[poolCount] = poolHash;
+	auto nameLength = std::min<size_t>(strlen(poolName), MEMORY_MANAGER_MAX_NAME_LENGTH - 1);
+	memcpy(m_MemoryPoolNames[poolCount], poolName, nameLength);
+	m_MemoryPoolNames[poolCount][nameLength] = '\0';
+	m_MemoryPoolCount.store(poolCount + 1, std::memory_order_release);
+	return poolCount;
+}
+
+inline int MemoryManager::InternCallSite(int poolID, const char* fileName, int lineNumber)
+{
+	std::lock_guard<std::mutex> lock(m_InternLock);
+
+	auto callSiteCount = m_CallSiteCount.load(std::memory_order_relaxed);
+	if (callSiteCount >= MEMORY_MANAGER_MAX_CALL_SITES)
+	{
+		printf("MemoryManager has run out of call sites. Allocations from %s:%d will not be attributed.\n", fileName, lineNumber);
+		return -1;
+	}
+
+	m_CallSiteFiles[callSiteCount] = fileName;
+	m_CallSiteLines[callSiteCount] = lineNumber;
+	m_CallSitePools[callSiteCount] = poolID;
+	m_CallSiteCount.store(callSiteCount + 1, std::memory_order_release);
+	return callSiteCount;
+}
+
+inline void MemoryManager::ManageMemoryNew(int poolID, size_t amount, int callSiteID)
+{
+#if FRAME_ALLOCATION_MONITOR_ACTIVE
+	FrameAllocationMonitor::CountManagedAllocation();
+#endif
+
+	RecordMemoryNew(poolID, amount, callSiteID);
+}
+
+inline void MemoryManager::RecordMemoryNew(int poolID, size_t amount, int callSiteID)
+{
+	if (GetThreadCountersDestroyed())
+	{
+		m_MemoryPoolAllocationCounts[poolID].fetch_add(1, std::memory_order_relaxed);
+		m_MemoryPoolHistograms[poolID][GetHistogramBucket(amount)].fetch_add(1, std::memory_order_relaxed);
+		RaisePeak(m_MemoryPoolPeaks[poolID], m_MemoryPoolAmounts[poolID].fetch_add(int64_t(amount), std::memory_order_relaxed) + int64_t(amount));
+		RaisePeak(m_PeakMemoryUsed, m_TotalMemoryUsed.fetch_add(int64_t(amount), std::memory_order_relaxed) + int64_t(amount));
+		if (callSiteID >= 0)
+		{
+			m_CallSiteAllocationCounts[callSiteID].fetch_add(1, std::memory_order_relaxed);
+			m_CallSiteAllocationBytes[callSiteID].fetch_add(uint64_t(amount), std::memory_order_relaxed);
+		}
+		return;
+	}
+
+	auto& counters = GetThreadCounters();
+	counters.m_PoolDeltas[poolID] += int64_t(amount);
+	counters.m_TotalDelta += int64_t(amount);
+	counters.m_AllocationCounts[poolID]++;
+	counters.m_Histograms[poolID][GetHistogramBucket(amount)]++;
+
+	//  Track the highest live amount this thread has seen, so short-lived spikes between flushes still show up as peaks
+	auto poolAmount = m_MemoryPoolAmounts[poolID].load(std::memory_order_relaxed) + counters.m_PoolDeltas[poolID];
+	if (poolAmount > counters.m_PoolPeaks[poolID]) counters.m_PoolPeaks[poolID] = poolAmount;
+	auto totalAmount = m_TotalMemoryUsed.load(std::memory_order_relaxed) + counters.m_TotalDelta;
+	if (totalAmount > counters.m_TotalPeak) counters.m_TotalPeak = totalAmount;
+
+	if (callSiteID >= 0)
+	{
+		m_CallSiteAllocationCounts[callSiteID].fetch_add(1, std::memory_order_relaxed);
+		m_CallSiteAllocationBytes[callSiteID].fetch_add(uint64_t(amount), std::memory_order_relaxed);
+	}
+
+	if (++counters.m_PendingCount >= MEMORY_MANAGER_FLUSH_INTERVAL) FlushThreadCounters(counters);
+}
+
+inline void MemoryManager::ManageMemoryDelete(int poolID, size_t amount)
+{
+	if (GetThreadCountersDestroyed())
+	{
+		m_MemoryPoolAmounts[poolID].fetch_sub(int64_t(amount), std::memory_order_relaxed);
+		m_TotalMemoryUsed.fetch_sub(int64_t(amount), std::memory_order_relaxed);
+		return;
+	}
+
+	auto& counters = GetThreadCounters();
+	counters.m_PoolDeltas[poolID] -= int64_t(amount);
+	counters.m_TotalDelta -= int64_t(amount);
+	if (++counters.m_PendingCount >= MEMORY_MANAGER_FLUSH_INTERVAL) FlushThreadCounters(counters);
+}
+
+inline void MemoryManager::FlushThreadCounters()
+{
+	if (!GetThreadCountersDestroyed()) FlushThreadCounters(GetThreadCounters());
+}
+
+inline void MemoryManager::EndFrame()
+{
+	FlushThreadCounters();
+	++m_FrameNumber;
+
+	if (!m_FrameOutput.is_open()) return;
+	if (m_FrameOutputFormat == MEMORY_OUTPUT_JSON) { WriteJSON(m_FrameOutput, false); m_FrameOutput << "\n"; }
+	else WriteCSV(m_FrameOutput, false);
+}
+
+inline void MemoryManager::RaisePeak(std::atomic<int64_t>& peak, int64_t amount)
 {
-	if (m_MemoryPoolList.find(poolType) == m_MemoryPoolList.end()) m_MemoryPoolList[poolType] = 0;
-	m_MemoryPoolList[poolType] += int(amount);
-	m_TotalMemoryUsed += int(amount);
+	auto currentPeak = peak.load(std::memory_order_relaxed);
+	while (amount > currentPeak && !peak.compare_exchange_weak(currentPeak, amount, std::memory_order_relaxed)) {}
 }
 
-inline void MemoryManager::ManageMemoryDelete(std::string poolType, size_t amount)
+inline void MemoryManager::FlushThreadCounters(ThreadCounters& counters)
 {
-	if (m_MemoryPoolList.find(poolType) == m_MemoryPoolList.end()) m_MemoryPoolList[poolType] = 0;
-	m_MemoryPoolList[poolType] -= int(amount);
-	if (m_MemoryPoolList[poolType] < 0 && m_MemoryPoolList[poolType] >= -int(amount)) printf("MemoryManager has gone negative on the %s pool.\n", poolType.c_str());
+	if (counters.m_PendingCount == 0) return;
+	counters.m_PendingCount = 0;
 
-	m_TotalMemoryUsed -= int(amount);
-	if (m_TotalMemoryUsed < 0 && m_TotalMemoryUsed >= -int(amount)) printf("MemoryManager has gone negative on the total memory count.\n");
+	auto poolCount = m_MemoryPoolCount.load(std::memory_order_acquire);
+	for (auto i = 0; i < poolCount; ++i)
+	{
+		if (counters.m_AllocationCounts[i] != 0)
+		{
+			m_MemoryPoolAllocationCounts[i].fetch_add(counters.m_AllocationCounts[i], std::memory_order_relaxed);
+			counters.m_AllocationCounts[i] = 0;
+			for (auto j = 0; j < MEMORY_MANAGER_HISTOGRAM_BUCKETS; ++j)
+			{
+				if (counters.m_Histograms[i][j] == 0) continue;
+				m_MemoryPoolHistograms[i][j].fetch_add(counters.m_Histograms[i][j], std::memory_order_relaxed);
+				counters.m_Histograms[i][j] = 0;
+			}
+		}
+
+		if (counters.m_PoolPeaks[i] > 0)
+		{
+			RaisePeak(m_MemoryPoolPeaks[i], counters.m_PoolPeaks[i]);
+			counters.m_PoolPeaks[i] = 0;
+		}
+
+		auto delta = counters.m_PoolDeltas[i];
+		if (delta == 0) continue;
+		counters.m_PoolDeltas[i] = 0;
+
+		auto poolAmount = m_MemoryPoolAmounts[i].fetch_add(delta, std::memory_order_relaxed) + delta;
+		RaisePeak(m_MemoryPoolPeaks[i], poolAmount);
+		if (poolAmount < 0 && poolAmount >= delta) printf("MemoryManager has gone negative on the %s pool.\n", m_MemoryPoolNames[i]);
+	}
+
+	auto totalDelta = counters.m_TotalDelta;
+	counters.m_TotalDelta = 0;
+	RaisePeak(m_PeakMemoryUsed, counters.m_TotalPeak);
+	counters.m_TotalPeak = 0;
+
+	auto totalMemoryUsed = m_TotalMemoryUsed.fetch_add(totalDelta, std::memory_order_relaxed) + totalDelta;
+	RaisePeak(m_PeakMemoryUsed, totalMemoryUsed);
+	if (totalMemoryUsed < 0 && totalMemoryUsed >= totalDelta) printf("MemoryManager has gone negative on the total memory count.\n");
+}
+
+inline MemoryManager::ThreadCounters::ThreadCounters() :
+	m_TotalDelta(0),
+	m_TotalPeak(0),
+	m_PendingCount(0)
+{
+	memset(m_PoolDeltas, 0, sizeof(m_PoolDeltas));
+	memset(m_PoolPeaks, 0, sizeof(m_PoolPeaks));
+	memset(m_AllocationCounts, 0, sizeof(m_AllocationCounts));
+	memset(m_Histograms, 0, sizeof(m_Histograms));
+	GetThreadCountersState() = THREAD_COUNTERS_ALIVE;
 }
 
+inline MemoryManager::ThreadCounters::~ThreadCounters()
+{
+	//  Roll up whatever this thread still has pending before it exits
+	MemoryManager::GetInstance().FlushThreadCounters(*this);
+	GetThreadCountersState() = THREAD_COUNTERS_DESTROYED;
+}
 
-inline void MemoryManager::OutputMemoryData(const char* fileName)
+inline void MemoryManager::OutputMemoryData(const char* fileName, int format)
 {
+	FlushThreadCounters();
+
 	std::ofstream memoryOutput(fileName, std::ios_base::binary);
 	if (!memoryOutput.good() || memoryOutput.bad())
 	{
@@ -62,22 +381,133 @@ inline void MemoryManager::OutputMemoryData(const char* fileName)
 		return;
 	}
 
-	printf("Memory Management Data:\n");
-	for (auto iter = m_MemoryPoolList.begin(); iter != m_MemoryPoolList.end(); ++iter)
+	if (format == MEMORY_OUTPUT_JSON) WriteJSON(memoryOutput, true);
+	else { WriteCSVHeader(memoryOutput); WriteCSV(memoryOutput, true); }
+	memoryOutput.close();
+}
+
+inline bool MemoryManager::BeginFrameOutput(const char* fileName, int format)
+{
+	EndFrameOutput();
+
+	//  Per-frame output is appended one line (JSON) or one row per pool (CSV) at a time, so it can be followed while running
+	m_FrameOutput.open(fileName, std::ios_base::binary | std::ios_base::trunc);
+	if (!m_FrameOutput.good())
 	{
-		printf("\"%s\":  %d\n", (*iter).first.c_str(), (*iter).second);
+		printf("MemoryManager has failed to open %s for per-frame output.\n", fileName);
+		m_FrameOutput.close();
+		return false;
 	}
-	memoryOutput.close();
+
+	m_FrameOutputFormat = format;
+	if (m_FrameOutputFormat != MEMORY_OUTPUT_JSON) WriteCSVHeader(m_FrameOutput);
+	return true;
 }
 
-inline std::string MemoryManager::GetMemoryPoolNameAtIndex(int index) const
+inline void MemoryManager::EndFrameOutput()
+{
+	if (m_FrameOutput.is_open()) m_FrameOutput.close();
+}
+
+inline void MemoryManager::WriteCSVHeader(std::ostream& output) const
+{
+	output << "frame,pool,live_bytes,peak_bytes,allocation_count";
+	for (auto i = 0; i < MEMORY_MANAGER_HISTOGRAM_BUCKETS - 1; ++i) output << ",size_le_" << GetHistogramBucketLimit(i);
+	output << ",size_gt_" << GetHistogramBucketLimit(MEMORY_MANAGER_HISTOGRAM_BUCKETS - 2) << "\n";
+}
+
+inline void MemoryManager::WriteCSV(std::ostream& output, bool includeCallSites) const
+{
+	auto poolCount = int(GetMemoryPoolCount());
+	for (auto i = 0; i < poolCount; ++i)
+	{
+		output << m_FrameNumber << ",\"" << m_MemoryPoolNames[i] << "\"," << m_MemoryPoolAmounts[i].load(std::memory_order_relaxed) << "," << m_MemoryPoolPeaks[i].load(std::memory_order_relaxed) << "," << m_MemoryPoolAllocationCounts[i].load(std::memory_order_relaxed);
+		for (auto j = 0; j < MEMORY_MANAGER_HISTOGRAM_BUCKETS; ++j) output << "," << m_MemoryPoolHistograms[i][j].load(std::memory_order_relaxed);
+		output << "\n";
+	}
+	output << m_FrameNumber << ",\"Total\"," << m_TotalMemoryUsed.load(std::memory_order_relaxed) << "," << m_PeakMemoryUsed.load(std::memory_order_relaxed) << ",,";
+	for (auto j = 1; j < MEMORY_MANAGER_HISTOGRAM_BUCKETS; ++j) output << ",";
+	output << "\n";
+
+	if (!includeCallSites) return;
+
+	auto callSiteCount = m_CallSiteCount.load(std::memory_order_acquire);
+	if (callSiteCount == 0) return;
+	output << "\nfile,line,pool,allocation_count,allocation_bytes\n";
+	for (auto i = 0; i < callSiteCount; ++i)
+		output << "\"" << m_CallSiteFiles[i] << "\"," << m_CallSiteLines[i] << ",\"" << m_MemoryPoolNames[m_CallSitePools[i]] << "\"," << m_CallSiteAllocationCounts[i].load(std::memory_order_relaxed) << "," << m_CallSiteAllocationBytes[i].load(std::memory_order_relaxed) << "\n";
+}
+
+inline void MemoryManager::WriteJSON(std::ostream& output, bool includeCallSites) const
 {
-	auto i = 0;
-	for (auto iter = m_MemoryPoolList.begin(); iter != m_MemoryPoolList.end(); ++iter, ++i)
+	output << "{\"frame\":" << m_FrameNumber << ",\"live_bytes\":" << m_TotalMemoryUsed.load(std::memory_order_relaxed) << ",\"peak_bytes\":" << m_PeakMemoryUsed.load(std::memory_order_relaxed) << ",\"histogram_limits\":[";
+	for (auto i = 0; i < MEMORY_MANAGER_HISTOGRAM_BUCKETS - 1; ++i) output << (i ? "," : "") << GetHistogramBucketLimit(i);
+	output << "],\"pools\":[";
+
+	auto poolCount = int(GetMemoryPoolCount());
+	for (auto i = 0; i < poolCount; ++i)
 	{
-		if (i != index) continue;
-		return (*iter).first;
+		output << (i ? "," : "") << "{\"name\":\"" << m_MemoryPoolNames[i] << "\",\"live_bytes\":" << m_MemoryPoolAmounts[i].load(std::memory_order_relaxed) << ",\"peak_bytes\":" << m_MemoryPoolPeaks[i].load(std::memory_order_relaxed) << ",\"allocation_count\":" << m_MemoryPoolAllocationCounts[i].load(std::memory_order_relaxed) << ",\"histogram\":[";
+		for (auto j = 0; j < MEMORY_MANAGER_HISTOGRAM_BUCKETS; ++j) output << (j ? "," : "") << m_MemoryPoolHistograms[i][j].load(std::memory_order_relaxed);
+		output << "]}";
 	}
+	output << "]";
+
+	if (includeCallSites)
+	{
+		output << ",\"call_sites\":[";
+		auto callSiteCount = m_CallSiteCount.load(std::memory_order_acquire);
+		for (auto i = 0; i < callSiteCount; ++i)
+		{
+			//  File paths may contain backslashes, which need escaping in JSON
+			output << (i ? "," : "") << "{\"file\":\"";
+			for (auto character = m_CallSiteFiles[i]; *character != '\0'; ++character) output << ((*character == '\\') ? "\\\\" : std::string(1, *character));
+			output << "\",\"line\":" << m_CallSiteLines[i] << ",\"pool\":\"" << m_MemoryPoolNames[m_CallSitePools[i]] << "\",\"allocation_count\":" << m_CallSiteAllocationCounts[i].load(std::memory_order_relaxed) << ",\"allocation_bytes\":" << m_CallSiteAllocationBytes[i].load(std::memory_order_relaxed) << "}";
+		}
+		output << "]";
+	}
+	output << "}";
+}
+
+inline void MemoryManager::TakeSnapshot(MemorySnapshot& snapshot)
+{
+	FlushThreadCounters();
+
+	snapshot.m_FrameNumber = m_FrameNumber;
+	snapshot.m_PoolCount = int(GetMemoryPoolCount());
+	snapshot.m_TotalBytes = m_TotalMemoryUsed.load(std::memory_order_relaxed);
+	snapshot.m_PeakTotalBytes = m_PeakMemoryUsed.load(std::memory_order_relaxed);
+	for (auto i = 0; i < snapshot.m_PoolCount; ++i)
+	{
+		auto& pool = snapshot.m_Pools[i];
+		pool.m_Name = m_MemoryPoolNames[i];
+		pool.m_LiveBytes = m_MemoryPoolAmounts[i].load(std::memory_order_relaxed);
+		pool.m_PeakBytes = m_MemoryPoolPeaks[i].load(std::memory_order_relaxed);
+		pool.m_AllocationCount = m_MemoryPoolAllocationCounts[i].load(std::memory_order_relaxed);
+	}
+}
+
+inline void MemoryManager::DiffSnapshots(const MemorySnapshot& before, const MemorySnapshot& after, MemorySnapshotDiff& diff)
+{
+	diff.m_FrameCount = after.m_FrameNumber - before.m_FrameNumber;
+	diff.m_PoolCount = after.m_PoolCount;
+	diff.m_ChangedPoolCount = 0;
+	diff.m_TotalBytesDelta = after.m_TotalBytes - before.m_TotalBytes;
+	for (auto i = 0; i < after.m_PoolCount; ++i)
+	{
+		//  Pools that did not exist yet in the earlier snapshot are treated as having started from nothing
+		auto existedBefore = (i < before.m_PoolCount);
+		auto& delta = diff.m_Pools[i];
+		delta.m_Name = after.m_Pools[i].m_Name;
+		delta.m_LiveBytesDelta = after.m_Pools[i].m_LiveBytes - (existedBefore ? before.m_Pools[i].m_LiveBytes : 0);
+		delta.m_AllocationCountDelta = after.m_Pools[i].m_AllocationCount - (existedBefore ? before.m_Pools[i].m_AllocationCount : 0);
+		if (!existedBefore || delta.m_LiveBytesDelta != 0 || delta.m_AllocationCountDelta != 0) diff.m_ChangedPoolCount++;
+	}
+}
+
+inline std::string MemoryManager::GetMemoryPoolNameAtIndex(int index) const
+{
+	if (index >= 0 && index < int(GetMemoryPoolCount())) return std::string(m_MemoryPoolNames[index]);
 
 	printf("Memory Manager error: Attempting to find invalid memory pool.\n");
 	return "";
@@ -85,12 +515,31 @@ inline std::string MemoryManager::GetMemoryPoolNameAtIndex(int index) const
 
 inline int MemoryManager::GetMemoryPoolAmountAtIndex(int index) const
 {
-	auto i = 0;
-	for (auto iter = m_MemoryPoolList.begin(); iter != m_MemoryPoolList.end(); ++iter, ++i)
-	{
-		if (i != index) continue;
-		return (*iter).second;
-	}
+	if (index >= 0 && index < int(GetMemoryPoolCount())) return int(m_MemoryPoolAmounts[index].load(std::memory_order_relaxed));
+
+	printf("Memory Manager error: Attempting to find invalid memory pool.\n");
+	return 0;
+}
+
+inline int64_t MemoryManager::GetMemoryPoolPeakAtIndex(int index) const
+{
+	if (index >= 0 && index < int(GetMemoryPoolCount())) return m_MemoryPoolPeaks[index].load(std::memory_order_relaxed);
+
+	printf("Memory Manager error: Attempting to find invalid memory pool.\n");
+	return 0;
+}
+
+inline uint64_t MemoryManager::GetMemoryPoolAllocationCountAtIndex(int index) const
+{
+	if (index >= 0 && index < int(GetMemoryPoolCount())) return m_MemoryPoolAllocationCounts[index].load(std::memory_order_relaxed);
+
+	printf("Memory Manager error: Attempting to find invalid memory pool.\n");
+	return 0;
+}
+
+inline uint64_t MemoryManager::GetMemoryPoolHistogramAtIndex(int index, int bucket) const
+{
+	if (index >= 0 && index < int(GetMemoryPoolCount()) && bucket >= 0 && bucket < MEMORY_MANAGER_HISTOGRAM_BUCKETS) return m_MemoryPoolHistograms[index][bucket].load(std::memory_order_relaxed);
 
 	printf("Memory Manager error: Attempting to find invalid memory pool.\n");
 	return 0;
@@ -98,14 +547,41 @@ inline int MemoryManager::GetMemoryPoolAmountAtIndex(int index) const
 
 inline void MemoryManager::Shutdown()
 {
-	if (m_TotalMemoryUsed > 0) printf("MemoryManager still managing %d bytes of memory. Perhaps it wasn't shut down last.\n", m_TotalMemoryUsed);
-	m_MemoryPoolList.clear();
+	FlushThreadCounters();
+	EndFrameOutput();
+
+	auto totalMemoryUsed = m_TotalMemoryUsed.load(std::memory_order_relaxed);
+	if (totalMemoryUsed > 0) printf("MemoryManager still managing %lld bytes of memory. Perhaps it wasn't shut down last.\n", (long long)(totalMemoryUsed));
+	for (auto i = 0; i < MEMORY_MANAGER_MAX_POOLS; ++i) m_MemoryPoolAmounts[i].store(0, std::memory_order_relaxed);
+	m_TotalMemoryUsed.store(0, std::memory_order_relaxed);
 }
 
-inline MemoryManager::MemoryManager() : 
-	m_TotalMemoryUsed(0)
+inline MemoryManager::MemoryManager() :
+	m_MemoryPoolCount(0),
+	m_TotalMemoryUsed(0),
+	m_PeakMemoryUsed(0),
+	m_CallSiteCount(0),
+	m_FrameOutputFormat(MEMORY_OUTPUT_CSV),
+	m_FrameNumber(0)
 {
+	memset(m_MemoryPoolHashes, 0, sizeof(m_MemoryPoolHashes));
+	memset(m_MemoryPoolNames, 0, sizeof(m_MemoryPoolNames));
+	for (auto i = 0; i < MEMORY_MANAGER_MAX_POOLS; ++i)
+	{
+		m_MemoryPoolAmounts[i].store(0, std::memory_order_relaxed);
+		m_MemoryPoolPeaks[i].store(0, std::memory_order_relaxed);
+		m_MemoryPoolAllocationCounts[i].store(0, std::memory_order_relaxed);
+		for (auto j = 0; j < MEMORY_MANAGER_HISTOGRAM_BUCKETS; ++j) m_MemoryPoolHistograms[i][j].store(0, std::memory_order_relaxed);
+	}
 
+	memset(m_CallSiteFiles, 0, sizeof(m_CallSiteFiles));
+	memset(m_CallSiteLines, 0, sizeof(m_CallSiteLines));
+	memset(m_CallSitePools, 0, sizeof(m_CallSitePools));
+	for (auto i = 0; i < MEMORY_MANAGER_MAX_CALL_SITES; ++i)
+	{
+		m_CallSiteAllocationCounts[i].store(0, std::memory_order_relaxed);
+		m_CallSiteAllocationBytes[i].store(0, std::memory_order_relaxed);
+	}
 }
 
 inline MemoryManager::~MemoryManager()
@@ -114,4 +590,7 @@ inline MemoryManager::~MemoryManager()
 
 //  Instance to be utilized by anyone including this header
 MemoryManager& memoryManager = MemoryManager::GetInstance();
-#endif
\ No newline at end of file
+#endif
+
+//  Scoped allocation tagging and the global operator new/delete replacements
+#include "MemoryScope.h"
\ No newline at end of file
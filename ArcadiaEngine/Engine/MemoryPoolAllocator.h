@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#define MEMORY_POOL_SLAB_SIZE			65536
+#define MEMORY_POOL_MAX_BLOCK_SIZE		1024
+#define MEMORY_POOL_SIZE_CLASS_COUNT	20
+
+//  A size-class pool allocator. Each size class carves fixed-size blocks out of large slabs and keeps freed blocks in an
+//  intrusive free list, so allocation and deallocation are O(1) and never fragment the general heap. Requests larger than
+//  MEMORY_POOL_MAX_BLOCK_SIZE fall through to the general heap.
+class MemoryPoolAllocator
+{
+public:
+	static MemoryPoolAllocator& GetInstance() { static MemoryPoolAllocator INSTANCE; return INSTANCE; }
+
+	void* Allocate(size_t amount);
+	void Free(void* memory, size_t amount);
+
+	unsigned int GetSizeClassCount() const { return MEMORY_POOL_SIZE_CLASS_COUNT; }
+	size_t GetSizeClassBlockSize(int index) const { return m_SizeClasses[index].m_BlockSize; }
+	size_t GetSizeClassSlabCount(int index) const { return m_SizeClasses[index].m_Slabs.size(); }
+	unsigned int GetSizeClassBlocksInUse(int index) const { return m_SizeClasses[index].m_BlocksInUse; }
+
+	void Shutdown();
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* m_Next;
+	};
+
+	struct SizeClass
+	{
+		size_t m_BlockSize;
+		FreeBlock* m_FreeList;
+		std::vector<char*> m_Slabs;
+		unsigned int m_BlocksInUse;
+		std::mutex m_Lock;
+	};
+
+	MemoryPoolAllocator();
+	~MemoryPoolAllocator();
+
+	int GetSizeClassIndex(size_t amount) const { return (amount > MEMORY_POOL_MAX_BLOCK_SIZE) ? -1 : m_SizeClassLookup[(amount + 15) / 16]; }
+	static bool AddSlab(SizeClass& sizeClass);
+
+	SizeClass m_SizeClasses[MEMORY_POOL_SIZE_CLASS_COUNT];
+	uint8_t m_SizeClassLookup[MEMORY_POOL_MAX_BLOCK_SIZE / 16 + 1];
+};
+
+inline void* MemoryPoolAllocator::Allocate(size_t amount)
+{
+	auto sizeClassIndex = GetSizeClassIndex(amount);
+	if (sizeClassIndex < 0)
+	{
+		auto memory = malloc(amount);
+		if (memory == nullptr) throw std::bad_alloc();
+		return memory;
+	}
+
+	auto& sizeClass = m_SizeClasses[sizeClassIndex];
+	std::lock_guard<std::mutex> lock(sizeClass.m_Lock);
+
+	//  Pull the head of the free list, adding a new slab if the size class is exhausted
+	if (sizeClass.m_FreeList == nullptr && !AddSlab(sizeClass)) throw std::bad_alloc();
+	auto block = sizeClass.m_FreeList;
+	sizeClass.m_FreeList = block->m_Next;
+	sizeClass.m_BlocksInUse++;
+	return block;
+}
+
+inline void MemoryPoolAllocator::Free(void* memory, size_t amount)
+{
+	if (memory == nullptr) return;
+
+	auto sizeClassIndex = GetSizeClassIndex(amount);
+	if (sizeClassIndex < 0)
+	{
+		free(memory);
+		return;
+	}
+
+	auto& sizeClass = m_SizeClasses[sizeClassIndex];
+	std::lock_guard<std::mutex> lock(sizeClass.m_Lock);
+
+	//  Push the block back onto the head of the free list
+	auto block = static_cast<FreeBlock*>(memory);
+	block->m_Next = sizeClass.m_FreeList;
+	sizeClass.m_FreeList = block;
+	sizeClass.m_BlocksInUse--;
+}
+
+inline void MemoryPoolAllocator::Shutdown()
+{
+	//  Only release the slabs of size classes that no longer have any live blocks
+	for (auto i = 0; i < MEMORY_POOL_SIZE_CLASS_COUNT; ++i)
+	{
+		auto& sizeClass = m_SizeClasses[i];
+		std::lock_guard<std::mutex> lock(sizeClass.m_Lock);
+		if (sizeClass.m_BlocksInUse != 0)
+		{
+			printf("MemoryPoolAllocator still has %u live blocks of size %u. Perhaps it wasn't shut down last.\n", sizeClass.m_BlocksInUse, (unsigned int)(sizeClass.m_BlockSize));
+			continue;
+		}
+
+		for (auto iter = sizeClass.m_Slabs.begin(); iter != sizeClass.m_Slabs.end(); ++iter) free((*iter));
+		sizeClass.m_Slabs.clear();
+		sizeClass.m_FreeList = nullptr;
+	}
+}
+
+inline MemoryPoolAllocator::MemoryPoolAllocator()
+{
+	//  Block sizes grow in steps of 16 up to 128 bytes, then 32 up to 256, 64 up to 512, and 128 up to 1024
+	size_t blockSize = 0;
+	for (auto i = 0; i < MEMORY_POOL_SIZE_CLASS_COUNT; ++i)
+	{
+		blockSize += (blockSize < 128) ? 16 : (blockSize < 256) ? 32 : (blockSize < 512) ? 64 : 128;
+		m_SizeClasses[i].m_BlockSize = blockSize;
+		m_SizeClasses[i].m_FreeList = nullptr;
+		m_SizeClasses[i].m_BlocksInUse = 0;
+	}
+
+	//  Build the lookup table that maps a request size (in 16 byte steps) to the smallest size class that fits it
+	auto sizeClassIndex = 0;
+	for (auto i = 0; i <= MEMORY_POOL_MAX_BLOCK_SIZE / 16; ++i)
+	{
+		while (m_SizeClasses[sizeClassIndex].m_BlockSize < size_t(i) * 16) ++sizeClassIndex;
+		m_SizeClassLookup[i] = uint8_t(sizeClassIndex);
+	}
+}
+
+inline MemoryPoolAllocator::~MemoryPoolAllocator()
+{
+	Shutdown();
+}
+
+inline bool MemoryPoolAllocator::AddSlab(SizeClass& sizeClass)
+{
+	auto slab = static_cast<char*>(malloc(MEMORY_POOL_SLAB_SIZE));
+	if (slab == nullptr) return false;
+	sizeClass.m_Slabs.push_back(slab);
+
+	//  Thread every block in the new slab onto the free list (in reverse, so blocks are handed out in address order)
+	auto blockCount = MEMORY_POOL_SLAB_SIZE / sizeClass.m_BlockSize;
+	for (auto i = blockCount; i > 0; --i)
+	{
+		auto block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * sizeClass.m_BlockSize);
+		block->m_Next = sizeClass.m_FreeList;
+		sizeClass.m_FreeList = block;
+	}
+
+	return true;
+}
+
+//  Instance to be utilized by anyone including this header
+MemoryPoolAllocator& memoryPoolAllocator = MemoryPoolAllocator::GetInstance();
\ No newline at end of file
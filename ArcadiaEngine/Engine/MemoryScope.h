@@ -0,0 +1,150 @@
+#pragma once
+
+#include "MemoryManager.h"
+#include "FrameAllocationMonitor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#define MEMORY_SCOPE_MAX_DEPTH		32
+#define MEMORY_SCOPE_HEADER_SIZE	16
+
+#if !MEMORY_MANAGER_ACTIVE
+#define MEMORY_SCOPE(stringPoolType)
+#else
+#define MEMORY_SCOPE_NAME_JOIN(name, line) name##line
+#define MEMORY_SCOPE_NAME(line) MEMORY_SCOPE_NAME_JOIN(memoryScope, line)
+
+//  Attributes every global operator new made on this thread, until the end of the enclosing scope, to the given memory pool.
+//  The real size of each allocation is recorded with it, so the matching delete is accounted for without any bookkeeping.
+#define MEMORY_SCOPE(stringPoolType) MemoryScope MEMORY_SCOPE_NAME(__LINE__)(MEMORY_POOL_ID(stringPoolType))
+
+class MemoryScope
+{
+public:
+	//  Plain data so the thread-local stack needs no dynamic initialization (it is touched from inside operator new)
+	struct TagStack
+	{
+		int m_PoolIDs[MEMORY_SCOPE_MAX_DEPTH];
+		int m_Depth;
+		bool m_InHook;
+	};
+
+	static TagStack& GetTagStack() { thread_local TagStack TAGS = {}; return TAGS; }
+	static int GetActivePoolID();
+
+	explicit MemoryScope(int poolID);
+	~MemoryScope();
+
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+};
+
+inline int MemoryScope::GetActivePoolID()
+{
+	auto& tags = GetTagStack();
+	if (tags.m_InHook) return -1;
+
+	//  Scopes nested deeper than the stack allows are attributed to the deepest one that fit
+	auto depth = std::min<int>(tags.m_Depth, MEMORY_SCOPE_MAX_DEPTH);
+	return (depth > 0) ? tags.m_PoolIDs[depth - 1] : -1;
+}
+
+inline MemoryScope::MemoryScope(int poolID)
+{
+	auto& tags = GetTagStack();
+	if (tags.m_Depth < MEMORY_SCOPE_MAX_DEPTH) tags.m_PoolIDs[tags.m_Depth] = poolID;
+	++tags.m_Depth;
+}
+
+inline MemoryScope::~MemoryScope()
+{
+	--GetTagStack().m_Depth;
+}
+#endif
+
+#if MEMORY_MANAGER_ACTIVE || FRAME_ALLOCATION_MONITOR_ACTIVE
+//  Every global allocation carries a small header holding its requested size and the pool it was attributed to (if any)
+struct GlobalAllocationHeader
+{
+	size_t m_Size;
+	int m_PoolID;
+};
+static_assert(sizeof(GlobalAllocationHeader) <= MEMORY_SCOPE_HEADER_SIZE && alignof(std::max_align_t) <= MEMORY_SCOPE_HEADER_SIZE, "The global allocation header must preserve malloc alignment");
+
+inline void* GlobalAllocate(size_t size) noexcept
+{
+#if FRAME_ALLOCATION_MONITOR_ACTIVE
+	FrameAllocationMonitor::CountHeapAllocation(size);
+#endif
+
+	auto block = static_cast<char*>(malloc(size + MEMORY_SCOPE_HEADER_SIZE));
+	if (block == nullptr) return nullptr;
+
+	auto header = reinterpret_cast<GlobalAllocationHeader*>(block);
+	header->m_Size = size;
+	header->m_PoolID = -1;
+
+#if MEMORY_MANAGER_ACTIVE
+	auto poolID = MemoryScope::GetActivePoolID();
+	if (poolID >= 0)
+	{
+		//  Accounting must never be attributed back to itself, should it ever allocate
+		auto& tags = MemoryScope::GetTagStack();
+		tags.m_InHook = true;
+		header->m_PoolID = poolID;
+		MemoryManager::GetInstance().RecordMemoryNew(poolID, size);
+		tags.m_InHook = false;
+	}
+#endif
+
+	return block + MEMORY_SCOPE_HEADER_SIZE;
+}
+
+inline void GlobalFree(void* memory) noexcept
+{
+	if (memory == nullptr) return;
+
+	auto block = static_cast<char*>(memory) - MEMORY_SCOPE_HEADER_SIZE;
+#if MEMORY_MANAGER_ACTIVE
+	auto header = reinterpret_cast<GlobalAllocationHeader*>(block);
+	if (header->m_PoolID >= 0)
+	{
+		auto& tags = MemoryScope::GetTagStack();
+		auto wasInHook = tags.m_InHook;
+		tags.m_InHook = true;
+		MemoryManager::GetInstance().ManageMemoryDelete(header->m_PoolID, header->m_Size);
+		tags.m_InHook = wasInHook;
+	}
+#endif
+	free(block);
+}
+
+//  Replacements for the global allocation functions. These are defined here (rather than inline) because the engine is compiled
+//  as a single translation unit. The over-aligned C++17 overloads are left to the standard library.
+void* operator new(size_t size)
+{
+	auto memory = GlobalAllocate(size);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	auto memory = GlobalAllocate(size);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return GlobalAllocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return GlobalAllocate(size); }
+
+void operator delete(void* memory) noexcept { GlobalFree(memory); }
+void operator delete[](void* memory) noexcept { GlobalFree(memory); }
+void operator delete(void* memory, size_t) noexcept { GlobalFree(memory); }
+void operator delete[](void* memory, size_t) noexcept { GlobalFree(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { GlobalFree(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { GlobalFree(memory); }
+#endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "MemoryManager.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#define SCENE_ARENA_INITIAL_SIZE		(1024 * 64) // 64KB
+#define SCENE_ARENA_LARGEST_POOL_BLOCK	(1024 * 64) // Strings and lists bigger than this go (unrecycled) to the arena itself
+
+//  A memory resource that owns everything built for a single scene (a dialogue and its UI nodes, strings and child lists).
+//  Allocation is a monotonic pointer bump and nothing is given back individually; when the arena is destroyed every chunk it
+//  took from the general heap is released in one piece.
+//
+//  Nodes are allocated straight from the monotonic resource, as they live as long as the scene. Strings and containers go
+//  through a pool resource layered on top of it instead, since a long-lived dialogue may change them every frame. The pool
+//  keeps what they free and hands it out again, so the arena only grows with the most they ever hold at once.
+//
+//  An arena only receives allocations while it is the active arena on the current thread (see SceneArenaScope). Anything it
+//  owns must not outlive it.
+class SceneArena
+{
+public:
+	explicit SceneArena(size_t initialSize = SCENE_ARENA_INITIAL_SIZE);
+	~SceneArena() {}
+
+	SceneArena(const SceneArena&) = delete;
+	SceneArena& operator=(const SceneArena&) = delete;
+
+	static SceneArena* GetActive() { return GetActiveSlot(); }
+	static std::pmr::memory_resource* GetActiveResource() { auto sceneArena = GetActive(); return (sceneArena != nullptr) ? sceneArena->GetResource() : std::pmr::get_default_resource(); }
+
+	std::pmr::memory_resource* GetResource() { return &m_Pool; }
+	void* Allocate(size_t amount, size_t alignment = alignof(std::max_align_t)) { return m_Resource.allocate(amount, alignment); }
+	bool Owns(const void* memory) const { return m_Chunks.Owns(memory); }
+	size_t GetReservedBytes() const { return m_Chunks.GetReservedBytes(); }
+
+private:
+	friend class SceneArenaScope;
+
+	static SceneArena*& GetActiveSlot() { thread_local SceneArena* ACTIVE = nullptr; return ACTIVE; }
+
+	//  Upstream of the monotonic resource. Takes the arena's chunks from the general heap, accounts for them and remembers their
+	//  address ranges so the arena can tell whether a pointer belongs to it.
+	class ChunkResource : public std::pmr::memory_resource
+	{
+	public:
+		ChunkResource() : m_ReservedBytes(0) {}
+
+		bool Owns(const void* memory) const;
+		size_t GetReservedBytes() const { return m_ReservedBytes; }
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* memory, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		std::vector<std::pair<const char*, size_t>> m_ChunkList;
+		size_t m_ReservedBytes;
+	};
+
+	//  The chunk resource must be declared first, so it outlives the monotonic resource that hands its chunks back on destruction
+	//  (and that in turn outlives the pool drawing from it)
+	ChunkResource m_Chunks;
+	std::pmr::monotonic_buffer_resource m_Resource;
+	std::pmr::unsynchronized_pool_resource m_Pool;
+};
+
+//  Makes a scene arena the active arena on the current thread for the lifetime of the scope, restoring the previous one after
+class SceneArenaScope
+{
+public:
+	explicit SceneArenaScope(SceneArena* sceneArena) : m_PreviousArena(SceneArena::GetActiveSlot()) { SceneArena::GetActiveSlot() = sceneArena; }
+	~SceneArenaScope() { SceneArena::GetActiveSlot() = m_PreviousArena; }
+
+	SceneArenaScope(const SceneArenaScope&) = delete;
+	SceneArenaScope& operator=(const SceneArenaScope&) = delete;
+
+private:
+	SceneArena* m_PreviousArena;
+};
+
+inline SceneArena::SceneArena(size_t initialSize) :
+	m_Resource(initialSize, &m_Chunks),
+	m_Pool(std::pmr::pool_options{ 0, SCENE_ARENA_LARGEST_POOL_BLOCK }, &m_Resource)
+{
+
+}
+
+inline bool SceneArena::ChunkResource::Owns(const void* memory) const
+{
+	auto address = static_cast<const char*>(memory);
+	for (auto iter = m_ChunkList.begin(); iter != m_ChunkList.end(); ++iter)
+		if (address >= (*iter).first && address < (*iter).first + (*iter).second) return true;
+
+	return false;
+}
+
+inline void* SceneArena::ChunkResource::do_allocate(size_t bytes, size_t alignment)
+{
+	auto chunk = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	m_ChunkList.push_back(std::make_pair(static_cast<const char*>(chunk), bytes));
+	m_ReservedBytes += bytes;
+	MANAGE_MEMORY_NEW("SceneArena", bytes);
+	return chunk;
+}
+
+inline void SceneArena::ChunkResource::do_deallocate(void* memory, size_t bytes, size_t alignment)
+{
+	auto chunkIter = std::find_if(m_ChunkList.begin(), m_ChunkList.end(), [=](const std::pair<const char*, size_t>& chunk) { return chunk.first == memory; });
+	if (chunkIter != m_ChunkList.end()) m_ChunkList.erase(chunkIter);
+	m_ReservedBytes -= bytes;
+	MANAGE_MEMORY_DELETE("SceneArena", bytes);
+	std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+}
\ No newline at end of file
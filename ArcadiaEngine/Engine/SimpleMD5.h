@@ -166,7 +166,7 @@ inline MD5::MD5()
 inline MD5::MD5(const std::vector<unsigned char>& data)
 {
 	init();
-	update((const char*)(data.data()), UINT(data.size()));
+	update((const char*)(data.data()), size_type(data.size()));
 	finalize();
 }
 
@@ -175,7 +175,7 @@ inline MD5::MD5(const char* data, int dataCount, int dataLength)
 {
 	init();
 	for (int i = 0; i < dataCount; ++i)
-		update(pcuchar(&data[i * dataLength]), UINT(dataLength));
+		update(pcuchar(&data[i * dataLength]), size_type(dataLength));
 	finalize();
 }
 
@@ -183,7 +183,7 @@ inline MD5::MD5(const char* data, int dataCount, int dataLength)
 inline MD5::MD5(const std::string &text)
 {
 	init();
-	update(text.c_str(), UINT(text.length()));
+	update(text.c_str(), size_type(text.length()));
 	finalize();
 }
 
@@ -409,7 +409,7 @@ inline std::string MD5::hexdigest() const
 	if (!finalized) return "";
 
 	char buf[33];
-	for (auto i = 0; i < 16; i++) sprintf_s(buf + i * 2, 3, "%02x", digest[i]);
+	for (auto i = 0; i < 16; i++) snprintf(buf + i * 2, 3, "%02x", digest[i]);
 	buf[32] = 0;
 
 	return std::string(buf);
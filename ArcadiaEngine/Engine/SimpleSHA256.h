@@ -3,6 +3,7 @@
 #ifndef SHA256_H
 #define SHA256_H
 
+#include <cstdio>
 #include <string>
 #include <cstring>
 #include <fstream>
@@ -182,7 +183,7 @@ std::string sha256(std::string input)
 	char buf[2 * SHA256::DIGEST_SIZE + 1];
 	buf[2 * SHA256::DIGEST_SIZE] = 0;
 	for (int i = 0; i < SHA256::DIGEST_SIZE; i++)
-		sprintf_s(buf + i * 2, 3, "%02x", digest[i]);
+		snprintf(buf + i * 2, 3, "%02x", digest[i]);
 	return std::string(buf);
 }
 
@@ -200,7 +201,7 @@ std::string sha256(char* data, int dataCount, int dataLength)
 	char buf[2 * SHA256::DIGEST_SIZE + 1];
 	buf[2 * SHA256::DIGEST_SIZE] = 0;
 	for (int i = 0; i < SHA256::DIGEST_SIZE; i++)
-		sprintf_s(buf + i * 2, 3, "%02x", digest[i]);
+		snprintf(buf + i * 2, 3, "%02x", digest[i]);
 	return std::string(buf);
 }
 
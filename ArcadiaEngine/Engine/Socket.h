@@ -1,20 +1,53 @@
 #pragma once
 
+#include "DatagramBatch.h"
 #include "SocketBuffer.h"
+#include "SocketCompression.h"
+#include "SocketPlatform.h"
 
+#include <algorithm>
+#include <climits>
 #include <string>
-#include <WS2tcpip.h>
-#pragma comment(lib, "Ws2_32.lib")
+#include <vector>
+
+#define SOCKET_FRAME_HEADER_MAX_SIZE	8
+#define SOCKET_FRAME_MAX_SIZE			(1024 * 1024 * 64) // 64MB
+#define SOCKET_RECEIVE_CHUNK_SIZE		(1024 * 4) // 4KB
+#define SOCKET_UNSENT_MAX_SIZE			(1024 * 1024 * 4) // 4MB held for a backed up peer before sends are refused
+
+//  How the length before each message is written when a TCP socket uses data format 0
+enum SocketFrameLengthTypes { SOCKET_FRAME_LENGTH_16 = 0, SOCKET_FRAME_LENGTH_32, SOCKET_FRAME_LENGTH_VARINT, SOCKET_FRAME_LENGTH_TYPE_COUNT };
 
 class Socket
 {
 private:
 	bool m_IsConnectionUDP;
 	int m_DataFormat;
+	int m_FrameLengthType;
+	int m_CompressionThreshold;
 	char m_FormatString[30];
-	static SOCKADDR_IN SenderAddr;
+
+	//  Where the last datagram (or accepted connection) this socket received came from
+	SOCKADDR_IN m_SenderAddress;
 
 	int receivetext(char*buf, int max);
+	int receivescatter(char* first, int firstSize, char* second, int secondSize) const;
+	int takeringmessage(SocketBuffer* destination, SocketBuffer::MessageView& view) const;
+	int writeframeheader(char* header, int payloadSize) const;
+	int readframeheader(const unsigned char* header, int available, int& payloadSize) const;
+	int takeframe(SocketBuffer* destination);
+	int receiveframe(SocketBuffer* destination);
+	void keepunsent(const SocketIOBuffer* ioBuffers, int ioBufferCount, int sentCount);
+	int sendunsent();
+
+	//  Messages waiting for flushmessages, and the tail of anything a send only partly wrote (sent first, ahead of anything new)
+	std::vector<SocketBuffer*> m_SendQueue;
+	SocketBuffer m_UnsentData;
+
+	//  Framing state for format 0: received data waiting to be handed out, and the payload size of the frame at its read
+	//  position once that frame's header has been read (or -1 while it is still unknown)
+	SocketBuffer m_ReceiveData;
+	int m_FramePayloadSize;
 
 public:
 	SOCKET m_SocketID;
@@ -23,6 +56,9 @@ public:
 	Socket();
 	~Socket();
 
+	static void* operator new(size_t size) { return memoryPoolAllocator.Allocate(size); }
+	static void operator delete(void* memory, size_t size) { memoryPoolAllocator.Free(memory, size); }
+
 	bool tcpconnect(const char* address, int port, int mode);
 	bool tcplisten(int port, int max, int mode);
 	Socket* tcpaccept(int mode) const;
@@ -32,25 +68,42 @@ public:
 	int setsync(int mode) const;
 	bool udpconnect(int port, int mode);
 	int sendmessage(const char* ip, int port, SocketBuffer* source);
+	int sendgather(SocketBuffer** sources, int sourceCount);
+	void queuemessage(SocketBuffer* source);
+	void unqueuemessages(SocketBuffer* source);
+	int flushmessages();
+	int queuedmessages() const { return int(m_SendQueue.size()); }
+	int unsentbytes() const { return m_UnsentData.bytesleft(); }
 	int receivemessage(int len, SocketBuffer*destination, int length_specific = 0);
-	int peekmessage(int size, SocketBuffer*destination) const;
+	int receivemessageview(SocketBuffer* destination, SocketBuffer::MessageView& view);
+	int receivedatagrams(DatagramBatch& batch);
+	int senddatagrams(DatagramBatch& batch, int first = 0);
+	int peekmessage(int size, SocketBuffer*destination);
 	static int lasterror();
 	static std::string GetHostIP(const char* address);
 	static int SockExit(void);
 	static int SockStart(void);
-	static char* lastinIP(void);
-	static unsigned short lastinPort(void);
+	std::string lastinIP() const;
+	unsigned short lastinPort() const;
 	static char* myhost();
 	int SetFormat(int mode, char* sep);
-};
+	int SetFrameLengthType(int frameLengthType);
 
-int SenderAddrSize = sizeof(SOCKADDR_IN);
-SOCKADDR_IN Socket::SenderAddr;
+	bool isudp() const { return m_IsConnectionUDP; }
+	int dataformat() const { return m_DataFormat; }
+
+	//  Compression is negotiated and applied by WinsockWrapper (see SocketCompression.h). A negative threshold means this end
+	//  doesn't want it.
+	void setcompression(int threshold) { m_CompressionThreshold = threshold; }
+	int compressionthreshold() const { return m_CompressionThreshold; }
+	bool compressionenabled() const { return m_CompressionThreshold >= 0; }
+	SocketCompressionState m_CompressionState;
+};
 
 inline bool Socket::tcpconnect(const char *address, int port, int mode)
 {
 	char portString[16];
-	sprintf_s(portString, 16, "%d", port);
+	snprintf(portString, 16, "%d", port);
 
 	if ((m_SocketID = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == SOCKET_ERROR) return false;
 
@@ -110,16 +163,26 @@ inline bool Socket::tcplisten(int port, int max, int mode)
 inline Socket::Socket(SOCKET sock) :
 	m_SocketID(sock),
 	m_IsConnectionUDP(false),
-	m_DataFormat(0)
+	m_DataFormat(0),
+	m_FrameLengthType(SOCKET_FRAME_LENGTH_16),
+	m_CompressionThreshold(-1),
+	m_FramePayloadSize(-1),
+	m_CompressionState()
 {
+	memset(&m_SenderAddress, 0, sizeof(m_SenderAddress));
 
 }
 
 inline Socket::Socket() :
 	m_SocketID(0),
 	m_IsConnectionUDP(false),
-	m_DataFormat(0)
+	m_DataFormat(0),
+	m_FrameLengthType(SOCKET_FRAME_LENGTH_16),
+	m_CompressionThreshold(-1),
+	m_FramePayloadSize(-1),
+	m_CompressionState()
 {
+	memset(&m_SenderAddress, 0, sizeof(m_SenderAddress));
 
 }
 
@@ -134,10 +197,13 @@ inline Socket* Socket::tcpaccept(int mode) const
 {
 	if (m_SocketID < 0) return nullptr;
 	SOCKET sock2;
-	if ((sock2 = accept(m_SocketID, (SOCKADDR *)&SenderAddr, &SenderAddrSize)) != INVALID_SOCKET)
+	SOCKADDR_IN address;
+	socklen_t addressSize = sizeof(SOCKADDR_IN);
+	if ((sock2 = accept(m_SocketID, (SOCKADDR *)&address, &addressSize)) != INVALID_SOCKET)
 	{
-		MANAGE_MEMORY_NEW("Socket", sizeof(Socket));
+		MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(Socket));
 		auto sockit = new Socket(sock2);
+		sockit->m_SenderAddress = address;
 		if (mode >= 1)sockit->setsync(1);
 		return sockit;
 	}
@@ -147,10 +213,12 @@ inline Socket* Socket::tcpaccept(int mode) const
 inline std::string Socket::tcpip() const
 {
 	if (m_SocketID < 0) return nullptr;
-	if (getpeername(m_SocketID, (SOCKADDR *)&SenderAddr, &SenderAddrSize) == SOCKET_ERROR) return nullptr;
+	SOCKADDR_IN address;
+	socklen_t addressSize = sizeof(SOCKADDR_IN);
+	if (getpeername(m_SocketID, (SOCKADDR *)&address, &addressSize) == SOCKET_ERROR) return nullptr;
 
 	char ipAddress[32];
-	inet_ntop(AF_INET, &SenderAddr.sin_addr, ipAddress, INET_ADDRSTRLEN);
+	inet_ntop(AF_INET, &address.sin_addr, ipAddress, INET_ADDRSTRLEN);
 	return std::string(ipAddress);
 }
 
@@ -204,32 +272,243 @@ inline int Socket::sendmessage(const char *ip, int port, SocketBuffer *source)
 		struct sockaddr_in sa;
 		inet_pton(AF_INET, ip, &(sa.sin_addr)); //  TODO: Is this line even needed?
 
-		size = std::min<int>(source->m_BufferUtilizedCount, 8195);
+		size = std::min<int>(source->m_BufferUtilizedCount, DATAGRAM_MAX_SIZE);
 		addr.sin_family = AF_INET;
 		addr.sin_port = htons(port);
-		addr.sin_addr.s_addr = sa.sin_addr.S_un.S_addr;
-		size = sendto(m_SocketID, source->m_BufferData, size, 0, (SOCKADDR *)&addr, sizeof(SOCKADDR_IN));
+		addr.sin_addr.s_addr = sa.sin_addr.s_addr;
+		size = sendto(m_SocketID, source->m_BufferData, size, SOCKET_SEND_FLAGS, (SOCKADDR *)&addr, sizeof(SOCKADDR_IN));
 	}
-	else
+	else size = sendgather(&source, 1);
+	return ((size == SOCKET_ERROR) ? -WSAGetLastError() : size);
+}
+
+inline int Socket::writeframeheader(char* header, int payloadSize) const
+{
+	if (m_DataFormat != 0) return 0;
+
+	switch (m_FrameLengthType)
+	{
+	case SOCKET_FRAME_LENGTH_32:
+	{
+		auto length = (unsigned int)(payloadSize);
+		memcpy(header, &length, 4);
+		return 4;
+	}
+
+	case SOCKET_FRAME_LENGTH_VARINT:
 	{
-		SocketBuffer sendbuff;
-		sendbuff.clear();
-		if (m_DataFormat == 0)
+		//  Seven bits at a time, lowest first, with the top bit set on every byte but the last
+		auto length = (unsigned int)(payloadSize);
+		auto headerSize = 0;
+		do
 		{
-			sendbuff.writeushort(source->m_BufferUtilizedCount);
-			sendbuff.addBuffer(source);
-			size = send(m_SocketID, sendbuff.m_BufferData, sendbuff.m_BufferUtilizedCount, 0);
+			auto byte = (unsigned char)(length & 0x7F);
+			length >>= 7;
+			header[headerSize++] = char((length != 0) ? (byte | 0x80) : byte);
+		} while (length != 0);
+		return headerSize;
+	}
+
+	default:
+	{
+		auto length = (unsigned short)(payloadSize);
+		memcpy(header, &length, 2);
+		return 2;
+	}
+	}
+}
+
+inline int Socket::readframeheader(const unsigned char* header, int available, int& payloadSize) const
+{
+	//  Returns the size of the header once all of it is available, 0 while more is needed, or -1 if it can't be a valid frame
+	switch (m_FrameLengthType)
+	{
+	case SOCKET_FRAME_LENGTH_32:
+	{
+		if (available < 4) return 0;
+		unsigned int length;
+		memcpy(&length, header, 4);
+		if (length > SOCKET_FRAME_MAX_SIZE) return -1;
+		payloadSize = int(length);
+		return 4;
+	}
+
+	case SOCKET_FRAME_LENGTH_VARINT:
+	{
+		unsigned int length = 0;
+		for (auto i = 0; i < 5; ++i)
+		{
+			if (i >= available) return 0;
+			length |= (unsigned int)(header[i] & 0x7F) << (7 * i);
+			if ((header[i] & 0x80) != 0) continue;
+			if (length > SOCKET_FRAME_MAX_SIZE) return -1;
+			payloadSize = int(length);
+			return i + 1;
 		}
-		else if (m_DataFormat == 1)
+		return -1;
+	}
+
+	default:
+	{
+		if (available < 2) return 0;
+		unsigned short length;
+		memcpy(&length, header, 2);
+		payloadSize = int(length);
+		return 2;
+	}
+	}
+}
+
+inline int Socket::sendgather(SocketBuffer** sources, int sourceCount)
+{
+	//  Sends each source as its own framed message, passing the frame headers and separators alongside the buffers themselves so
+	//  nothing is copied into a combined packet. As many messages as fit in one scatter/gather call go out in a single system call.
+	//
+	//  A message is either refused outright (SOCKET_ERROR, with nothing sent) or accepted whole: if the socket only takes part of
+	//  the data, the rest is kept and goes out ahead of the next send or flush on this socket. While data is already being held,
+	//  sends that would take it past SOCKET_UNSENT_MAX_SIZE are refused with WSAEWOULDBLOCK until the peer catches up.
+	if (m_SocketID < 0 || m_IsConnectionUDP) return SOCKET_ERROR;
+
+	//  A message too large for its length header would desync the stream, so refuse the whole send instead. An empty frame is
+	//  refused too, as a receive that returns 0 means the connection closed.
+	auto maximumSize = (m_DataFormat != 0) ? INT_MAX : ((m_FrameLengthType == SOCKET_FRAME_LENGTH_16) ? 65535 : SOCKET_FRAME_MAX_SIZE);
+	for (auto i = 0; i < sourceCount; ++i)
+	{
+		if (m_DataFormat == 0 && sources[i]->m_BufferUtilizedCount == 0)
 		{
-			sendbuff.addBuffer(source);
-			sendbuff.writechars(m_FormatString);
-			size = send(m_SocketID, sendbuff.m_BufferData, sendbuff.m_BufferUtilizedCount, 0);
+			printf("Socket can't send an empty framed message\n");
+			WSASetLastError(WSAEMSGSIZE);
+			return SOCKET_ERROR;
 		}
-		else if (m_DataFormat == 2)
-			size = send(m_SocketID, source->m_BufferData, source->m_BufferUtilizedCount, 0);
+		if (sources[i]->m_BufferUtilizedCount <= maximumSize) continue;
+		printf("Socket message of %d bytes is too large for its frame length type\n", sources[i]->m_BufferUtilizedCount);
+		WSASetLastError(WSAEMSGSIZE);
+		return SOCKET_ERROR;
 	}
-	return ((size == SOCKET_ERROR) ? -WSAGetLastError() : size);
+
+	SocketIOBuffer ioBuffers[SOCKET_IO_BUFFER_MAX_COUNT];
+	char headers[SOCKET_IO_BUFFER_MAX_COUNT / 2][SOCKET_FRAME_HEADER_MAX_SIZE];
+	auto separatorLength = (m_DataFormat == 1) ? int(strlen(m_FormatString)) : 0;
+
+	//  Held data is pushed out on its own first if these messages would take it over the limit, and they're only refused if the
+	//  peer still isn't taking enough
+	if (m_UnsentData.bytesleft() > 0)
+	{
+		long long incomingSize = 0;
+		for (auto i = 0; i < sourceCount; ++i) incomingSize += SOCKET_FRAME_HEADER_MAX_SIZE + sources[i]->m_BufferUtilizedCount + separatorLength;
+		if (m_UnsentData.bytesleft() + incomingSize > SOCKET_UNSENT_MAX_SIZE)
+		{
+			if (sendunsent() == SOCKET_ERROR && lasterror() != WSAEWOULDBLOCK) return SOCKET_ERROR;
+			if (m_UnsentData.bytesleft() > 0 && m_UnsentData.bytesleft() + incomingSize > SOCKET_UNSENT_MAX_SIZE)
+			{
+				WSASetLastError(WSAEWOULDBLOCK);
+				return SOCKET_ERROR;
+			}
+		}
+	}
+	auto sourceIndex = 0;
+	auto totalSent = 0;
+	auto stalled = false;
+
+	do
+	{
+		auto ioBufferCount = 0;
+		auto unsentSize = m_UnsentData.bytesleft();
+		if (unsentSize > 0) SetSocketIOBuffer(ioBuffers[ioBufferCount++], m_UnsentData.m_BufferData + m_UnsentData.m_ReadPosition, unsentSize);
+
+		for (auto headerIndex = 0; sourceIndex < sourceCount && ioBufferCount + 3 <= SOCKET_IO_BUFFER_MAX_COUNT && headerIndex < SOCKET_IO_BUFFER_MAX_COUNT / 2; ++sourceIndex, ++headerIndex)
+		{
+			auto source = sources[sourceIndex];
+			auto headerSize = writeframeheader(headers[headerIndex], source->m_BufferUtilizedCount);
+			if (headerSize > 0) SetSocketIOBuffer(ioBuffers[ioBufferCount++], headers[headerIndex], headerSize);
+			if (source->m_BufferUtilizedCount > 0) SetSocketIOBuffer(ioBuffers[ioBufferCount++], source->m_BufferData, source->m_BufferUtilizedCount);
+			if (separatorLength > 0) SetSocketIOBuffer(ioBuffers[ioBufferCount++], m_FormatString, separatorLength);
+		}
+		if (ioBufferCount == 0) break;
+
+		//  Once anything has gone out every message is accepted, so a later call that can't send just keeps its data for next time
+		auto sentCount = stalled ? 0 : SendSocketIOBuffers(m_SocketID, ioBuffers, ioBufferCount);
+		if (sentCount == SOCKET_ERROR)
+		{
+			if (totalSent == 0) return SOCKET_ERROR;
+			stalled = true;
+			sentCount = 0;
+		}
+
+		totalSent += sentCount;
+		keepunsent(ioBuffers, ioBufferCount, sentCount);
+	} while (sourceIndex < sourceCount);
+
+	return totalSent;
+}
+
+inline void Socket::keepunsent(const SocketIOBuffer* ioBuffers, int ioBufferCount, int sentCount)
+{
+	for (auto i = 0; i < ioBufferCount; ++i)
+	{
+		auto data = GetSocketIOBufferData(ioBuffers[i]);
+		auto size = GetSocketIOBufferSize(ioBuffers[i]);
+		auto sentFromBuffer = std::min<int>(sentCount, size);
+		sentCount -= sentFromBuffer;
+
+		//  Data already held from an earlier partial send only needs the sent part marking as read. Once more than half the buffer
+		//  has been sent the rest is moved back to the front, so a peer that stays behind doesn't keep the buffer growing.
+		if (data == m_UnsentData.m_BufferData + m_UnsentData.m_ReadPosition)
+		{
+			m_UnsentData.m_ReadPosition += sentFromBuffer;
+			if (m_UnsentData.m_ReadPosition > m_UnsentData.capacity() / 2)
+			{
+				auto remaining = m_UnsentData.bytesleft();
+				memmove(m_UnsentData.m_BufferData, m_UnsentData.m_BufferData + m_UnsentData.m_ReadPosition, remaining);
+				m_UnsentData.m_ReadPosition = 0;
+				m_UnsentData.m_BufferUtilizedCount = m_UnsentData.m_WritePosition = remaining;
+			}
+			continue;
+		}
+
+		if (sentFromBuffer < size)
+		{
+			MEMORY_SCOPE("WinsockWrapper");
+			m_UnsentData.StreamWrite((void*)(data + sentFromBuffer), size - sentFromBuffer);
+		}
+	}
+
+	if (m_UnsentData.bytesleft() == 0) m_UnsentData.clear();
+}
+
+inline int Socket::sendunsent()
+{
+	//  Sends as much of the data held from earlier partial sends as the socket will take, and returns how much that was
+	auto unsentSize = m_UnsentData.bytesleft();
+	if (unsentSize == 0) return 0;
+
+	SocketIOBuffer ioBuffer;
+	SetSocketIOBuffer(ioBuffer, m_UnsentData.m_BufferData + m_UnsentData.m_ReadPosition, unsentSize);
+	auto sentCount = SendSocketIOBuffers(m_SocketID, &ioBuffer, 1);
+	if (sentCount == SOCKET_ERROR) return SOCKET_ERROR;
+
+	keepunsent(&ioBuffer, 1, sentCount);
+	return sentCount;
+}
+
+inline void Socket::queuemessage(SocketBuffer* source)
+{
+	//  The buffer isn't copied, so it must be left untouched until the queue is flushed
+	MEMORY_SCOPE("WinsockWrapper");
+	m_SendQueue.push_back(source);
+}
+
+inline void Socket::unqueuemessages(SocketBuffer* source)
+{
+	m_SendQueue.erase(std::remove(m_SendQueue.begin(), m_SendQueue.end(), source), m_SendQueue.end());
+}
+
+inline int Socket::flushmessages()
+{
+	//  A refused flush leaves the queue as it was, so it can be tried again
+	auto size = sendgather(m_SendQueue.data(), int(m_SendQueue.size()));
+	if (size != SOCKET_ERROR) m_SendQueue.clear();
+	return size;
 }
 
 inline int Socket::receivetext(char*buf, int max)
@@ -251,77 +530,275 @@ inline int Socket::receivetext(char*buf, int max)
 
 inline int Socket::receivemessage(int len, SocketBuffer* destination, int length_specific)
 {
+	//  Framed messages carry their own length, so length_specific is no longer needed and is ignored
 	if (m_SocketID < 0) return -1;
+	if (!m_IsConnectionUDP && m_DataFormat == 0 && !len) return receiveframe(destination);
+
 	auto size = -1;
-	char* buff = nullptr;
 	if (m_IsConnectionUDP)
 	{
-		size = 8195;
-		MANAGE_MEMORY_NEW("WinsockWrapper", size);
-		buff = new char[size];
-		size = recvfrom(m_SocketID, buff, size, 0, (SOCKADDR *)&SenderAddr, &SenderAddrSize);
+		//  Datagrams and raw reads go straight into the destination's storage
+		destination->clear();
+		destination->reserve(DATAGRAM_MAX_SIZE);
+		socklen_t addressSize = sizeof(SOCKADDR_IN);
+		size = recvfrom(m_SocketID, destination->m_BufferData, DATAGRAM_MAX_SIZE, 0, (SOCKADDR *)&m_SenderAddress, &addressSize);
+		if (size > 0) destination->m_BufferUtilizedCount = destination->m_WritePosition = size;
 	}
-	else
+	else if (m_DataFormat == 1 && !len)
 	{
-		if (m_DataFormat == 0 && !len)
+		//  The receive buffer only lives until the data is copied into the destination, so take it from the frame arena
+		FrameArenaScope frameScope;
+		auto buff = FrameArena::GetInstance().AllocateArray<char>(65536);
+		size = receivetext(buff, 65536);
+		if (size > 0)
 		{
-			if (length_specific == 0)
-			{
-				//  Check that 2 bytes have been received, noting the length of the incoming message. Peek the data in case it hasn't fully arrived.
-				if ((size = recv(m_SocketID, (char*)&length_specific, 2, MSG_PEEK)) == SOCKET_ERROR) { return -1; }
-				if (size == 0) { return 0; }
-			}
-
-			auto buffer_size = length_specific;
-			MANAGE_MEMORY_NEW("WinsockWrapper", buffer_size);
-			buff = new char[buffer_size + 2];
-			if ((size = recv(m_SocketID, buff, buffer_size, MSG_PEEK)) == SOCKET_ERROR) { return -1; } // It is possible that the full data hasn't arrived yet, so peek first
-			size = recv(m_SocketID, buff, buffer_size + 2, 0);
+			destination->clear();
+			destination->addBuffer(buff, size);
 		}
-		else if (m_DataFormat == 1 && !len)
+	}
+	else if (m_DataFormat == 2 || len > 0)
+	{
+		destination->clear();
+		destination->reserve(len);
+		size = recv(m_SocketID, destination->m_BufferData, len, 0);
+		if (size > 0) destination->m_BufferUtilizedCount = destination->m_WritePosition = size;
+	}
+	return size;
+}
+
+inline int Socket::takeframe(SocketBuffer* destination)
+{
+	//  Hands out the frame at the front of the received data if all of it has arrived. Returns 1 if it did, 0 if the frame is
+	//  still incomplete, or -1 if the data can't be a valid frame. Empty frames (which sendgather won't send) are skipped, so a
+	//  frame handed out always has something in it.
+	auto data = reinterpret_cast<const unsigned char*>(m_ReceiveData.m_BufferData + m_ReceiveData.m_ReadPosition);
+	auto available = m_ReceiveData.bytesleft();
+	while (m_FramePayloadSize <= 0)
+	{
+		m_FramePayloadSize = -1;
+		auto headerSize = readframeheader(data, available, m_FramePayloadSize);
+		if (headerSize <= 0) return headerSize;
+
+		//  The header is consumed as soon as it is complete, so the next pass only waits on the payload
+		m_ReceiveData.m_ReadPosition += headerSize;
+		data += headerSize;
+		available -= headerSize;
+	}
+	if (available < m_FramePayloadSize) return 0;
+
+	destination->clear();
+	destination->addBuffer((char*)(data), m_FramePayloadSize);
+	m_ReceiveData.m_ReadPosition += m_FramePayloadSize;
+	m_FramePayloadSize = -1;
+	if (m_ReceiveData.bytesleft() == 0) m_ReceiveData.clear();
+	return 1;
+}
+
+inline int Socket::receiveframe(SocketBuffer* destination)
+{
+	//  Frames are reassembled here across as many partial reads as they take. Each call makes at most one recv, and none at all
+	//  while a complete frame is already waiting, so an event loop can call this once per readiness event.
+	auto frameResult = takeframe(destination);
+	if (frameResult == 0)
+	{
+		//  Move whatever is left of the received data to the front, then make room for at least the rest of the frame
+		if (m_ReceiveData.m_ReadPosition > 0)
 		{
-			size = 65536;
-			MANAGE_MEMORY_NEW("WinsockWrapper", size);
-			buff = new char[size];
-			size = receivetext(buff, size);
+			auto remaining = m_ReceiveData.bytesleft();
+			memmove(m_ReceiveData.m_BufferData, m_ReceiveData.m_BufferData + m_ReceiveData.m_ReadPosition, remaining);
+			m_ReceiveData.m_ReadPosition = 0;
+			m_ReceiveData.m_BufferUtilizedCount = m_ReceiveData.m_WritePosition = remaining;
 		}
-		else if (m_DataFormat == 2 || len > 0)
+
+		auto wanted = std::max<int>(SOCKET_RECEIVE_CHUNK_SIZE, (m_FramePayloadSize >= 0) ? (m_FramePayloadSize - m_ReceiveData.m_BufferUtilizedCount) : 0);
+		m_ReceiveData.reserve(m_ReceiveData.m_BufferUtilizedCount + wanted);
+		auto freeSpace = m_ReceiveData.capacity() - m_ReceiveData.m_BufferUtilizedCount;
+
+		auto size = recv(m_SocketID, m_ReceiveData.m_BufferData + m_ReceiveData.m_BufferUtilizedCount, freeSpace, 0);
+		if (size == SOCKET_ERROR) return -1;
+		if (size == 0) return 0;
+		m_ReceiveData.m_BufferUtilizedCount += size;
+		m_ReceiveData.m_WritePosition = m_ReceiveData.m_BufferUtilizedCount;
+
+		frameResult = takeframe(destination);
+		if (frameResult == 0)
 		{
-			MANAGE_MEMORY_NEW("WinsockWrapper", len);
-			buff = new char[len];
-			size = recv(m_SocketID, buff, len, 0);
+			//  Only part of a frame has arrived so far
+			WSASetLastError(WSAEWOULDBLOCK);
+			return -1;
 		}
 	}
-	if (size > 0)
+
+	if (frameResult < 0)
 	{
-		destination->clear();
-		destination->addBuffer(buff + 2, size);
+		printf("Socket received an invalid frame header. The connection can't be read any further.\n");
+		WSASetLastError(WSAEMSGSIZE);
+		return -1;
 	}
-	if (buff != nullptr)
+	return destination->m_BufferUtilizedCount;
+}
+
+inline int Socket::receivescatter(char* first, int firstSize, char* second, int secondSize) const
+{
+	//  Fills both free regions of a receive ring with a single call
+	SocketIOBuffer ioBuffers[2];
+	SetSocketIOBuffer(ioBuffers[0], first, firstSize);
+	SetSocketIOBuffer(ioBuffers[1], second, secondSize);
+	return ReceiveSocketIOBuffers(m_SocketID, ioBuffers, (secondSize > 0) ? 2 : 1);
+}
+
+inline int Socket::takeringmessage(SocketBuffer* destination, SocketBuffer::MessageView& view) const
+{
+	//  Returns 1 if a message was taken, 0 if there isn't a complete one yet, or -1 if the data can't be a valid frame
+	auto readable = destination->GetRingReadable();
+	if (m_DataFormat == 0)
 	{
-		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(buff));
-		delete[] buff;
+		//  A whole frame (the length header and the data it describes) must be in the ring before it can be handed out
+		unsigned char header[SOCKET_FRAME_HEADER_MAX_SIZE];
+		auto available = std::min<int>(readable, SOCKET_FRAME_HEADER_MAX_SIZE);
+		destination->PeekRing(header, 0, available);
+
+		auto payloadSize = 0;
+		auto headerSize = readframeheader(header, available, payloadSize);
+		if (headerSize <= 0) return headerSize;
+		if (readable < headerSize + payloadSize) return 0;
+
+		view.m_Data = destination->ViewRing(headerSize, payloadSize);
+		view.m_Size = payloadSize;
+		destination->SetRingView(headerSize + payloadSize);
+		return 1;
 	}
-	return size;
+
+	//  Raw data is handed out as it arrived, up to the end of the ring
+	if (readable <= 0) return 0;
+	auto readIndex = destination->m_RingReadCount & (destination->m_RingSize - 1);
+	auto size = std::min<int>(readable, int(destination->m_RingSize - readIndex));
+	view.m_Data = destination->ViewRing(0, size);
+	view.m_Size = size;
+	destination->SetRingView(size);
+	return 1;
 }
 
-inline int Socket::peekmessage(int size, SocketBuffer* destination) const
+inline int Socket::receivemessageview(SocketBuffer* destination, SocketBuffer::MessageView& view)
 {
-	if (m_SocketID < 0) return -1;
-	if (size == 0) size = 65536;
-	MANAGE_MEMORY_NEW("WinsockWrapper", size);
-	auto buff = new char[size];
-	size = recvfrom(m_SocketID, buff, size, MSG_PEEK, (SOCKADDR *)&SenderAddr, &SenderAddrSize);
-	if (size < 0)
+	//  Returns 1 with the message in the view (an empty frame is a message too, with a size of 0), 0 if the connection closed,
+	//  or -1 on error
+	view.m_Data = nullptr;
+	view.m_Size = 0;
+	if (m_SocketID < 0 || m_IsConnectionUDP || !destination->HasReceiveRing()) return -1;
+	if (m_DataFormat != 0 && m_DataFormat != 2) return -1;
+
+	//  The previous view from this buffer is finished with, so its space can be reused
+	destination->ReleaseRingView();
+	auto takeResult = takeringmessage(destination, view);
+	if (takeResult > 0) return 1;
+	if (takeResult < 0)
+	{
+		WSASetLastError(WSAEMSGSIZE);
+		return -1;
+	}
+
+	//  Receive whatever has arrived straight into the ring, with one call, then look for a complete message again
+	char* first;
+	char* second;
+	int firstSize;
+	int secondSize;
+	if (destination->GetRingWriteSegments(first, firstSize, second, secondSize) == 0)
+	{
+		printf("Socket receive ring is full without holding a complete message. Increase the ring size.\n");
+		return -1;
+	}
+
+	auto size = receivescatter(first, firstSize, second, secondSize);
+	if (size == SOCKET_ERROR) return -1;
+	if (size == 0) return 0;
+	destination->CommitRingWrite(size);
+	takeResult = takeringmessage(destination, view);
+	if (takeResult > 0) return 1;
+	if (takeResult < 0)
 	{
-		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(buff));
-		delete[] buff;
+		WSASetLastError(WSAEMSGSIZE);
 		return -1;
 	}
+
+	//  Only part of a message has arrived so far
+	WSASetLastError(WSAEWOULDBLOCK);
+	return -1;
+}
+
+inline int Socket::receivedatagrams(DatagramBatch& batch)
+{
+	//  Fills as many of the batch's slots as there are datagrams waiting, and returns how many that was. A blocking socket only
+	//  waits for the first one.
+	if (m_SocketID < 0 || !m_IsConnectionUDP) return -1;
+	batch.Clear();
+
+#if SOCKET_BATCHED_DATAGRAMS
+	batch.PrepareReceive();
+	auto count = recvmmsg(m_SocketID, batch.m_Messages.data(), (unsigned int)(batch.m_Capacity), MSG_WAITFORONE, nullptr);
+	if (count < 0) return -1;
+	for (auto i = 0; i < count; ++i) batch.m_Sizes[i] = int(batch.m_Messages[i].msg_len);
+#else
+	auto count = 0;
+	for (; count < batch.m_Capacity; ++count)
+	{
+		//  After the first datagram, stop as soon as nothing more is waiting rather than block
+		if (count > 0)
+		{
+			u_long waiting = 0;
+			if (ioctlsocket(m_SocketID, FIONREAD, &waiting) != 0 || waiting == 0) break;
+		}
+
+		socklen_t addressSize = sizeof(SOCKADDR_IN);
+		auto size = recvfrom(m_SocketID, batch.GetData(count), batch.m_SlotSize, 0, (SOCKADDR *)&batch.m_Addresses[count], &addressSize);
+		if (size == SOCKET_ERROR)
+		{
+			if (count == 0) return -1;
+			break;
+		}
+		batch.m_Sizes[count] = size;
+	}
+#endif
+
+	batch.m_Count = count;
+	if (count > 0) m_SenderAddress = batch.m_Addresses[count - 1];
+	return count;
+}
+
+inline int Socket::senddatagrams(DatagramBatch& batch, int first)
+{
+	//  Sends the batch's datagrams from the given one onward, and returns how many were sent. Anything short of the rest of the
+	//  batch can be retried by passing first + the returned count.
+	if (m_SocketID < 0 || !m_IsConnectionUDP) return -1;
+	if (first < 0 || first >= batch.m_Count) return 0;
+
+#if SOCKET_BATCHED_DATAGRAMS
+	batch.PrepareSend();
+	auto count = sendmmsg(m_SocketID, batch.m_Messages.data() + first, (unsigned int)(batch.m_Count - first), SOCKET_SEND_FLAGS);
+	if (count < 0) return -1;
+#else
+	auto count = 0;
+	for (auto i = first; i < batch.m_Count; ++i, ++count)
+	{
+		if (sendto(m_SocketID, batch.GetData(i), batch.m_Sizes[i], SOCKET_SEND_FLAGS, (SOCKADDR *)&batch.m_Addresses[i], sizeof(SOCKADDR_IN)) != SOCKET_ERROR) continue;
+		if (count == 0) return -1;
+		break;
+	}
+#endif
+	return count;
+}
+
+inline int Socket::peekmessage(int size, SocketBuffer* destination)
+{
+	if (m_SocketID < 0) return -1;
+	if (size == 0) size = 65536;
+	FrameArenaScope frameScope;
+	auto buff = FrameArena::GetInstance().AllocateArray<char>(size);
+	socklen_t addressSize = sizeof(SOCKADDR_IN);
+	size = recvfrom(m_SocketID, buff, size, MSG_PEEK, (SOCKADDR *)&m_SenderAddress, &addressSize);
+	if (size < 0) return -1;
 	destination->clear();
 	destination->addBuffer(buff, size);
-	MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(buff));
-	delete[] buff;
 	return size;
 }
 
@@ -359,35 +836,49 @@ inline std::string Socket::GetHostIP(const char* hostname)
 	return std::string(ipAddress);
 }
 
-inline char* Socket::lastinIP(void)
+inline std::string Socket::lastinIP() const
 {
-	return (char*)"";
-	////return inet_ntoa(SenderAddr.sin_addr);
+	char ipAddress[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &m_SenderAddress.sin_addr, ipAddress, INET_ADDRSTRLEN);
+	return std::string(ipAddress);
 }
 
-inline unsigned short Socket::lastinPort(void)
+inline unsigned short Socket::lastinPort() const
 {
-	return ntohs(SenderAddr.sin_port);
+	return ntohs(m_SenderAddress.sin_port);
 }
 
 inline int Socket::SetFormat(int mode, char* sep)
 {
 	auto previous = m_DataFormat;
 	m_DataFormat = mode;
-	if (mode == 1 && strlen(sep) > 0) strcpy_s(m_FormatString, 30, sep);
+	if (mode == 1 && strlen(sep) > 0) snprintf(m_FormatString, 30, "%s", sep);
+	return previous;
+}
+
+inline int Socket::SetFrameLengthType(int frameLengthType)
+{
+	//  Both ends must use the same type, and it should only change before any framed data has been sent or received
+	if (frameLengthType < 0 || frameLengthType >= SOCKET_FRAME_LENGTH_TYPE_COUNT) return -1;
+	auto previous = m_FrameLengthType;
+	m_FrameLengthType = frameLengthType;
 	return previous;
 }
 
 inline int Socket::SockExit(void)
 {
+#if defined(_WIN32)
 	WSACleanup();
+#endif
 	return 1;
 }
 
 inline int Socket::SockStart(void)
 {
+#if defined(_WIN32)
 	WSADATA wsaData;
 	WSAStartup(MAKEWORD(1, 1), &wsaData);
+#endif
 	return 1;
 }
 
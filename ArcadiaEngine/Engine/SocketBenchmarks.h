@@ -0,0 +1,147 @@
+#pragma once
+
+#include "SocketBuffer.h"
+#include "SocketCipher.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define SOCKET_BENCHMARK_FIELD_SIZE	64
+
+//  Micro-benchmarks for the networking helpers, run on demand from the debug console. Each returns one line per result.
+class SocketBenchmarks
+{
+public:
+	static std::vector<std::string> RunBufferGrowth();
+	static std::vector<std::string> RunCipherThroughput();
+
+private:
+	//  Reproduces the original SocketBuffer storage policy (grow to exactly what is needed plus 30 bytes, and give the storage
+	//  back on every clear) so the two can be timed side by side
+	struct LegacyGrowthBuffer
+	{
+		LegacyGrowthBuffer() : m_BufferData(new char[30]), m_BufferSize(30), m_WritePosition(0) {}
+		~LegacyGrowthBuffer() { delete[] m_BufferData; }
+
+		void StreamWrite(const void* in, int size)
+		{
+			if (m_WritePosition + size >= m_BufferSize)
+			{
+				auto newBufferSize = m_WritePosition + size + 30;
+				auto newBufferData = new char[newBufferSize];
+				memcpy(newBufferData, m_BufferData, m_WritePosition);
+				delete[] m_BufferData;
+				m_BufferData = newBufferData;
+				m_BufferSize = newBufferSize;
+			}
+			memcpy(m_BufferData + m_WritePosition, in, size);
+			m_WritePosition += size;
+		}
+
+		void clear()
+		{
+			if (m_BufferSize > 30)
+			{
+				delete[] m_BufferData;
+				m_BufferSize = 30;
+				m_BufferData = new char[m_BufferSize];
+			}
+			m_WritePosition = 0;
+		}
+
+		char* m_BufferData;
+		int m_BufferSize;
+		int m_WritePosition;
+	};
+
+	template <typename BufferType>
+	static double TimePacketBuilds(BufferType& buffer, int payloadSize, int packetCount);
+
+	template <typename CipherFunction>
+	static double TimeCipher(std::vector<char>& payload, int packetCount, CipherFunction cipherFunction);
+};
+
+template <typename BufferType>
+inline double SocketBenchmarks::TimePacketBuilds(BufferType& buffer, int payloadSize, int packetCount)
+{
+	char field[SOCKET_BENCHMARK_FIELD_SIZE];
+	for (auto i = 0; i < SOCKET_BENCHMARK_FIELD_SIZE; ++i) field[i] = char(i);
+
+	//  Build each packet one field at a time and clear it afterwards, the way game code fills a buffer before sending it
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (auto packet = 0; packet < packetCount; ++packet)
+	{
+		for (auto written = 0; written < payloadSize; written += SOCKET_BENCHMARK_FIELD_SIZE)
+			buffer.StreamWrite(field, std::min<int>(SOCKET_BENCHMARK_FIELD_SIZE, payloadSize - written));
+		buffer.clear();
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::micro>(endTime - startTime).count() / double(packetCount);
+}
+
+inline std::vector<std::string> SocketBenchmarks::RunBufferGrowth()
+{
+	struct PayloadCase { const char* m_Name; int m_Size; int m_PacketCount; };
+	const PayloadCase payloadCases[] = { { "1 KB", 1024, 2000 }, { "64 KB", 1024 * 64, 20 }, { "1 MB", 1024 * 1024, 1 } };
+
+	std::vector<std::string> results;
+	char line[160];
+	for (auto i = 0; i < int(sizeof(payloadCases) / sizeof(payloadCases[0])); ++i)
+	{
+		auto& payloadCase = payloadCases[i];
+
+		LegacyGrowthBuffer legacyBuffer;
+		auto legacyTime = TimePacketBuilds(legacyBuffer, payloadCase.m_Size, payloadCase.m_PacketCount);
+
+		SocketBuffer socketBuffer;
+		auto socketBufferTime = TimePacketBuilds(socketBuffer, payloadCase.m_Size, payloadCase.m_PacketCount);
+
+		snprintf(line, sizeof(line), "SocketBuffer %s packet: %.1f us (was %.1f us with exact growth), %.1fx faster", payloadCase.m_Name, socketBufferTime, legacyTime, legacyTime / std::max<double>(socketBufferTime, 0.001));
+		results.push_back(std::string(line));
+	}
+	return results;
+}
+
+template <typename CipherFunction>
+inline double SocketBenchmarks::TimeCipher(std::vector<char>& payload, int packetCount, CipherFunction cipherFunction)
+{
+	//  Returns the throughput in MB per second
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (auto packet = 0; packet < packetCount; ++packet) cipherFunction(payload.data(), int(payload.size()), packet);
+	auto endTime = std::chrono::high_resolution_clock::now();
+	auto seconds = std::max<double>(std::chrono::duration<double>(endTime - startTime).count(), 0.000001);
+	return (double(payload.size()) * double(packetCount)) / (1024.0 * 1024.0) / seconds;
+}
+
+inline std::vector<std::string> SocketBenchmarks::RunCipherThroughput()
+{
+	struct PayloadCase { const char* m_Name; int m_Size; int m_PacketCount; };
+	const PayloadCase payloadCases[] = { { "64 B", 64, 20000 }, { "1 KB", 1024, 4000 }, { "64 KB", 1024 * 64, 64 }, { "1 MB", 1024 * 1024, 8 } };
+	const char* password = "SocketBenchmarks";
+
+	unsigned char salt[SOCKET_CIPHER_SALT_SIZE];
+	SocketCipher::GenerateSalt(salt);
+	SocketCipher rc4Cipher;
+	rc4Cipher.SetPassword(password, salt, SOCKET_CIPHER_CLIENT_TO_SERVER, SOCKET_CIPHER_RC4);
+	SocketCipher chachaCipher;
+	chachaCipher.SetPassword(password, salt, SOCKET_CIPHER_CLIENT_TO_SERVER, SOCKET_CIPHER_CHACHA20);
+
+	std::vector<std::string> results;
+	char line[200];
+	for (auto i = 0; i < int(sizeof(payloadCases) / sizeof(payloadCases[0])); ++i)
+	{
+		auto& payloadCase = payloadCases[i];
+		std::vector<char> payload(payloadCase.m_Size);
+		for (auto j = 0; j < payloadCase.m_Size; ++j) payload[j] = char(j);
+
+		//  Each packet on its own, as EncryptBuffer treats every buffer: the original keys RC4 from the password every time
+		auto legacySpeed = TimeCipher(payload, payloadCase.m_PacketCount, [=](char* data, int size, int) { SocketCipher::ApplyRC4(password, data, size); });
+		auto rc4Speed = TimeCipher(payload, payloadCase.m_PacketCount, [&](char* data, int size, int packet) { rc4Cipher.ApplyToPacket(data, size, uint64_t(packet)); });
+		auto chachaSpeed = TimeCipher(payload, payloadCase.m_PacketCount, [&](char* data, int size, int packet) { chachaCipher.ApplyToPacket(data, size, uint64_t(packet)); });
+
+		snprintf(line, sizeof(line), "Cipher %s packets: ChaCha20 %.0f MB/s, keyed RC4 %.0f MB/s, EncryptBuffer RC4 %.0f MB/s (%.1fx)", payloadCase.m_Name, chachaSpeed, rc4Speed, legacySpeed, chachaSpeed / std::max<double>(legacySpeed, 0.001));
+		results.push_back(std::string(line));
+	}
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "SocketBuffer.h"
+
+#include <assert.h>
+#include <cmath>
+#include <cstdint>
+
+//  Bit-level packing on top of a SocketBuffer, for payloads made mostly of small numbers and flags. Values take only the bits
+//  they need: flags take one bit each, integers are written as varints (seven bits per byte, small values in one byte, with
+//  zigzag encoding so small negative values stay small), and floats are quantized to a fixed range and precision.
+//
+//  Bits are packed lowest first into each byte, so the stream reads the same on any machine. A writer appends at the buffer's
+//  write position and must be flushed (or destroyed) before the buffer is sent. A reader consumes whole bytes from the buffer's
+//  read position as it needs them.
+class SocketBitWriter
+{
+public:
+	explicit SocketBitWriter(SocketBuffer* buffer) : m_Buffer(buffer), m_Scratch(0), m_ScratchBits(0), m_BitCount(0) {}
+	~SocketBitWriter() { Flush(); }
+
+	SocketBitWriter(const SocketBitWriter&) = delete;
+	SocketBitWriter& operator=(const SocketBitWriter&) = delete;
+
+	void WriteBits(unsigned int value, int bitCount);
+	void WriteBool(bool value) { WriteBits(value ? 1 : 0, 1); }
+	void WriteFlags(unsigned int flags, int flagCount) { WriteBits(flags, flagCount); }
+	void WriteVarUInt(uint64_t value);
+	void WriteVarInt(int64_t value) { WriteVarUInt((uint64_t(value) << 1) ^ uint64_t(value >> 63)); }
+	void WriteQuantizedFloat(float value, float minimum, float maximum, float precision);
+	void AlignToByte() { WriteBits(0, (8 - (m_ScratchBits & 7)) & 7); }
+	int Flush();
+
+	int GetBitCount() const { return m_BitCount; }
+
+	//  The number of bits a float quantized to the given range and precision takes
+	static int GetQuantizedBitCount(float minimum, float maximum, float precision);
+
+private:
+	SocketBuffer* m_Buffer;
+	uint64_t m_Scratch;
+	int m_ScratchBits;
+	int m_BitCount;
+};
+
+class SocketBitReader
+{
+public:
+	explicit SocketBitReader(SocketBuffer* buffer) : m_Buffer(buffer), m_Scratch(0), m_ScratchBits(0), m_Overflowed(false) {}
+
+	unsigned int ReadBits(int bitCount);
+	bool ReadBool() { return ReadBits(1) != 0; }
+	unsigned int ReadFlags(int flagCount) { return ReadBits(flagCount); }
+	uint64_t ReadVarUInt();
+	int64_t ReadVarInt() { auto value = ReadVarUInt(); return int64_t(value >> 1) ^ -int64_t(value & 1); }
+	float ReadQuantizedFloat(float minimum, float maximum, float precision);
+	void AlignToByte() { m_Scratch >>= (m_ScratchBits & 7); m_ScratchBits &= ~7; }
+
+	//  True once a read has run past the end of the buffer (or hit a malformed varint). Every read from then on returns zero.
+	bool GetOverflowed() const { return m_Overflowed; }
+
+private:
+	SocketBuffer* m_Buffer;
+	uint64_t m_Scratch;
+	int m_ScratchBits;
+	bool m_Overflowed;
+};
+
+inline void SocketBitWriter::WriteBits(unsigned int value, int bitCount)
+{
+	//  At most 32 bits go in at a time, which with fewer than 32 left over from the last word always fits the 64 bit scratch
+	assert(bitCount <= 32);
+	if (bitCount <= 0) return;
+	if (bitCount > 32) bitCount = 32;
+	if (bitCount < 32) value &= (1u << bitCount) - 1;
+
+	m_Scratch |= uint64_t(value) << m_ScratchBits;
+	m_ScratchBits += bitCount;
+	m_BitCount += bitCount;
+
+	//  Whole words are moved into the buffer as soon as they are complete
+	if (m_ScratchBits >= 32)
+	{
+		unsigned char bytes[4] = { (unsigned char)(m_Scratch), (unsigned char)(m_Scratch >> 8), (unsigned char)(m_Scratch >> 16), (unsigned char)(m_Scratch >> 24) };
+		m_Buffer->StreamWrite(bytes, 4);
+		m_Scratch >>= 32;
+		m_ScratchBits -= 32;
+	}
+}
+
+inline void SocketBitWriter::WriteVarUInt(uint64_t value)
+{
+	do
+	{
+		auto group = (unsigned int)(value & 0x7F);
+		value >>= 7;
+		WriteBits((value != 0) ? (group | 0x80) : group, 8);
+	} while (value != 0);
+}
+
+inline void SocketBitWriter::WriteQuantizedFloat(float value, float minimum, float maximum, float precision)
+{
+	auto bitCount = GetQuantizedBitCount(minimum, maximum, precision);
+	auto stepCount = (unsigned int)(std::ceil((maximum - minimum) / precision));
+	if (!(value > minimum)) value = minimum;
+	if (value > maximum) value = maximum;
+
+	auto step = (unsigned int)(std::floor((value - minimum) / precision + 0.5f));
+	WriteBits(std::min<unsigned int>(step, stepCount), bitCount);
+}
+
+inline int SocketBitWriter::Flush()
+{
+	//  Writes out the last partial byte (padded with zero bits), and returns the number of bytes the stream has taken in total
+	auto byteCount = (m_ScratchBits + 7) / 8;
+	for (auto i = 0; i < byteCount; ++i)
+	{
+		auto byte = (unsigned char)(m_Scratch >> (i * 8));
+		m_Buffer->StreamWrite(&byte, 1);
+	}
+	m_BitCount += (byteCount * 8) - m_ScratchBits;
+	m_Scratch = 0;
+	m_ScratchBits = 0;
+	return m_BitCount / 8;
+}
+
+inline int SocketBitWriter::GetQuantizedBitCount(float minimum, float maximum, float precision)
+{
+	if (!(precision > 0.0f) || !(maximum > minimum)) return 0;
+	auto stepCount = (uint64_t)(std::ceil((maximum - minimum) / precision));
+	auto bitCount = 0;
+	while (bitCount < 32 && (uint64_t(1) << bitCount) <= stepCount) ++bitCount;
+	return bitCount;
+}
+
+inline unsigned int SocketBitReader::ReadBits(int bitCount)
+{
+	assert(bitCount <= 32);
+	if (bitCount <= 0 || m_Overflowed) return 0;
+	if (bitCount > 32) bitCount = 32;
+
+	//  Only the bytes needed are taken from the buffer, so its read position always ends just past the last bit read
+	while (m_ScratchBits < bitCount)
+	{
+		if (m_Buffer->bytesleft() <= 0)
+		{
+			m_Overflowed = true;
+			return 0;
+		}
+		m_Scratch |= uint64_t((unsigned char)(m_Buffer->m_BufferData[m_Buffer->m_ReadPosition++])) << m_ScratchBits;
+		m_ScratchBits += 8;
+	}
+
+	auto value = (unsigned int)(m_Scratch & ((bitCount < 32) ? ((uint64_t(1) << bitCount) - 1) : 0xFFFFFFFFull));
+	m_Scratch >>= bitCount;
+	m_ScratchBits -= bitCount;
+	return value;
+}
+
+inline uint64_t SocketBitReader::ReadVarUInt()
+{
+	uint64_t value = 0;
+	for (auto shift = 0; shift < 64; shift += 7)
+	{
+		auto group = ReadBits(8);
+		value |= uint64_t(group & 0x7F) << shift;
+		if ((group & 0x80) == 0) return value;
+	}
+
+	//  No 64 bit value needs more than ten groups
+	m_Overflowed = true;
+	return 0;
+}
+
+inline float SocketBitReader::ReadQuantizedFloat(float minimum, float maximum, float precision)
+{
+	auto step = ReadBits(SocketBitWriter::GetQuantizedBitCount(minimum, maximum, precision));
+	return std::min<float>(minimum + float(step) * precision, maximum);
+}
\ No newline at end of file
@@ -1,22 +1,53 @@
 #pragma once
 
+#include "MemoryPoolAllocator.h"
+#include "FrameArena.h"
+#include "SocketByteOrder.h"
+#include "SocketFileView.h"
+
 #include <algorithm>
+#include <type_traits>
 
 #define RETURNVAL_BUFFER_SIZE 1024 * 128 // 128KB
+#define RECEIVE_RING_DEFAULT_SIZE 1024 * 64 // 64KB
+#define SOCKETBUFFER_INLINE_SIZE 128 // Packets up to this size never touch the heap
 
 class SocketBuffer
 {
 	static char m_ReturnValueBuffer[RETURNVAL_BUFFER_SIZE + 1];
 public:
+	//  A received message left in place in the receive ring. It stays valid until the next message is taken from the same buffer.
+	struct MessageView
+	{
+		const char* m_Data;
+		int m_Size;
+	};
+
 	char* m_BufferData;
 	int m_BufferSize;
 	int m_ReadPosition;
 	int m_WritePosition;
 	int m_BufferUtilizedCount;
+
+	//  Receive ring (see EnableReceiveRing). The read and write counts only ever increase, and wrap safely as the size is a power of two.
+	char* m_RingData;
+	unsigned int m_RingSize;
+	unsigned int m_RingReadCount;
+	unsigned int m_RingWriteCount;
+	unsigned int m_RingViewSize;
+
 	void StreamWrite(void *in, int size);
 	void StreamRead(void* out, int size, bool peek);
 	SocketBuffer();
 	~SocketBuffer();
+
+	//  A buffer may point at its own inline storage, so it can't be copied
+	SocketBuffer(const SocketBuffer&) = delete;
+	SocketBuffer& operator=(const SocketBuffer&) = delete;
+
+	static void* operator new(size_t size) { return memoryPoolAllocator.Allocate(size); }
+	static void operator delete(void* memory, size_t size) { memoryPoolAllocator.Free(memory, size); }
+
 	int 				writechar(unsigned char a);
 	int 				writeshort(short a);
 	int 				writeushort(unsigned short a);
@@ -41,12 +72,47 @@ public:
 	char*				readchars(int len, bool peek = false);
 	char*				readstring(bool peek = false);
 
+	//  Whole arrays of numbers (or enums) in one copy. With networkOrder the values are big endian in the buffer, so both ends
+	//  agree whatever byte order their machines use; without it they are in host order, like writeint and the other writes.
+	template <typename Type> int WriteArray(const Type* values, int count, bool networkOrder = false);
+	template <typename Type> int ReadArray(Type* values, int count, bool networkOrder = false, bool peek = false);
+
 	int bytesleft() const { return m_BufferUtilizedCount - m_ReadPosition; }
+	int capacity() const { return m_BufferSize; }
+	void reserve(int capacity);
+	void reserve_append(int size);
+	void shrink_to_fit();
 	void StreamSet(int pos);
 	void clear();
 	int addBuffer(char*, int);
 	int addBuffer(SocketBuffer*);
 	char operator[](int index) const;
+
+	//  Receive ring
+	bool EnableReceiveRing(int ringSize = RECEIVE_RING_DEFAULT_SIZE);
+	void DisableReceiveRing();
+	bool HasReceiveRing() const { return m_RingData != nullptr; }
+	int GetRingReadable() const { return int(m_RingWriteCount - m_RingReadCount); }
+	int GetRingWritable() const { return int(m_RingSize - (m_RingWriteCount - m_RingReadCount)); }
+	int GetRingWriteSegments(char*& first, int& firstSize, char*& second, int& secondSize);
+	void CommitRingWrite(int size);
+	bool PeekRing(void* out, int offset, int size) const;
+	const char* ViewRing(int offset, int size);
+	void SetRingView(int consumedSize) { m_RingViewSize = (unsigned int)(consumedSize); }
+	void ReleaseRingView();
+
+	//  File views: the buffer's contents can be a read-only mapping of part of a file instead of storage of its own. Reading
+	//  works as normal. Anything that writes to the buffer first copies the view into storage of its own (clear just drops it).
+	int MapFileView(SocketFileView::NativeFile file, long long offset, int size);
+	bool IsFileView() const { return m_FileView.IsMapped(); }
+	void DetachFileView();
+
+private:
+	void SetStorage(int newBufferSize);
+	void ReleaseFileView(bool keepData);
+
+	char m_InlineData[SOCKETBUFFER_INLINE_SIZE];
+	SocketFileView m_FileView;
 };
 
 #define SIZEOF_CHAR sizeof(char)
@@ -61,30 +127,34 @@ char SocketBuffer::m_ReturnValueBuffer[RETURNVAL_BUFFER_SIZE + 1];
 
 inline SocketBuffer::SocketBuffer()
 {
-	m_BufferSize = 30;
-	MANAGE_MEMORY_NEW("WinsockWrapper", m_BufferSize);
-	m_BufferData = new char[m_BufferSize];
+	m_BufferSize = SOCKETBUFFER_INLINE_SIZE;
+	m_BufferData = m_InlineData;
 	m_BufferUtilizedCount = 0;
 	m_ReadPosition = 0;
 	m_WritePosition = 0;
+	m_RingData = nullptr;
+	m_RingSize = 0;
+	m_RingReadCount = 0;
+	m_RingWriteCount = 0;
+	m_RingViewSize = 0;
 }
 
 inline SocketBuffer::~SocketBuffer()
 {
-	if (m_BufferData != nullptr)
-	{
-		MANAGE_MEMORY_DELETE("WinsockWrapper", m_BufferSize);
-		delete[] m_BufferData;
-	}
+	if (m_BufferData != m_InlineData && !m_FileView.IsMapped()) delete[] m_BufferData;
+	DisableReceiveRing();
 }
 
 inline void SocketBuffer::StreamWrite(void *in, int size)
 {
-	if (m_WritePosition + size >= m_BufferSize)
-	{
-		m_BufferSize = m_WritePosition + size + 30;
-		if ((m_BufferData = static_cast<char*>(realloc(m_BufferData, m_BufferSize))) == nullptr) return;
-	}
+	//  Data being appended from this buffer itself must be found again once the storage moves, whether a file view is copied
+	//  out of its mapping (which is unmapped after) or the storage grows
+	auto source = static_cast<char*>(in);
+	auto sourceOffset = (source >= m_BufferData && source < m_BufferData + m_BufferSize) ? int(source - m_BufferData) : -1;
+
+	reserve_append(size);
+	if (sourceOffset >= 0) in = m_BufferData + sourceOffset;
+
 	memcpy(m_BufferData + m_WritePosition, in, size);
 	m_WritePosition += size;
 	if (m_WritePosition > m_BufferUtilizedCount) m_BufferUtilizedCount = m_WritePosition;
@@ -259,16 +329,97 @@ inline int SocketBuffer::addBuffer(char *m_BufferData, int len)
 	return len;
 }
 
+inline void SocketBuffer::reserve(int capacity)
+{
+	//  Whoever reserves is about to write straight into the storage
+	if (m_FileView.IsMapped()) ReleaseFileView(true);
+	if (capacity > m_BufferSize) SetStorage(capacity);
+}
+
+inline void SocketBuffer::reserve_append(int size)
+{
+	//  Makes room for size more bytes at the write position. Storage grows geometrically, so building a buffer up one write at a
+	//  time costs amortized constant time per write.
+	if (m_FileView.IsMapped()) ReleaseFileView(true);
+	if (m_WritePosition + size > m_BufferSize) SetStorage(std::max<int>(m_WritePosition + size, m_BufferSize * 2));
+}
+
+inline void SocketBuffer::shrink_to_fit()
+{
+	if (m_FileView.IsMapped()) ReleaseFileView(true);
+	if (m_BufferData == m_InlineData) return;
+	SetStorage(std::max<int>(m_BufferUtilizedCount, m_WritePosition));
+}
+
+inline void SocketBuffer::SetStorage(int newBufferSize)
+{
+	//  Anything that fits is kept inline, and everything else is given exactly the size asked for
+	char* newBufferData = m_InlineData;
+	if (newBufferSize > SOCKETBUFFER_INLINE_SIZE)
+	{
+		MEMORY_SCOPE("WinsockWrapper");
+		newBufferData = new char[newBufferSize];
+	}
+	else newBufferSize = SOCKETBUFFER_INLINE_SIZE;
+
+	if (newBufferData == m_BufferData) return;
+	memcpy(newBufferData, m_BufferData, std::min<int>(m_BufferUtilizedCount, newBufferSize));
+	if (m_BufferData != m_InlineData) delete[] m_BufferData;
+	m_BufferData = newBufferData;
+	m_BufferSize = newBufferSize;
+}
+
 inline void SocketBuffer::clear()
 {
-	if (m_BufferSize > 30)
+	//  The capacity is kept, so a buffer that is cleared and refilled every frame stops allocating once it has grown to fit
+	if (m_FileView.IsMapped()) ReleaseFileView(false);
+	m_BufferUtilizedCount = 0;
+	m_ReadPosition = 0;
+	m_WritePosition = 0;
+}
+
+inline int SocketBuffer::MapFileView(SocketFileView::NativeFile file, long long offset, int size)
+{
+	//  Replaces the contents with a view of up to size bytes of the file from offset, and returns how many bytes are in view
+	//  (or -1, leaving the buffer empty). The read position starts at the beginning of the view.
+	clear();
+	if (m_BufferData != m_InlineData) delete[] m_BufferData;
+	m_BufferData = m_InlineData;
+	m_BufferSize = SOCKETBUFFER_INLINE_SIZE;
+
+	auto viewSize = m_FileView.Map(file, offset, size);
+	if (viewSize < 0) return -1;
+
+	m_BufferData = const_cast<char*>(m_FileView.GetData());
+	m_BufferSize = viewSize;
+	m_BufferUtilizedCount = viewSize;
+	m_WritePosition = viewSize;
+	return viewSize;
+}
+
+inline void SocketBuffer::DetachFileView()
+{
+	//  For anything about to change the bytes in place, like a cipher
+	if (m_FileView.IsMapped()) ReleaseFileView(true);
+}
+
+inline void SocketBuffer::ReleaseFileView(bool keepData)
+{
+	auto keepSize = keepData ? m_BufferUtilizedCount : 0;
+	auto newBufferData = m_InlineData;
+	auto newBufferSize = SOCKETBUFFER_INLINE_SIZE;
+	if (keepSize > SOCKETBUFFER_INLINE_SIZE)
 	{
-		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(m_BufferData));
-		delete[] m_BufferData;
-		m_BufferSize = 30;
-		MANAGE_MEMORY_NEW("WinsockWrapper", m_BufferSize);
-		m_BufferData = new char[m_BufferSize];
+		MEMORY_SCOPE("WinsockWrapper");
+		newBufferData = new char[keepSize];
+		newBufferSize = keepSize;
 	}
+	memcpy(newBufferData, m_BufferData, keepSize);
+	m_FileView.Unmap();
+
+	m_BufferData = newBufferData;
+	m_BufferSize = newBufferSize;
+	if (keepData) return;
 	m_BufferUtilizedCount = 0;
 	m_ReadPosition = 0;
 	m_WritePosition = 0;
@@ -280,7 +431,117 @@ inline void SocketBuffer::StreamSet(int pos)
 	m_WritePosition = 0;
 }
 
+template <typename Type>
+inline int SocketBuffer::WriteArray(const Type* values, int count, bool networkOrder)
+{
+	static_assert(std::is_arithmetic<Type>::value || std::is_enum<Type>::value, "WriteArray only takes numbers and enums");
+	static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "WriteArray values must be 1, 2, 4 or 8 bytes");
+	if (count <= 0) return 0;
+
+	auto size = int(sizeof(Type)) * count;
+	reserve_append(size);
+	if (networkOrder) SocketByteOrder::CopyToNetwork(m_BufferData + m_WritePosition, values, count, int(sizeof(Type)));
+	else memcpy(m_BufferData + m_WritePosition, values, size_t(size));
+
+	m_WritePosition += size;
+	if (m_WritePosition > m_BufferUtilizedCount) m_BufferUtilizedCount = m_WritePosition;
+	return size;
+}
+
+template <typename Type>
+inline int SocketBuffer::ReadArray(Type* values, int count, bool networkOrder, bool peek)
+{
+	//  Reads nothing (and returns 0) unless the whole array is in the buffer. Returns the number of bytes read.
+	static_assert(std::is_arithmetic<Type>::value || std::is_enum<Type>::value, "ReadArray only takes numbers and enums");
+	static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "ReadArray values must be 1, 2, 4 or 8 bytes");
+	if (count <= 0) return 0;
+
+	auto size = int(sizeof(Type)) * count;
+	if (bytesleft() < size) return 0;
+	if (networkOrder) SocketByteOrder::CopyFromNetwork(values, m_BufferData + m_ReadPosition, count, int(sizeof(Type)));
+	else memcpy(values, m_BufferData + m_ReadPosition, size_t(size));
+
+	if (!peek) m_ReadPosition += size;
+	return size;
+}
+
 inline char SocketBuffer::operator [](int i) const
 {
 	return ((i < 0 || i >= m_BufferUtilizedCount) ? '\0' : m_BufferData[i]);
+}
+
+inline bool SocketBuffer::EnableReceiveRing(int ringSize)
+{
+	if (ringSize <= 0) return false;
+
+	//  Round the size up to a power of two, so positions in the ring are a mask of the read and write counts
+	unsigned int roundedSize = 1;
+	while (roundedSize < (unsigned int)(ringSize)) roundedSize <<= 1;
+	if (m_RingData != nullptr && m_RingSize == roundedSize) return true;
+
+	DisableReceiveRing();
+
+	//  The second half mirrors the start of the ring, so a message that wraps around the end can still be viewed in one piece
+	MEMORY_SCOPE("WinsockWrapper");
+	m_RingData = new char[size_t(roundedSize) * 2];
+	m_RingSize = roundedSize;
+	return true;
+}
+
+inline void SocketBuffer::DisableReceiveRing()
+{
+	if (m_RingData != nullptr) delete[] m_RingData;
+	m_RingData = nullptr;
+	m_RingSize = 0;
+	m_RingReadCount = 0;
+	m_RingWriteCount = 0;
+	m_RingViewSize = 0;
+}
+
+inline int SocketBuffer::GetRingWriteSegments(char*& first, int& firstSize, char*& second, int& secondSize)
+{
+	//  The free space starts at the write position and may wrap around to the front of the ring
+	auto writable = (unsigned int)(GetRingWritable());
+	auto writeIndex = m_RingWriteCount & (m_RingSize - 1);
+	auto untilEnd = std::min<unsigned int>(writable, m_RingSize - writeIndex);
+	first = m_RingData + writeIndex;
+	firstSize = int(untilEnd);
+	second = m_RingData;
+	secondSize = int(writable - untilEnd);
+	return int(writable);
+}
+
+inline void SocketBuffer::CommitRingWrite(int size)
+{
+	m_RingWriteCount += (unsigned int)(std::min<int>(size, GetRingWritable()));
+}
+
+inline bool SocketBuffer::PeekRing(void* out, int offset, int size) const
+{
+	if (offset < 0 || size < 0 || offset + size > GetRingReadable()) return false;
+
+	auto readIndex = (m_RingReadCount + (unsigned int)(offset)) & (m_RingSize - 1);
+	auto untilEnd = std::min<unsigned int>((unsigned int)(size), m_RingSize - readIndex);
+	memcpy(out, m_RingData + readIndex, untilEnd);
+	memcpy(static_cast<char*>(out) + untilEnd, m_RingData, size - untilEnd);
+	return true;
+}
+
+inline const char* SocketBuffer::ViewRing(int offset, int size)
+{
+	if (offset < 0 || size < 0 || offset + size > GetRingReadable()) return nullptr;
+
+	//  Only a region that wraps past the end needs any copying: its front part is mirrored just past the end of the ring
+	auto readIndex = (m_RingReadCount + (unsigned int)(offset)) & (m_RingSize - 1);
+	if (readIndex + (unsigned int)(size) > m_RingSize) memcpy(m_RingData + m_RingSize, m_RingData, readIndex + size - m_RingSize);
+	return m_RingData + readIndex;
+}
+
+inline void SocketBuffer::ReleaseRingView()
+{
+	m_RingReadCount += m_RingViewSize;
+	m_RingViewSize = 0;
+
+	//  Restart from the front once everything has been read, so the next messages are far less likely to wrap
+	if (m_RingReadCount == m_RingWriteCount) m_RingReadCount = m_RingWriteCount = 0;
 }
\ No newline at end of file
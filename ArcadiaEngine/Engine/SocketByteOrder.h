@@ -0,0 +1,130 @@
+#pragma once
+
+#include "SocketSIMD.h"
+
+#include <cstdint>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+//  Converts arrays of 2, 4 or 8 byte values between host and network (big endian) byte order while copying them. On a big
+//  endian host the conversion is just the copy. Whole vectors are reversed at a time where the instruction set allows it.
+class SocketByteOrder
+{
+public:
+	static void CopyToNetwork(void* out, const void* in, int count, int elementSize);
+	static void CopyFromNetwork(void* out, const void* in, int count, int elementSize) { CopyToNetwork(out, in, count, elementSize); }
+
+private:
+	static void CopySwapped(unsigned char* out, const unsigned char* in, int count, int elementSize);
+	static void SwapElements(unsigned char* out, const unsigned char* in, int count, int elementSize);
+};
+
+inline void SocketByteOrder::CopyToNetwork(void* out, const void* in, int count, int elementSize)
+{
+	if (count <= 0) return;
+#if SOCKET_HOST_BIG_ENDIAN
+	memmove(out, in, size_t(count) * size_t(elementSize));
+#else
+	if (elementSize == 1) memmove(out, in, size_t(count));
+	else CopySwapped(static_cast<unsigned char*>(out), static_cast<const unsigned char*>(in), count, elementSize);
+#endif
+}
+
+inline void SocketByteOrder::CopySwapped(unsigned char* out, const unsigned char* in, int count, int elementSize)
+{
+	auto byteCount = count * elementSize;
+	auto offset = 0;
+
+#if SOCKET_SIMD_AVX2 || SOCKET_SIMD_SSSE3
+	//  A byte shuffle reverses every element in a vector at once. The AVX2 shuffle works within each 16 byte lane, so the same
+	//  pattern serves both.
+	alignas(16) static const unsigned char swapPatterns[3][16] = {
+		{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+		{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+		{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+	};
+	auto pattern = _mm_load_si128(reinterpret_cast<const __m128i*>(swapPatterns[(elementSize == 2) ? 0 : ((elementSize == 4) ? 1 : 2)]));
+#if SOCKET_SIMD_AVX2
+	auto widePattern = _mm256_broadcastsi128_si256(pattern);
+	for (; offset + 32 <= byteCount; offset += 32)
+	{
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + offset));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + offset), _mm256_shuffle_epi8(block, widePattern));
+	}
+#endif
+	for (; offset + 16 <= byteCount; offset += 16)
+	{
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + offset));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_shuffle_epi8(block, pattern));
+	}
+#elif SOCKET_SIMD_NEON
+	for (; offset + 16 <= byteCount; offset += 16)
+	{
+		auto block = vld1q_u8(in + offset);
+		block = (elementSize == 2) ? vrev16q_u8(block) : ((elementSize == 4) ? vrev32q_u8(block) : vrev64q_u8(block));
+		vst1q_u8(out + offset, block);
+	}
+#elif SOCKET_SIMD_SSE2
+	//  Without a byte shuffle, 16 bit values can still be swapped eight at a time with shifts
+	if (elementSize == 2)
+	{
+		for (; offset + 16 <= byteCount; offset += 16)
+		{
+			auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + offset));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8)));
+		}
+	}
+#endif
+
+	SwapElements(out + offset, in + offset, (byteCount - offset) / elementSize, elementSize);
+}
+
+inline void SocketByteOrder::SwapElements(unsigned char* out, const unsigned char* in, int count, int elementSize)
+{
+	for (auto i = 0; i < count; ++i, in += elementSize, out += elementSize)
+	{
+		switch (elementSize)
+		{
+		case 2:
+		{
+			uint16_t value;
+			memcpy(&value, in, 2);
+#if defined(_MSC_VER)
+			value = _byteswap_ushort(value);
+#else
+			value = __builtin_bswap16(value);
+#endif
+			memcpy(out, &value, 2);
+			break;
+		}
+
+		case 4:
+		{
+			uint32_t value;
+			memcpy(&value, in, 4);
+#if defined(_MSC_VER)
+			value = _byteswap_ulong(value);
+#else
+			value = __builtin_bswap32(value);
+#endif
+			memcpy(out, &value, 4);
+			break;
+		}
+
+		case 8:
+		{
+			uint64_t value;
+			memcpy(&value, in, 8);
+#if defined(_MSC_VER)
+			value = _byteswap_uint64(value);
+#else
+			value = __builtin_bswap64(value);
+#endif
+			memcpy(out, &value, 8);
+			break;
+		}
+		}
+	}
+}
\ No newline at end of file
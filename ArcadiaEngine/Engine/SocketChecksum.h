@@ -0,0 +1,218 @@
+#pragma once
+
+#include "SocketSIMD.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//  The largest number of bytes Adler-32 can sum before its 32 bit running totals have to be reduced, rounded down to whole
+//  32 byte vectors
+#define SOCKET_ADLER32_BLOCK_SIZE	5536
+#define SOCKET_ADLER32_MODULUS		65521
+
+enum SocketChecksumTypes { SOCKET_CHECKSUM_ADLER32 = 0, SOCKET_CHECKSUM_CRC32C, SOCKET_CHECKSUM_TYPE_COUNT };
+
+//  Checksums over any span of bytes. Adler-32 is the zlib checksum, summed a vector at a time with SSE2 or AVX2. CRC32C is the
+//  Castagnoli CRC (as used by iSCSI and SCTP), using the SSE4.2 crc32 instruction where it's available and eight lookup tables
+//  otherwise.
+//
+//  Both can be built up a piece at a time: start from GetInitialValue and pass each piece to Update with the checksum so far.
+//  The result is the same as checksumming all of the pieces at once.
+class SocketChecksum
+{
+public:
+	static unsigned int GetInitialValue(int algorithm) { return (algorithm == SOCKET_CHECKSUM_ADLER32) ? 1u : 0u; }
+	static unsigned int Update(int algorithm, unsigned int checksum, const void* data, size_t size);
+	static unsigned int Calculate(int algorithm, const void* data, size_t size) { return Update(algorithm, GetInitialValue(algorithm), data, size); }
+
+	static unsigned int UpdateAdler32(unsigned int adler, const unsigned char* data, size_t size);
+	static unsigned int UpdateCRC32C(unsigned int crc, const unsigned char* data, size_t size);
+
+private:
+	static void AddAdler32Bytes(unsigned int& a, unsigned int& b, const unsigned char* data, size_t size);
+	static void AddAdler32Vectors(unsigned int& a, unsigned int& b, const unsigned char* data, size_t size);
+	static const uint32_t* GetCRC32CTables();
+};
+
+inline unsigned int SocketChecksum::Update(int algorithm, unsigned int checksum, const void* data, size_t size)
+{
+	//  Unknown algorithms leave the checksum as it was
+	auto bytes = static_cast<const unsigned char*>(data);
+	switch (algorithm)
+	{
+	case SOCKET_CHECKSUM_ADLER32:	return UpdateAdler32(checksum, bytes, size);
+	case SOCKET_CHECKSUM_CRC32C:	return UpdateCRC32C(checksum, bytes, size);
+	default:						return checksum;
+	}
+}
+
+inline unsigned int SocketChecksum::UpdateAdler32(unsigned int adler, const unsigned char* data, size_t size)
+{
+	auto a = adler & 0xFFFF;
+	auto b = adler >> 16;
+
+	while (size > 0)
+	{
+		auto blockSize = (size < SOCKET_ADLER32_BLOCK_SIZE) ? size : size_t(SOCKET_ADLER32_BLOCK_SIZE);
+		auto vectorSize = blockSize & ~size_t(31);
+		AddAdler32Vectors(a, b, data, vectorSize);
+		AddAdler32Bytes(a, b, data + vectorSize, blockSize - vectorSize);
+		a %= SOCKET_ADLER32_MODULUS;
+		b %= SOCKET_ADLER32_MODULUS;
+		data += blockSize;
+		size -= blockSize;
+	}
+
+	return (b << 16) | a;
+}
+
+inline void SocketChecksum::AddAdler32Bytes(unsigned int& a, unsigned int& b, const unsigned char* data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		a += data[i];
+		b += a;
+	}
+}
+
+inline void SocketChecksum::AddAdler32Vectors(unsigned int& a, unsigned int& b, const unsigned char* data, size_t size)
+{
+	//  Over n bytes, a gains the sum of the bytes and b gains n * a plus each byte weighted by how many bytes remain from it to
+	//  the end. Each vector of bytes adds its plain sum to one set of lanes and its sum weighted by position within the vector to
+	//  another. A third set gathers the plain sums of every earlier vector, which is each of those bytes' missing weight in whole
+	//  vectors. The lanes are folded together once at the end, in 64 bits as the scaled totals can pass 32.
+#if SOCKET_SIMD_AVX2
+	auto zero = _mm256_setzero_si256();
+	auto ones = _mm256_set1_epi16(1);
+	auto weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	auto byteSums = _mm256_setzero_si256();
+	auto earlierSums = _mm256_setzero_si256();
+	auto weightedSums = _mm256_setzero_si256();
+	for (size_t offset = 0; offset < size; offset += 32)
+	{
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+		earlierSums = _mm256_add_epi32(earlierSums, byteSums);
+		byteSums = _mm256_add_epi32(byteSums, _mm256_sad_epu8(block, zero));
+		weightedSums = _mm256_add_epi32(weightedSums, _mm256_madd_epi16(_mm256_maddubs_epi16(block, weights), ones));
+	}
+
+	alignas(32) uint32_t lanes[3][8];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), byteSums);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), earlierSums);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), weightedSums);
+	const int laneCount = 8;
+	const int vectorShift = 5;
+#elif SOCKET_SIMD_SSE2
+	//  Without a signed-by-unsigned byte multiply, each half of the vector is widened to 16 bits and weighted separately
+	auto zero = _mm_setzero_si128();
+	auto lowWeights = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	auto highWeights = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+	auto byteSums = _mm_setzero_si128();
+	auto earlierSums = _mm_setzero_si128();
+	auto weightedSums = _mm_setzero_si128();
+	for (size_t offset = 0; offset < size; offset += 16)
+	{
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		earlierSums = _mm_add_epi32(earlierSums, byteSums);
+		byteSums = _mm_add_epi32(byteSums, _mm_sad_epu8(block, zero));
+		weightedSums = _mm_add_epi32(weightedSums, _mm_madd_epi16(_mm_unpacklo_epi8(block, zero), lowWeights));
+		weightedSums = _mm_add_epi32(weightedSums, _mm_madd_epi16(_mm_unpackhi_epi8(block, zero), highWeights));
+	}
+
+	alignas(16) uint32_t lanes[3][4];
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes[0]), byteSums);
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes[1]), earlierSums);
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes[2]), weightedSums);
+	const int laneCount = 4;
+	const int vectorShift = 4;
+#else
+	AddAdler32Bytes(a, b, data, size);
+	return;
+#endif
+
+#if SOCKET_SIMD_AVX2 || SOCKET_SIMD_SSE2
+	uint64_t byteSum = 0;
+	uint64_t earlierSum = 0;
+	uint64_t weightedSum = 0;
+	for (auto i = 0; i < laneCount; ++i)
+	{
+		byteSum += lanes[0][i];
+		earlierSum += lanes[1][i];
+		weightedSum += lanes[2][i];
+	}
+
+	b = (unsigned int)((uint64_t(b) + uint64_t(size) * a + (earlierSum << vectorShift) + weightedSum) % SOCKET_ADLER32_MODULUS);
+	a = (unsigned int)((uint64_t(a) + byteSum) % SOCKET_ADLER32_MODULUS);
+#endif
+}
+
+inline unsigned int SocketChecksum::UpdateCRC32C(unsigned int crc, const unsigned char* data, size_t size)
+{
+	crc = ~crc;
+
+#if SOCKET_SIMD_SSE42
+	//  The crc32 instruction takes eight bytes at a time on x64 (four otherwise), once the data is aligned to that
+	for (; size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0; --size) crc = _mm_crc32_u8(crc, *data++);
+#if defined(_M_X64) || defined(__x86_64__)
+	uint64_t wideCrc = crc;
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, 8);
+		wideCrc = _mm_crc32_u64(wideCrc, word);
+	}
+	crc = (unsigned int)(wideCrc);
+#endif
+	for (; size >= 4; size -= 4, data += 4)
+	{
+		uint32_t word;
+		memcpy(&word, data, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for (; size > 0; --size) crc = _mm_crc32_u8(crc, *data++);
+#else
+	//  Eight bytes at a time through eight tables ("slicing by eight"), each giving one byte's effect eight, seven, ... one byte on
+	auto tables = GetCRC32CTables();
+#if !SOCKET_HOST_BIG_ENDIAN
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		uint32_t low;
+		uint32_t high;
+		memcpy(&low, data, 4);
+		memcpy(&high, data + 4, 4);
+		low ^= crc;
+		crc = tables[(7 << 8) | (low & 0xFF)] ^ tables[(6 << 8) | ((low >> 8) & 0xFF)] ^
+			tables[(5 << 8) | ((low >> 16) & 0xFF)] ^ tables[(4 << 8) | (low >> 24)] ^
+			tables[(3 << 8) | (high & 0xFF)] ^ tables[(2 << 8) | ((high >> 8) & 0xFF)] ^
+			tables[(1 << 8) | ((high >> 16) & 0xFF)] ^ tables[high >> 24];
+	}
+#endif
+	for (; size > 0; --size) crc = tables[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+#endif
+
+	return ~crc;
+}
+
+inline const uint32_t* SocketChecksum::GetCRC32CTables()
+{
+	//  Built on first use. Table 0 is the usual byte table for the reflected polynomial, and each later table carries the
+	//  previous one through one more zero byte.
+	struct CRC32CTables
+	{
+		CRC32CTables()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				auto crc = i;
+				for (auto bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0u);
+				m_Tables[i] = crc;
+			}
+			for (auto i = 256; i < 256 * 8; ++i) m_Tables[i] = (m_Tables[i - 256] >> 8) ^ m_Tables[m_Tables[i - 256] & 0xFF];
+		}
+		uint32_t m_Tables[256 * 8];
+	};
+
+	static const CRC32CTables crc32cTables;
+	return crc32cTables.m_Tables;
+}
\ No newline at end of file
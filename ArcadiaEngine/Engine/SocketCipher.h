@@ -0,0 +1,421 @@
+#pragma once
+
+#include "SimpleSHA256.h"
+#include "SocketSIMD.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+enum SocketCipherTypes { SOCKET_CIPHER_CHACHA20 = 0, SOCKET_CIPHER_RC4, SOCKET_CIPHER_TYPE_COUNT };
+
+//  Which way across a connection a cipher carries data. The two directions are given different nonces, so each needs its own cipher.
+enum SocketCipherDirections { SOCKET_CIPHER_CLIENT_TO_SERVER = 0, SOCKET_CIPHER_SERVER_TO_CLIENT, SOCKET_CIPHER_DIRECTION_COUNT };
+
+#define SOCKET_CIPHER_KEY_SIZE		32
+#define SOCKET_CIPHER_NONCE_SIZE	12
+#define SOCKET_CIPHER_SALT_SIZE		16
+
+//  A stream cipher keyed once per session and then reused for every packet, so no packet pays for a key schedule. ChaCha20
+//  (RFC 8439) is the default, generating four blocks of key stream at a time with SSE2 or eight with AVX2. RC4 is kept for
+//  peers still using the original EncryptBuffer, with its key schedule done once and copied for each packet.
+//
+//  Encrypting and decrypting are the same operation. Apply continues one key stream across calls, for a connection where both
+//  ends see every byte in order (TCP). ApplyToPacket starts a fresh key stream for each packet number, for datagrams that may
+//  arrive out of order or not at all; a packet number must never be reused with the same key.
+//
+//  A key stream must never be used twice, so a ChaCha20 key from a password also depends on a salt chosen at random for each
+//  session (GenerateSalt) and sent to the peer in the clear, and the nonce holds the direction the data travels. One SocketCipher
+//  must never be shared by both directions of a connection: each end keys one cipher for what it sends and another for what it
+//  receives, from the same password and salt but opposite directions.
+class SocketCipher
+{
+public:
+	SocketCipher();
+	~SocketCipher();
+
+	SocketCipher(const SocketCipher&) = delete;
+	SocketCipher& operator=(const SocketCipher&) = delete;
+
+	//  A password is hashed (SHA-256) with the session's salt (SOCKET_CIPHER_SALT_SIZE bytes) into the key and nonce, so both ends
+	//  can key from the same ones. RC4 ignores the salt and direction, keying exactly as the original EncryptBuffer did, so it
+	//  repeats its key stream every session and is only for peers that need it. A session key exchanged some other way should be
+	//  given to SetKey instead, with a nonce that is never used twice with that key.
+	bool SetPassword(const char* password, const unsigned char* salt, int direction, int cipherType = SOCKET_CIPHER_CHACHA20);
+	void SetKey(const unsigned char* key, const unsigned char* nonce);
+	static void GenerateSalt(unsigned char* salt);
+	void Reset() { m_StreamPosition = 0; }
+
+	void Apply(char* data, int size);
+	void ApplyToPacket(char* data, int size, uint64_t packetNumber);
+
+	int GetType() const { return m_CipherType; }
+
+	//  The original EncryptBuffer, which runs the RC4 key schedule from the password for every buffer
+	static bool ApplyRC4(const char* password, char* data, int size);
+
+private:
+	static void ApplyChaCha20(const uint32_t* input, unsigned char* data, int size, uint64_t firstBlock, int skip);
+	void ApplyRC4Packet(unsigned char* data, int size) const;
+
+	static void GenerateBlocks(const uint32_t* input, uint64_t firstBlock, int blockCount, unsigned char* keyStream);
+	static void GenerateBlock(const uint32_t* input, uint64_t block, unsigned char* keyStream);
+	static void XorBytes(unsigned char* data, const unsigned char* keyStream, int size);
+
+	int m_CipherType;
+	uint32_t m_State[16];
+	uint64_t m_StreamPosition;
+	unsigned char m_RC4Box[256];
+	unsigned int m_RC4I;
+	unsigned int m_RC4J;
+};
+
+//  Blocks of key stream generated per pass
+#if SOCKET_SIMD_AVX2
+#define SOCKET_CIPHER_BLOCKS_PER_PASS	8
+#elif SOCKET_SIMD_SSE2
+#define SOCKET_CIPHER_BLOCKS_PER_PASS	4
+#else
+#define SOCKET_CIPHER_BLOCKS_PER_PASS	1
+#endif
+
+#define SOCKET_CIPHER_ROTATE(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+#define SOCKET_CIPHER_QUARTER_ROUND(a, b, c, d) \
+	a += b; d ^= a; d = SOCKET_CIPHER_ROTATE(d, 16); \
+	c += d; b ^= c; b = SOCKET_CIPHER_ROTATE(b, 12); \
+	a += b; d ^= a; d = SOCKET_CIPHER_ROTATE(d, 8); \
+	c += d; b ^= c; b = SOCKET_CIPHER_ROTATE(b, 7);
+
+inline SocketCipher::SocketCipher() :
+	m_CipherType(SOCKET_CIPHER_CHACHA20),
+	m_StreamPosition(0),
+	m_RC4I(0),
+	m_RC4J(0)
+{
+	memset(m_State, 0, sizeof(m_State));
+	memset(m_RC4Box, 0, sizeof(m_RC4Box));
+}
+
+inline SocketCipher::~SocketCipher()
+{
+	//  Don't leave key material behind in freed memory
+	volatile unsigned char* state = reinterpret_cast<volatile unsigned char*>(m_State);
+	for (size_t i = 0; i < sizeof(m_State); ++i) state[i] = 0;
+	volatile unsigned char* box = m_RC4Box;
+	for (size_t i = 0; i < sizeof(m_RC4Box); ++i) box[i] = 0;
+}
+
+inline bool SocketCipher::SetPassword(const char* password, const unsigned char* salt, int direction, int cipherType)
+{
+	auto passwordLength = int(strlen(password));
+	if (passwordLength <= 0 || cipherType < 0 || cipherType >= SOCKET_CIPHER_TYPE_COUNT) return false;
+	if (direction < 0 || direction >= SOCKET_CIPHER_DIRECTION_COUNT) return false;
+	m_CipherType = cipherType;
+	m_StreamPosition = 0;
+
+	if (cipherType == SOCKET_CIPHER_RC4)
+	{
+		//  The same schedule as ApplyRC4, including its use of only the first 256 characters of the password
+		auto keyLength = std::min<int>(passwordLength, 256);
+		for (auto i = 0; i < 256; ++i) m_RC4Box[i] = (unsigned char)(i);
+		unsigned int j = 0;
+		for (auto i = 0; i < 256; ++i)
+		{
+			j = (j + m_RC4Box[i] + (unsigned int)(password[i % keyLength])) % 256;
+			std::swap(m_RC4Box[i], m_RC4Box[j]);
+		}
+		m_RC4I = m_RC4J = 0;
+		return true;
+	}
+
+	if (salt == nullptr) return false;
+
+	//  The nonce is the direction in its first word and the rest from a hash of the key, leaving ApplyToPacket's packet number
+	//  (mixed into the last two words) clear of the direction
+	unsigned char key[SHA256::DIGEST_SIZE];
+	unsigned char nonceSource[SHA256::DIGEST_SIZE];
+	SHA256 hash;
+	hash.init();
+	hash.update(reinterpret_cast<const unsigned char*>(password), (unsigned int)(passwordLength));
+	hash.update(salt, SOCKET_CIPHER_SALT_SIZE);
+	hash.final(key);
+	hash.init();
+	hash.update(key, SHA256::DIGEST_SIZE);
+	hash.final(nonceSource);
+
+	unsigned char nonce[SOCKET_CIPHER_NONCE_SIZE] = { (unsigned char)(direction), 0, 0, 0 };
+	memcpy(nonce + 4, nonceSource, SOCKET_CIPHER_NONCE_SIZE - 4);
+	SetKey(key, nonce);
+	memset(key, 0, sizeof(key));
+	return true;
+}
+
+inline void SocketCipher::GenerateSalt(unsigned char* salt)
+{
+	//  random_device draws on the operating system's random source on the platforms the engine builds for
+	std::random_device randomDevice;
+	for (auto i = 0; i < SOCKET_CIPHER_SALT_SIZE; i += 4)
+	{
+		auto value = uint32_t(randomDevice());
+		for (auto j = 0; j < 4; ++j) salt[i + j] = (unsigned char)(value >> (j * 8));
+	}
+}
+
+inline void SocketCipher::SetKey(const unsigned char* key, const unsigned char* nonce)
+{
+	//  Key is SOCKET_CIPHER_KEY_SIZE bytes and nonce is SOCKET_CIPHER_NONCE_SIZE bytes, laid out as in RFC 8439
+	m_CipherType = SOCKET_CIPHER_CHACHA20;
+	m_StreamPosition = 0;
+
+	m_State[0] = 0x61707865;
+	m_State[1] = 0x3320646e;
+	m_State[2] = 0x79622d32;
+	m_State[3] = 0x6b206574;
+	for (auto i = 0; i < 8; ++i) m_State[4 + i] = uint32_t(key[i * 4]) | (uint32_t(key[i * 4 + 1]) << 8) | (uint32_t(key[i * 4 + 2]) << 16) | (uint32_t(key[i * 4 + 3]) << 24);
+	m_State[12] = 0;
+	for (auto i = 0; i < 3; ++i) m_State[13 + i] = uint32_t(nonce[i * 4]) | (uint32_t(nonce[i * 4 + 1]) << 8) | (uint32_t(nonce[i * 4 + 2]) << 16) | (uint32_t(nonce[i * 4 + 3]) << 24);
+}
+
+inline void SocketCipher::Apply(char* data, int size)
+{
+	if (size <= 0) return;
+
+	if (m_CipherType == SOCKET_CIPHER_RC4)
+	{
+		//  Continues the RC4 stream from wherever the last call left it
+		auto bytes = reinterpret_cast<unsigned char*>(data);
+		for (auto x = 0; x < size; ++x)
+		{
+			m_RC4I = (m_RC4I + 1) % 256;
+			m_RC4J = (m_RC4J + m_RC4Box[m_RC4I]) % 256;
+			std::swap(m_RC4Box[m_RC4I], m_RC4Box[m_RC4J]);
+			bytes[x] ^= m_RC4Box[(m_RC4Box[m_RC4I] + m_RC4Box[m_RC4J]) % 256];
+		}
+		return;
+	}
+
+	ApplyChaCha20(m_State, reinterpret_cast<unsigned char*>(data), size, m_StreamPosition / 64, int(m_StreamPosition % 64));
+	m_StreamPosition += uint64_t(size);
+}
+
+inline void SocketCipher::ApplyToPacket(char* data, int size, uint64_t packetNumber)
+{
+	if (size <= 0) return;
+
+	//  RC4 has no nonce, so each packet gets the key stream from its start (exactly what the original EncryptBuffer produced)
+	if (m_CipherType == SOCKET_CIPHER_RC4)
+	{
+		ApplyRC4Packet(reinterpret_cast<unsigned char*>(data), size);
+		return;
+	}
+
+	//  The packet number is mixed into the nonce, and each packet's key stream starts at block zero
+	uint32_t state[16];
+	memcpy(state, m_State, sizeof(state));
+	state[14] ^= uint32_t(packetNumber);
+	state[15] ^= uint32_t(packetNumber >> 32);
+	ApplyChaCha20(state, reinterpret_cast<unsigned char*>(data), size, 0, 0);
+
+	volatile uint32_t* stateWords = state;
+	for (auto i = 0; i < 16; ++i) stateWords[i] = 0;
+}
+
+inline bool SocketCipher::ApplyRC4(const char* password, char* data, int size)
+{
+	SocketCipher cipher;
+	if (!cipher.SetPassword(password, nullptr, SOCKET_CIPHER_CLIENT_TO_SERVER, SOCKET_CIPHER_RC4)) return false;
+	cipher.Apply(data, size);
+	return true;
+}
+
+inline void SocketCipher::ApplyRC4Packet(unsigned char* data, int size) const
+{
+	unsigned char box[256];
+	memcpy(box, m_RC4Box, sizeof(box));
+	unsigned int i = 0;
+	unsigned int j = 0;
+	for (auto x = 0; x < size; ++x)
+	{
+		i = (i + 1) % 256;
+		j = (j + box[i]) % 256;
+		std::swap(box[i], box[j]);
+		data[x] ^= box[(box[i] + box[j]) % 256];
+	}
+}
+
+inline void SocketCipher::ApplyChaCha20(const uint32_t* input, unsigned char* data, int size, uint64_t firstBlock, int skip)
+{
+	//  The block counter is 64 bits here: the low half is word 12, as in RFC 8439, and the high half is added to the first nonce
+	//  word, which only matters past 256 GB of one stream
+	alignas(32) unsigned char keyStream[64 * SOCKET_CIPHER_BLOCKS_PER_PASS];
+	auto block = firstBlock;
+	while (size > 0)
+	{
+		auto blockCount = std::min<int>(SOCKET_CIPHER_BLOCKS_PER_PASS, (skip + size + 63) / 64);
+		GenerateBlocks(input, block, blockCount, keyStream);
+
+		auto used = std::min<int>(size, blockCount * 64 - skip);
+		XorBytes(data, keyStream + skip, used);
+		data += used;
+		size -= used;
+		block += uint64_t(blockCount);
+		skip = 0;
+	}
+}
+
+inline void SocketCipher::GenerateBlock(const uint32_t* input, uint64_t block, unsigned char* keyStream)
+{
+	uint32_t x[16];
+	memcpy(x, input, sizeof(x));
+	x[12] = uint32_t(block);
+	x[13] = input[13] + uint32_t(block >> 32);
+
+	uint32_t start[16];
+	memcpy(start, x, sizeof(start));
+
+	for (auto round = 0; round < 10; ++round)
+	{
+		SOCKET_CIPHER_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		SOCKET_CIPHER_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+	}
+
+	for (auto i = 0; i < 16; ++i)
+	{
+		auto word = x[i] + start[i];
+		keyStream[i * 4] = (unsigned char)(word);
+		keyStream[i * 4 + 1] = (unsigned char)(word >> 8);
+		keyStream[i * 4 + 2] = (unsigned char)(word >> 16);
+		keyStream[i * 4 + 3] = (unsigned char)(word >> 24);
+	}
+}
+
+#if SOCKET_SIMD_AVX2 || SOCKET_SIMD_SSE2
+#define SOCKET_CIPHER_VECTOR_QUARTER_ROUND(a, b, c, d, Add, Xor, Rotate) \
+	a = Add(a, b); d = Xor(d, a); d = Rotate(d, 16); \
+	c = Add(c, d); b = Xor(b, c); b = Rotate(b, 12); \
+	a = Add(a, b); d = Xor(d, a); d = Rotate(d, 8); \
+	c = Add(c, d); b = Xor(b, c); b = Rotate(b, 7);
+
+#define SOCKET_CIPHER_VECTOR_ROUNDS(x, Add, Xor, Rotate) \
+	for (auto round = 0; round < 10; ++round) \
+	{ \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[0], x[4], x[8], x[12], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[1], x[5], x[9], x[13], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[2], x[6], x[10], x[14], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[3], x[7], x[11], x[15], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[0], x[5], x[10], x[15], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[1], x[6], x[11], x[12], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[2], x[7], x[8], x[13], Add, Xor, Rotate); \
+		SOCKET_CIPHER_VECTOR_QUARTER_ROUND(x[3], x[4], x[9], x[14], Add, Xor, Rotate); \
+	}
+
+inline __m128i SocketCipherRotate128(__m128i value, int bits) { return _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - bits)); }
+#if SOCKET_SIMD_AVX2
+inline __m256i SocketCipherRotate256(__m256i value, int bits) { return _mm256_or_si256(_mm256_slli_epi32(value, bits), _mm256_srli_epi32(value, 32 - bits)); }
+#endif
+#endif
+
+inline void SocketCipher::GenerateBlocks(const uint32_t* input, uint64_t firstBlock, int blockCount, unsigned char* keyStream)
+{
+	//  Each vector holds the same word of several consecutive blocks, so one pass of the rounds produces all of them. The
+	//  results are then transposed back into block order.
+#if SOCKET_SIMD_AVX2
+	if (blockCount == 8)
+	{
+		__m256i x[16];
+		__m256i start[16];
+		for (auto i = 0; i < 16; ++i) x[i] = _mm256_set1_epi32(int(input[i]));
+		uint32_t counterLow[8];
+		uint32_t counterHigh[8];
+		for (auto lane = 0; lane < 8; ++lane)
+		{
+			counterLow[lane] = uint32_t(firstBlock + lane);
+			counterHigh[lane] = input[13] + uint32_t((firstBlock + lane) >> 32);
+		}
+		x[12] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counterLow));
+		x[13] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counterHigh));
+		for (auto i = 0; i < 16; ++i) start[i] = x[i];
+
+		SOCKET_CIPHER_VECTOR_ROUNDS(x, _mm256_add_epi32, _mm256_xor_si256, SocketCipherRotate256);
+
+		for (auto group = 0; group < 4; ++group)
+		{
+			//  Transposes words group*4 .. group*4+3 of every block, within each 128 bit half (blocks 0-3, then 4-7)
+			auto a = _mm256_add_epi32(x[group * 4], start[group * 4]);
+			auto b = _mm256_add_epi32(x[group * 4 + 1], start[group * 4 + 1]);
+			auto c = _mm256_add_epi32(x[group * 4 + 2], start[group * 4 + 2]);
+			auto d = _mm256_add_epi32(x[group * 4 + 3], start[group * 4 + 3]);
+			auto ab0 = _mm256_unpacklo_epi32(a, b);
+			auto ab1 = _mm256_unpackhi_epi32(a, b);
+			auto cd0 = _mm256_unpacklo_epi32(c, d);
+			auto cd1 = _mm256_unpackhi_epi32(c, d);
+			__m256i rows[4] = { _mm256_unpacklo_epi64(ab0, cd0), _mm256_unpackhi_epi64(ab0, cd0), _mm256_unpacklo_epi64(ab1, cd1), _mm256_unpackhi_epi64(ab1, cd1) };
+			for (auto row = 0; row < 4; ++row)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + row * 64 + group * 16), _mm256_castsi256_si128(rows[row]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + (row + 4) * 64 + group * 16), _mm256_extracti128_si256(rows[row], 1));
+			}
+		}
+		return;
+	}
+#endif
+#if SOCKET_SIMD_AVX2 || SOCKET_SIMD_SSE2
+	for (; blockCount >= 4; blockCount -= 4, firstBlock += 4, keyStream += 256)
+	{
+		__m128i x[16];
+		__m128i start[16];
+		for (auto i = 0; i < 16; ++i) x[i] = _mm_set1_epi32(int(input[i]));
+		x[12] = _mm_setr_epi32(int(uint32_t(firstBlock)), int(uint32_t(firstBlock + 1)), int(uint32_t(firstBlock + 2)), int(uint32_t(firstBlock + 3)));
+		x[13] = _mm_setr_epi32(int(input[13] + uint32_t(firstBlock >> 32)), int(input[13] + uint32_t((firstBlock + 1) >> 32)), int(input[13] + uint32_t((firstBlock + 2) >> 32)), int(input[13] + uint32_t((firstBlock + 3) >> 32)));
+		for (auto i = 0; i < 16; ++i) start[i] = x[i];
+
+		SOCKET_CIPHER_VECTOR_ROUNDS(x, _mm_add_epi32, _mm_xor_si128, SocketCipherRotate128);
+
+		for (auto group = 0; group < 4; ++group)
+		{
+			auto a = _mm_add_epi32(x[group * 4], start[group * 4]);
+			auto b = _mm_add_epi32(x[group * 4 + 1], start[group * 4 + 1]);
+			auto c = _mm_add_epi32(x[group * 4 + 2], start[group * 4 + 2]);
+			auto d = _mm_add_epi32(x[group * 4 + 3], start[group * 4 + 3]);
+			auto ab0 = _mm_unpacklo_epi32(a, b);
+			auto ab1 = _mm_unpackhi_epi32(a, b);
+			auto cd0 = _mm_unpacklo_epi32(c, d);
+			auto cd1 = _mm_unpackhi_epi32(c, d);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + group * 16), _mm_unpacklo_epi64(ab0, cd0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + 64 + group * 16), _mm_unpackhi_epi64(ab0, cd0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + 128 + group * 16), _mm_unpacklo_epi64(ab1, cd1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(keyStream + 192 + group * 16), _mm_unpackhi_epi64(ab1, cd1));
+		}
+	}
+#endif
+	for (auto i = 0; i < blockCount; ++i) GenerateBlock(input, firstBlock + i, keyStream + i * 64);
+}
+
+inline void SocketCipher::XorBytes(unsigned char* data, const unsigned char* keyStream, int size)
+{
+	auto offset = 0;
+#if SOCKET_SIMD_SSE2
+	for (; offset + 16 <= size; offset += 16)
+	{
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + offset), _mm_xor_si128(block, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keyStream + offset))));
+	}
+#endif
+	for (; offset + 8 <= size; offset += 8)
+	{
+		uint64_t block;
+		uint64_t key;
+		memcpy(&block, data + offset, 8);
+		memcpy(&key, keyStream + offset, 8);
+		block ^= key;
+		memcpy(data + offset, &block, 8);
+	}
+	for (; offset < size; ++offset) data[offset] ^= keyStream[offset];
+}
\ No newline at end of file
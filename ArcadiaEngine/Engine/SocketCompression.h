@@ -0,0 +1,275 @@
+#pragma once
+
+#include "SocketBuffer.h"
+
+#include <cstdint>
+#include <cstring>
+
+#define SOCKET_COMPRESSION_DEFAULT_THRESHOLD	128 // Smaller payloads rarely shrink enough to be worth it
+#define SOCKET_COMPRESSION_HASH_BITS			12
+
+//  The first byte of a payload sent over a socket with compression on says how the rest of it is stored
+enum SocketCompressionTypes { SOCKET_COMPRESSION_NONE = 0, SOCKET_COMPRESSION_LZ, SOCKET_COMPRESSION_TYPE_COUNT };
+
+//  Compression is negotiated on each connection with small control frames, sent as ordinary messages in the stream:
+//
+//      OFFER	this end wants compression (sent when it is turned on)
+//      START	every payload from this end after this frame starts with a SocketCompressionTypes byte
+//      STOP	every payload from this end after this frame is sent as it is again
+//
+//  An end starts compressing once it has turned compression on and has had an OFFER from its peer. The receiving side only
+//  follows the peer's START and STOP frames, so the two never disagree about what a payload holds, even while one end is
+//  still waiting for the other. A control frame is six bytes beginning with 0xFF (never a valid type byte), which makes an
+//  uncompressed payload of exactly those six bytes the one message that can't be sent.
+enum SocketCompressionControls { SOCKET_COMPRESSION_CONTROL_OFFER = 1, SOCKET_COMPRESSION_CONTROL_START, SOCKET_COMPRESSION_CONTROL_STOP };
+#define SOCKET_COMPRESSION_CONTROL_SIZE			6
+#define SOCKET_COMPRESSION_CONTROL_VERSION		1
+
+//  Where a connection's negotiation has got to, kept on its socket
+struct SocketCompressionState
+{
+	bool m_OfferPending; // This end turned compression on but hasn't got its OFFER into the stream yet
+	bool m_PeerOffered;
+	bool m_Sending; // Payloads sent are compressed (START has gone out)
+	bool m_Receiving; // Payloads received are compressed (START has come in)
+	bool m_ErrorReported;
+};
+
+//  A small, dependency-free LZ compressor using the LZ4 block layout: each sequence is a token (literal count and match length,
+//  four bits each), the literals, a two byte offset back into the output and any extra match length. It matches four byte runs
+//  through a hash table of recent positions and skips ahead faster through data that isn't matching, which keeps it fast on
+//  payloads that don't compress.
+//
+//  CompressBuffer / DecompressBuffer wrap a payload in the form sent over a socket: one SocketCompressionTypes byte, then for
+//  compressed data the original size (four bytes, little endian) and the compressed block.
+class SocketCompression
+{
+public:
+	static int GetMaxCompressedSize(int size) { return size + (size / 255) + 16; }
+	static int Compress(const unsigned char* in, int inSize, unsigned char* out, int outCapacity);
+	static int Decompress(const unsigned char* in, int inSize, unsigned char* out, int outSize);
+
+	static int CompressBuffer(const SocketBuffer* source, SocketBuffer* destination, int threshold = SOCKET_COMPRESSION_DEFAULT_THRESHOLD);
+	static bool DecompressBuffer(const SocketBuffer* source, SocketBuffer* destination);
+
+	static void WriteControlFrame(SocketBuffer* destination, int control);
+	static int ReadControlFrame(const char* data, int size);
+
+private:
+	static unsigned int ReadWord(const unsigned char* in) { unsigned int word; memcpy(&word, in, 4); return word; }
+	static unsigned int HashWord(unsigned int word) { return (word * 2654435761u) >> (32 - SOCKET_COMPRESSION_HASH_BITS); }
+	static unsigned char* WriteLength(unsigned char* out, int length);
+	static unsigned char* WriteSequence(unsigned char* out, const unsigned char* literals, int literalCount, int offset, int matchLength);
+};
+
+//  The last match has to start this far from the end, and the last few bytes are always literals, as in LZ4
+#define SOCKET_COMPRESSION_MATCH_LIMIT		12
+#define SOCKET_COMPRESSION_LAST_LITERALS	5
+
+inline unsigned char* SocketCompression::WriteLength(unsigned char* out, int length)
+{
+	//  Lengths that don't fit in the token's four bits continue in bytes of 255, ending with a byte below 255
+	for (; length >= 255; length -= 255) *out++ = 255;
+	*out++ = (unsigned char)(length);
+	return out;
+}
+
+inline unsigned char* SocketCompression::WriteSequence(unsigned char* out, const unsigned char* literals, int literalCount, int offset, int matchLength)
+{
+	auto token = out++;
+	*token = (unsigned char)(std::min<int>(literalCount, 15) << 4);
+	if (literalCount >= 15) out = WriteLength(out, literalCount - 15);
+	memcpy(out, literals, literalCount);
+	out += literalCount;
+
+	//  The final sequence is literals only
+	if (matchLength == 0) return out;
+
+	out[0] = (unsigned char)(offset & 0xFF);
+	out[1] = (unsigned char)(offset >> 8);
+	out += 2;
+
+	auto matchCode = matchLength - 4;
+	*token |= (unsigned char)(std::min<int>(matchCode, 15));
+	if (matchCode >= 15) out = WriteLength(out, matchCode - 15);
+	return out;
+}
+
+inline int SocketCompression::Compress(const unsigned char* in, int inSize, unsigned char* out, int outCapacity)
+{
+	//  Returns the compressed size, or 0 if the output doesn't have GetMaxCompressedSize(inSize) bytes of room
+	if (inSize < 0 || outCapacity < GetMaxCompressedSize(inSize)) return 0;
+
+	int hashTable[1 << SOCKET_COMPRESSION_HASH_BITS];
+	for (auto i = 0; i < (1 << SOCKET_COMPRESSION_HASH_BITS); ++i) hashTable[i] = -1;
+
+	auto outStart = out;
+	auto anchor = 0;
+	auto position = 0;
+	auto matchStartLimit = inSize - SOCKET_COMPRESSION_MATCH_LIMIT;
+	auto matchEndLimit = inSize - SOCKET_COMPRESSION_LAST_LITERALS;
+
+	while (position < matchStartLimit)
+	{
+		auto word = ReadWord(in + position);
+		auto hash = HashWord(word);
+		auto candidate = hashTable[hash];
+		hashTable[hash] = position;
+
+		if (candidate < 0 || position - candidate > 0xFFFF || ReadWord(in + candidate) != word)
+		{
+			//  The longer it has been since the last match, the further ahead each miss skips
+			position += 1 + ((position - anchor) >> 6);
+			continue;
+		}
+
+		auto matchLength = 4;
+		while (position + matchLength < matchEndLimit && in[candidate + matchLength] == in[position + matchLength]) ++matchLength;
+
+		out = WriteSequence(out, in + anchor, position - anchor, position - candidate, matchLength);
+		position += matchLength;
+		anchor = position;
+
+		//  Remember a position just inside the match, so a repeat of its tail can be found right away
+		if (position - 2 < matchStartLimit) hashTable[HashWord(ReadWord(in + position - 2))] = position - 2;
+	}
+
+	out = WriteSequence(out, in + anchor, inSize - anchor, 0, 0);
+	return int(out - outStart);
+}
+
+inline int SocketCompression::Decompress(const unsigned char* in, int inSize, unsigned char* out, int outSize)
+{
+	//  Returns outSize once exactly that many bytes have been produced, or -1 if the data is malformed. Every length and offset
+	//  is checked against both buffers, so bad data from a peer can't read or write out of bounds.
+	auto inEnd = in + inSize;
+	auto outStart = out;
+	auto outEnd = out + outSize;
+
+	while (in < inEnd)
+	{
+		auto token = *in++;
+
+		int literalCount = token >> 4;
+		if (literalCount == 15)
+		{
+			unsigned char extra;
+			do
+			{
+				if (in >= inEnd) return -1;
+				extra = *in++;
+				literalCount += extra;
+			} while (extra == 255 && literalCount < outSize);
+		}
+		if (literalCount > inEnd - in || literalCount > outEnd - out) return -1;
+		memcpy(out, in, literalCount);
+		in += literalCount;
+		out += literalCount;
+
+		//  The final sequence ends with its literals
+		if (in == inEnd) break;
+
+		if (inEnd - in < 2) return -1;
+		auto offset = int(in[0]) | (int(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > out - outStart) return -1;
+
+		int matchLength = (token & 15) + 4;
+		if ((token & 15) == 15)
+		{
+			unsigned char extra;
+			do
+			{
+				if (in >= inEnd) return -1;
+				extra = *in++;
+				matchLength += extra;
+			} while (extra == 255 && matchLength < outSize);
+		}
+		if (matchLength > outEnd - out) return -1;
+
+		//  A match may overlap the bytes it is producing (a short repeating pattern), so those are copied a byte at a time
+		auto match = out - offset;
+		if (offset >= matchLength) memcpy(out, match, matchLength);
+		else for (auto i = 0; i < matchLength; ++i) out[i] = match[i];
+		out += matchLength;
+	}
+
+	return ((out == outEnd) ? outSize : -1);
+}
+
+inline int SocketCompression::CompressBuffer(const SocketBuffer* source, SocketBuffer* destination, int threshold)
+{
+	//  Replaces the destination with the source payload in its sent form, and returns that size. Payloads below the threshold,
+	//  or that don't get smaller, are stored as they are behind a SOCKET_COMPRESSION_NONE byte.
+	auto size = source->m_BufferUtilizedCount;
+	destination->clear();
+
+	if (size >= threshold)
+	{
+		destination->reserve(5 + GetMaxCompressedSize(size));
+		auto out = reinterpret_cast<unsigned char*>(destination->m_BufferData);
+		auto compressedSize = Compress(reinterpret_cast<const unsigned char*>(source->m_BufferData), size, out + 5, destination->capacity() - 5);
+		if (compressedSize > 0 && compressedSize + 5 < size + 1)
+		{
+			out[0] = (unsigned char)(SOCKET_COMPRESSION_LZ);
+			for (auto i = 0; i < 4; ++i) out[1 + i] = (unsigned char)((unsigned int)(size) >> (i * 8));
+			destination->m_BufferUtilizedCount = destination->m_WritePosition = compressedSize + 5;
+			return destination->m_BufferUtilizedCount;
+		}
+	}
+
+	auto type = (unsigned char)(SOCKET_COMPRESSION_NONE);
+	destination->StreamWrite(&type, 1);
+	destination->StreamWrite(source->m_BufferData, size);
+	return destination->m_BufferUtilizedCount;
+}
+
+inline bool SocketCompression::DecompressBuffer(const SocketBuffer* source, SocketBuffer* destination)
+{
+	//  Replaces the destination with the original payload from a source in its sent form
+	auto in = reinterpret_cast<const unsigned char*>(source->m_BufferData);
+	auto size = source->m_BufferUtilizedCount;
+	if (size < 1) return false;
+	destination->clear();
+
+	switch (in[0])
+	{
+	case SOCKET_COMPRESSION_NONE:
+		destination->StreamWrite(source->m_BufferData + 1, size - 1);
+		return true;
+
+	case SOCKET_COMPRESSION_LZ:
+	{
+		if (size < 5) return false;
+		unsigned int originalSize = 0;
+		for (auto i = 0; i < 4; ++i) originalSize |= (unsigned int)(in[1 + i]) << (i * 8);
+
+		//  A block can't expand by more than 255 to 1, so a larger claimed size is refused before anything is allocated
+		if (originalSize > (unsigned int)(size - 5) * 255u + 16u) return false;
+
+		destination->reserve(int(originalSize));
+		if (Decompress(in + 5, size - 5, reinterpret_cast<unsigned char*>(destination->m_BufferData), int(originalSize)) < 0) return false;
+		destination->m_BufferUtilizedCount = destination->m_WritePosition = int(originalSize);
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+inline void SocketCompression::WriteControlFrame(SocketBuffer* destination, int control)
+{
+	const unsigned char frame[SOCKET_COMPRESSION_CONTROL_SIZE] = { 0xFF, 'L', 'Z', 'N', SOCKET_COMPRESSION_CONTROL_VERSION, (unsigned char)(control) };
+	destination->clear();
+	destination->StreamWrite((void*)(frame), SOCKET_COMPRESSION_CONTROL_SIZE);
+}
+
+inline int SocketCompression::ReadControlFrame(const char* data, int size)
+{
+	//  Returns the SocketCompressionControls value of a control frame, or 0 for anything else
+	if (size != SOCKET_COMPRESSION_CONTROL_SIZE) return 0;
+	auto in = reinterpret_cast<const unsigned char*>(data);
+	if (in[0] != 0xFF || in[1] != 'L' || in[2] != 'Z' || in[3] != 'N' || in[4] != SOCKET_COMPRESSION_CONTROL_VERSION) return 0;
+	return ((in[5] >= SOCKET_COMPRESSION_CONTROL_OFFER && in[5] <= SOCKET_COMPRESSION_CONTROL_STOP) ? int(in[5]) : 0);
+}
\ No newline at end of file
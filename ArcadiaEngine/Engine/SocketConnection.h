@@ -0,0 +1,671 @@
+#pragma once
+
+#include "DatagramBatch.h"
+#include "SocketBuffer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+//  How a channel treats its messages. Unreliable messages are sent once and may be lost (or arrive out of order). Reliable ones
+//  are resent until acknowledged, and are delivered either as they complete or strictly in the order they were sent.
+enum SocketChannelTypes { SOCKET_CHANNEL_UNRELIABLE = 0, SOCKET_CHANNEL_RELIABLE_UNORDERED, SOCKET_CHANNEL_RELIABLE_ORDERED, SOCKET_CHANNEL_TYPE_COUNT };
+
+#define SOCKET_CONNECTION_PROTOCOL_ID			0x41C5
+#define SOCKET_CONNECTION_HEADER_SIZE			11 // Protocol ID, flags, sequence, ack, ack bits
+#define SOCKET_CONNECTION_ENTRY_SIZE			5 // Channel, message ID, size
+#define SOCKET_CONNECTION_FRAGMENT_ENTRY_SIZE	9 // Channel, message ID, fragment index and count, size
+#define SOCKET_CONNECTION_TOKEN_SIZE			8
+#define SOCKET_CONNECTION_CHALLENGE_SIZE		(SOCKET_CONNECTION_HEADER_SIZE + SOCKET_CONNECTION_TOKEN_SIZE)
+#define SOCKET_CONNECTION_FRAGMENT_SIZE			(DATAGRAM_MAX_SIZE - SOCKET_CONNECTION_HEADER_SIZE - SOCKET_CONNECTION_TOKEN_SIZE - SOCKET_CONNECTION_FRAGMENT_ENTRY_SIZE)
+#define SOCKET_CONNECTION_MAX_FRAGMENTS			256 // Messages up to about 2MB
+#define SOCKET_CONNECTION_MAX_CHANNELS			16
+#define SOCKET_CONNECTION_PACKET_HISTORY		1024 // Sent packets remembered for acks, by sequence
+#define SOCKET_CONNECTION_MESSAGE_WINDOW		256 // Reliable messages in flight per channel
+#define SOCKET_CONNECTION_MAX_REASSEMBLY_SIZE	(4 * 1024 * 1024) // Room set aside for messages still in pieces
+#define SOCKET_CONNECTION_INITIAL_RESEND_TIME	0.25
+#define SOCKET_CONNECTION_MIN_RESEND_TIME		0.02
+#define SOCKET_CONNECTION_MAX_RESEND_TIME		1.0
+#define SOCKET_CONNECTION_KEEPALIVE_TIME		0.25
+#define SOCKET_CONNECTION_TIMEOUT				10.0
+#define SOCKET_CONNECTION_TOKEN_PERIOD			10.0 // A token is good for this period and the next
+#define SOCKET_CONNECTION_MAX_WAITING			64 // New connections a listening socket holds before they are accepted
+
+//  One peer of a UDP socket, with any number of message channels. The connection is only the protocol: it reads the datagrams
+//  it is given and writes the ones it wants sent into a DatagramBatch, and WinsockWrapper moves them through the socket.
+//
+//  Every packet has its own sequence number and acknowledges the latest packet received along with a bitfield of the 32 before
+//  it, so each ack is repeated in many packets and a lost one rarely matters. Reliable messages remember which packets carried
+//  them. Once one of those packets is acknowledged the message is done, and otherwise it is sent again when the resend timeout
+//  (from the measured round trip time) runs out. Messages too big for one datagram go in fragments, which are acknowledged and
+//  resent one by one, and are put back together before delivery.
+//
+//  A message still in pieces has room for all of it set aside when its first fragment arrives, though each fragment is only
+//  stored as it comes in, and a connection sets aside no more than SOCKET_CONNECTION_MAX_REASSEMBLY_SIZE in all. A packet that
+//  would start a reliable message past that is refused whole and left for the peer to send again, except the one an ordered
+//  channel delivers next, which nothing else can get past. Unreliable messages past it are dropped.
+//
+//  A listening end keeps nothing for a peer it hasn't heard from before until the peer proves it can receive at its address.
+//  The end that opened the connection attaches a token to its packets until it hears back, and a packet whose token is missing
+//  or wrong is answered with a challenge carrying the right one (made from the listener's secret and the peer's address, see
+//  WinsockWrapper::UpdateConnections), which the opening end then attaches instead. A challenge is no larger than the packet
+//  that drew it.
+//
+//      packet:	protocol ID (2), flags (1), sequence (2), ack (2), ack bits (4), [token (8)], then entries until the end
+//      entry:	channel (1, top bit set for a fragment), message ID (2), [fragment index (2), fragment count (2)], size (2), data
+//
+//  The flags are bit 0 when the ack fields are valid, bit 1 when a token is attached, and bit 2 for a challenge, which holds
+//  nothing but its token.
+//
+//  All numbers are little endian. Sequence numbers and message IDs are 16 bits and wrap around.
+class SocketConnection
+{
+public:
+	//  An outgoing connection is one this end opened, which attaches a token until its peer answers
+	SocketConnection(int socketID, const SOCKADDR_IN& address, double time, bool outgoing);
+
+	SocketConnection(const SocketConnection&) = delete;
+	SocketConnection& operator=(const SocketConnection&) = delete;
+
+	//  Both ends need the same channels in the same order. A new connection has one of each type, at the index of its type.
+	int AddChannel(int channelType);
+	int GetChannelCount() const { return int(m_Channels.size()); }
+
+	int QueueMessage(int channel, const char* data, int size);
+	int TakeMessage(int channel, SocketBuffer* destination);
+
+	bool ReadPacket(const char* data, int size, double time);
+	int WritePackets(DatagramBatch& batch, double time);
+
+	int GetSocketID() const { return m_SocketID; }
+	const SOCKADDR_IN& GetAddress() const { return m_Address; }
+	double GetRoundTripTime() const { return m_RoundTripTime; }
+	double GetResendTime() const { return m_ResendTime; }
+	bool GetTimedOut(double time) const { return (time - m_LastReceiveTime > SOCKET_CONNECTION_TIMEOUT); }
+
+	static bool IsConnectionPacket(const char* data, int size);
+	static bool GetPacketToken(const char* data, int size, uint64_t& token);
+	static int WriteChallenge(char* out, uint64_t token);
+
+private:
+	struct OutgoingMessage
+	{
+		uint16_t m_MessageID;
+		bool m_Active;
+		std::vector<char> m_Data;
+		int m_FragmentCount;
+		int m_NextFragment;
+		int m_UnackedCount;
+		std::vector<double> m_FragmentSendTimes;
+		std::vector<bool> m_FragmentAcked;
+	};
+
+	struct IncomingMessage
+	{
+		uint16_t m_MessageID;
+		bool m_Active;
+		bool m_Delivered;
+		int m_FragmentCount;
+		int m_ReceivedCount;
+		int m_ReservedSize;
+		std::vector<std::vector<char>> m_Fragments;
+	};
+
+	struct Channel
+	{
+		int m_Type;
+		uint16_t m_NextSendID;
+		uint16_t m_NextWindowID;
+		uint16_t m_OldestUnackedID;
+		uint16_t m_NextDeliverID;
+		std::deque<OutgoingMessage> m_Pending;
+		std::vector<OutgoingMessage> m_SendWindow;
+		std::vector<IncomingMessage> m_ReceiveWindow;
+		std::deque<std::vector<char>> m_Delivered;
+	};
+
+	//  A fragment of a reliable message that a packet carried
+	struct FragmentReference
+	{
+		uint8_t m_Channel;
+		uint16_t m_MessageID;
+		uint16_t m_FragmentIndex;
+	};
+
+	struct SentPacket
+	{
+		uint16_t m_Sequence;
+		bool m_Valid;
+		bool m_Acked;
+		double m_SendTime;
+		std::vector<FragmentReference> m_Fragments;
+	};
+
+	//  Where each channel's packing got to, so a run of packets written in one call doesn't look at anything twice
+	struct ChannelCursor
+	{
+		int m_WindowOffset;
+		int m_Fragment;
+	};
+
+	static bool SequenceGreater(uint16_t a, uint16_t b) { return ((a > b) && (a - b <= 32768)) || ((a < b) && (b - a > 32768)); }
+	static void WriteUInt16(char* out, uint16_t value) { out[0] = char(value & 0xFF); out[1] = char(value >> 8); }
+	static void WriteUInt32(char* out, uint32_t value) { for (auto i = 0; i < 4; ++i) out[i] = char((value >> (i * 8)) & 0xFF); }
+	static uint16_t ReadUInt16(const char* in) { return uint16_t((unsigned char)(in[0]) | ((unsigned char)(in[1]) << 8)); }
+	static uint32_t ReadUInt32(const char* in) { uint32_t value = 0; for (auto i = 0; i < 4; ++i) value |= uint32_t((unsigned char)(in[i])) << (i * 8); return value; }
+	static void WriteUInt64(char* out, uint64_t value) { for (auto i = 0; i < 8; ++i) out[i] = char((value >> (i * 8)) & 0xFF); }
+	static uint64_t ReadUInt64(const char* in) { uint64_t value = 0; for (auto i = 0; i < 8; ++i) value |= uint64_t((unsigned char)(in[i])) << (i * 8); return value; }
+	static bool IsReliable(int channelType) { return (channelType != SOCKET_CHANNEL_UNRELIABLE); }
+	static int GetReservedSize(int fragmentCount) { return fragmentCount * SOCKET_CONNECTION_FRAGMENT_SIZE; }
+
+	int WritePacket(double time, std::vector<ChannelCursor>& cursors, bool& packetFull);
+	bool WriteEntry(int& size, int channel, const OutgoingMessage& message, int fragmentIndex);
+	bool ReadEntries(const char* data, int size, bool apply);
+	bool IsLateFragment(const Channel& channel, uint16_t messageID) const;
+	void ReceiveFragment(int channel, uint16_t messageID, int fragmentIndex, int fragmentCount, const char* data, int size);
+	void DeliverMessage(Channel& channel, IncomingMessage& message);
+	void ReleaseMessage(IncomingMessage& message);
+	void RecordReceived(uint16_t sequence);
+	void AcknowledgePacket(uint16_t sequence, double time);
+	void FillSendWindows();
+
+	int m_SocketID;
+	SOCKADDR_IN m_Address;
+	std::vector<Channel> m_Channels;
+	std::vector<SentPacket> m_SentPackets;
+	std::vector<char> m_PacketData;
+	int m_ReservedSize;
+
+	uint16_t m_NextSequence;
+	uint16_t m_RemoteSequence;
+	uint32_t m_ReceivedBits;
+	bool m_ReceivedAny;
+	bool m_AckPending;
+	bool m_AttachToken;
+	uint64_t m_Token;
+
+	double m_RoundTripTime;
+	double m_RoundTripVariance;
+	double m_ResendTime;
+	double m_LastSendTime;
+	double m_LastReceiveTime;
+};
+
+inline SocketConnection::SocketConnection(int socketID, const SOCKADDR_IN& address, double time, bool outgoing) :
+	m_SocketID(socketID),
+	m_Address(address),
+	m_ReservedSize(0),
+	m_NextSequence(0),
+	m_RemoteSequence(0),
+	m_ReceivedBits(0),
+	m_ReceivedAny(false),
+	m_AckPending(false),
+	m_AttachToken(outgoing),
+	m_Token(0),
+	m_RoundTripTime(0.0),
+	m_RoundTripVariance(0.0),
+	m_ResendTime(SOCKET_CONNECTION_INITIAL_RESEND_TIME),
+	m_LastSendTime(time - SOCKET_CONNECTION_KEEPALIVE_TIME),
+	m_LastReceiveTime(time)
+{
+	m_SentPackets.resize(SOCKET_CONNECTION_PACKET_HISTORY);
+	for (auto iter = m_SentPackets.begin(); iter != m_SentPackets.end(); ++iter) iter->m_Valid = false;
+	m_PacketData.resize(DATAGRAM_MAX_SIZE);
+	for (auto i = 0; i < SOCKET_CHANNEL_TYPE_COUNT; ++i) AddChannel(i);
+}
+
+inline int SocketConnection::AddChannel(int channelType)
+{
+	//  Returns the new channel's index, or -1 if the type is unknown or there are already as many channels as a packet can name
+	if (channelType < 0 || channelType >= SOCKET_CHANNEL_TYPE_COUNT || int(m_Channels.size()) >= SOCKET_CONNECTION_MAX_CHANNELS) return -1;
+
+	m_Channels.emplace_back();
+	auto& channel = m_Channels.back();
+	channel.m_Type = channelType;
+	channel.m_NextSendID = 0;
+	channel.m_NextWindowID = 0;
+	channel.m_OldestUnackedID = 0;
+	channel.m_NextDeliverID = 0;
+	if (IsReliable(channelType)) channel.m_SendWindow.resize(SOCKET_CONNECTION_MESSAGE_WINDOW);
+	channel.m_ReceiveWindow.resize(SOCKET_CONNECTION_MESSAGE_WINDOW);
+	for (auto iter = channel.m_SendWindow.begin(); iter != channel.m_SendWindow.end(); ++iter) iter->m_Active = false;
+	for (auto iter = channel.m_ReceiveWindow.begin(); iter != channel.m_ReceiveWindow.end(); ++iter)
+	{
+		iter->m_Active = false;
+		iter->m_ReservedSize = 0;
+	}
+	return int(m_Channels.size()) - 1;
+}
+
+inline int SocketConnection::QueueMessage(int channel, const char* data, int size)
+{
+	//  The message goes out with the next WritePackets. Returns its message ID, or -1 if the channel doesn't exist or the message
+	//  is empty or too large.
+	if (channel < 0 || channel >= int(m_Channels.size())) return -1;
+	if (size <= 0 || size > SOCKET_CONNECTION_FRAGMENT_SIZE * SOCKET_CONNECTION_MAX_FRAGMENTS) return -1;
+
+	auto& target = m_Channels[channel];
+	target.m_Pending.emplace_back();
+	auto& message = target.m_Pending.back();
+	message.m_MessageID = target.m_NextSendID++;
+	message.m_Active = true;
+	message.m_Data.assign(data, data + size);
+	message.m_FragmentCount = (size + SOCKET_CONNECTION_FRAGMENT_SIZE - 1) / SOCKET_CONNECTION_FRAGMENT_SIZE;
+	message.m_NextFragment = 0;
+	message.m_UnackedCount = message.m_FragmentCount;
+	return int(message.m_MessageID);
+}
+
+inline int SocketConnection::TakeMessage(int channel, SocketBuffer* destination)
+{
+	//  Replaces the destination with the next delivered message, and returns its size (0 if there isn't one, -1 if the channel
+	//  doesn't exist)
+	if (channel < 0 || channel >= int(m_Channels.size())) return -1;
+	auto& delivered = m_Channels[channel].m_Delivered;
+	if (delivered.empty()) return 0;
+
+	destination->clear();
+	destination->StreamWrite(delivered.front().data(), int(delivered.front().size()));
+	delivered.pop_front();
+	return destination->m_BufferUtilizedCount;
+}
+
+inline bool SocketConnection::IsConnectionPacket(const char* data, int size)
+{
+	return (size >= SOCKET_CONNECTION_HEADER_SIZE && ReadUInt16(data) == SOCKET_CONNECTION_PROTOCOL_ID);
+}
+
+inline bool SocketConnection::GetPacketToken(const char* data, int size, uint64_t& token)
+{
+	//  Returns false if the packet has no token attached
+	if (!IsConnectionPacket(data, size) || (data[2] & 6) != 2 || size < SOCKET_CONNECTION_CHALLENGE_SIZE) return false;
+	token = ReadUInt64(data + SOCKET_CONNECTION_HEADER_SIZE);
+	return true;
+}
+
+inline int SocketConnection::WriteChallenge(char* out, uint64_t token)
+{
+	//  Returns the size written, SOCKET_CONNECTION_CHALLENGE_SIZE
+	memset(out, 0, SOCKET_CONNECTION_HEADER_SIZE);
+	WriteUInt16(out, SOCKET_CONNECTION_PROTOCOL_ID);
+	out[2] = char(4);
+	WriteUInt64(out + SOCKET_CONNECTION_HEADER_SIZE, token);
+	return SOCKET_CONNECTION_CHALLENGE_SIZE;
+}
+
+inline bool SocketConnection::ReadPacket(const char* data, int size, double time)
+{
+	//  Returns false if the packet isn't one of ours or is malformed. A packet is only acknowledged once all of it has been
+	//  accepted, so one naming a channel that hasn't been added yet is dropped whole and will be sent again.
+	if (!IsConnectionPacket(data, size)) return false;
+	auto flags = (unsigned char)(data[2]);
+	if (flags & 4)
+	{
+		//  A challenge only matters until the peer has answered, and the resends it leads to carry the new token
+		if (m_AttachToken && size == SOCKET_CONNECTION_CHALLENGE_SIZE)
+		{
+			m_Token = ReadUInt64(data + SOCKET_CONNECTION_HEADER_SIZE);
+			m_AckPending = true;
+		}
+		return false;
+	}
+
+	auto headerSize = SOCKET_CONNECTION_HEADER_SIZE + ((flags & 2) ? SOCKET_CONNECTION_TOKEN_SIZE : 0);
+	if (size < headerSize || !ReadEntries(data + headerSize, size - headerSize, false)) return false;
+	m_AttachToken = false;
+
+	auto sequence = ReadUInt16(data + 3);
+	RecordReceived(sequence);
+	m_AckPending = true;
+	m_LastReceiveTime = time;
+
+	//  Bit 0 of the flags says the peer has received something, and so that the ack fields mean something
+	if (flags & 1)
+	{
+		auto ack = ReadUInt16(data + 5);
+		auto ackBits = ReadUInt32(data + 7);
+		AcknowledgePacket(ack, time);
+		for (auto i = 0; i < 32; ++i)
+			if (ackBits & (1u << i)) AcknowledgePacket(uint16_t(ack - 1 - i), time);
+
+		//  Acknowledged messages at the front of each send window make room for the next ones
+		for (auto iter = m_Channels.begin(); iter != m_Channels.end(); ++iter)
+			while (iter->m_OldestUnackedID != iter->m_NextWindowID && !iter->m_SendWindow[iter->m_OldestUnackedID % SOCKET_CONNECTION_MESSAGE_WINDOW].m_Active)
+				++iter->m_OldestUnackedID;
+	}
+
+	ReadEntries(data + headerSize, size - headerSize, true);
+	return true;
+}
+
+inline bool SocketConnection::ReadEntries(const char* data, int size, bool apply)
+{
+	//  Checked in full before anything is applied, as everything in a packet is taken or none of it is
+	auto position = 0;
+	auto reservedSize = 0;
+	while (position < size)
+	{
+		if (size - position < SOCKET_CONNECTION_ENTRY_SIZE) return false;
+		auto channelByte = (unsigned char)(data[position]);
+		auto channel = int(channelByte & 0x7F);
+		auto fragmented = ((channelByte & 0x80) != 0);
+		auto messageID = ReadUInt16(data + position + 1);
+		auto fragmentIndex = 0;
+		auto fragmentCount = 1;
+		position += 3;
+
+		if (fragmented)
+		{
+			if (size - position < 6) return false;
+			fragmentIndex = ReadUInt16(data + position);
+			fragmentCount = ReadUInt16(data + position + 2);
+			position += 4;
+		}
+		auto entrySize = int(ReadUInt16(data + position));
+		position += 2;
+
+		if (channel >= int(m_Channels.size()) || entrySize <= 0 || entrySize > size - position) return false;
+		if (fragmentCount < 1 || fragmentCount > SOCKET_CONNECTION_MAX_FRAGMENTS || fragmentIndex >= fragmentCount) return false;
+		if (entrySize > SOCKET_CONNECTION_FRAGMENT_SIZE || (fragmentIndex < fragmentCount - 1 && entrySize != SOCKET_CONNECTION_FRAGMENT_SIZE)) return false;
+
+		if (apply) ReceiveFragment(channel, messageID, fragmentIndex, fragmentCount, data + position, entrySize);
+		else
+		{
+			//  Room for the reliable messages this packet would start, other than one an ordered channel is waiting on
+			auto& target = m_Channels[channel];
+			auto& message = target.m_ReceiveWindow[messageID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+			auto starting = (IsReliable(target.m_Type) && !IsLateFragment(target, messageID) && (!message.m_Active || message.m_MessageID != messageID));
+			auto waitedOn = (target.m_Type == SOCKET_CHANNEL_RELIABLE_ORDERED && messageID == target.m_NextDeliverID);
+			if (starting && !waitedOn)
+			{
+				reservedSize += GetReservedSize(fragmentCount);
+				if (m_ReservedSize + reservedSize > SOCKET_CONNECTION_MAX_REASSEMBLY_SIZE) return false;
+			}
+		}
+		position += entrySize;
+	}
+	return true;
+}
+
+inline bool SocketConnection::IsLateFragment(const Channel& channel, uint16_t messageID) const
+{
+	if (channel.m_Type == SOCKET_CHANNEL_RELIABLE_ORDERED)
+	{
+		//  Anything before the next message to deliver has been delivered already. The sender never gets a whole window ahead.
+		if (SequenceGreater(channel.m_NextDeliverID, messageID)) return true;
+		return (uint16_t(messageID - channel.m_NextDeliverID) >= SOCKET_CONNECTION_MESSAGE_WINDOW);
+	}
+
+	//  A late copy of a message whose slot has since been taken by a newer one
+	auto& message = channel.m_ReceiveWindow[messageID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+	return (message.m_Active && message.m_MessageID != messageID && SequenceGreater(message.m_MessageID, messageID));
+}
+
+inline void SocketConnection::ReceiveFragment(int channel, uint16_t messageID, int fragmentIndex, int fragmentCount, const char* data, int size)
+{
+	auto& target = m_Channels[channel];
+	auto& message = target.m_ReceiveWindow[messageID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+	if (IsLateFragment(target, messageID)) return;
+
+	if (!message.m_Active || message.m_MessageID != messageID)
+	{
+		//  The first fragment of this message to arrive. An unreliable message still in pieces here has been given up on, and a
+		//  new one that there isn't room for is dropped (reliable ones were checked for room before the packet was taken).
+		ReleaseMessage(message);
+		if (!IsReliable(target.m_Type) && m_ReservedSize + GetReservedSize(fragmentCount) > SOCKET_CONNECTION_MAX_REASSEMBLY_SIZE) return;
+
+		message.m_MessageID = messageID;
+		message.m_Active = true;
+		message.m_Delivered = false;
+		message.m_FragmentCount = fragmentCount;
+		message.m_ReceivedCount = 0;
+		message.m_ReservedSize = GetReservedSize(fragmentCount);
+		message.m_Fragments.resize(fragmentCount);
+		m_ReservedSize += message.m_ReservedSize;
+	}
+	if (message.m_Delivered || message.m_FragmentCount != fragmentCount || !message.m_Fragments[fragmentIndex].empty()) return;
+
+	message.m_Fragments[fragmentIndex].assign(data, data + size);
+	if (++message.m_ReceivedCount < message.m_FragmentCount) return;
+
+	if (target.m_Type != SOCKET_CHANNEL_RELIABLE_ORDERED)
+	{
+		//  Delivered straight away. The slot remembers the message, so copies of it that arrive later are recognised.
+		DeliverMessage(target, message);
+		return;
+	}
+
+	while (true)
+	{
+		auto& next = target.m_ReceiveWindow[target.m_NextDeliverID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+		if (!next.m_Active || next.m_MessageID != target.m_NextDeliverID || next.m_ReceivedCount < next.m_FragmentCount) break;
+		DeliverMessage(target, next);
+		next.m_Active = false;
+		++target.m_NextDeliverID;
+	}
+}
+
+inline void SocketConnection::DeliverMessage(Channel& channel, IncomingMessage& message)
+{
+	auto size = size_t(0);
+	for (auto iter = message.m_Fragments.begin(); iter != message.m_Fragments.end(); ++iter) size += iter->size();
+
+	channel.m_Delivered.emplace_back();
+	auto& delivered = channel.m_Delivered.back();
+	delivered.reserve(size);
+	for (auto iter = message.m_Fragments.begin(); iter != message.m_Fragments.end(); ++iter) delivered.insert(delivered.end(), iter->begin(), iter->end());
+
+	ReleaseMessage(message);
+	message.m_Active = true;
+	message.m_Delivered = true;
+}
+
+inline void SocketConnection::ReleaseMessage(IncomingMessage& message)
+{
+	//  Frees a message's fragments and gives back the room set aside for it, leaving its slot empty
+	m_ReservedSize -= message.m_ReservedSize;
+	message.m_ReservedSize = 0;
+	message.m_Fragments = std::vector<std::vector<char>>();
+	message.m_Active = false;
+}
+
+inline void SocketConnection::RecordReceived(uint16_t sequence)
+{
+	//  The ack bits are the 32 packets before the latest, most recent in the lowest bit
+	if (!m_ReceivedAny)
+	{
+		m_ReceivedAny = true;
+		m_RemoteSequence = sequence;
+		m_ReceivedBits = 0;
+		return;
+	}
+
+	if (SequenceGreater(sequence, m_RemoteSequence))
+	{
+		auto distance = int(uint16_t(sequence - m_RemoteSequence));
+		m_ReceivedBits = (distance < 32) ? (m_ReceivedBits << distance) : 0;
+		if (distance <= 32) m_ReceivedBits |= 1u << (distance - 1);
+		m_RemoteSequence = sequence;
+		return;
+	}
+
+	auto distance = int(uint16_t(m_RemoteSequence - sequence));
+	if (distance >= 1 && distance <= 32) m_ReceivedBits |= 1u << (distance - 1);
+}
+
+inline void SocketConnection::AcknowledgePacket(uint16_t sequence, double time)
+{
+	auto& packet = m_SentPackets[sequence % SOCKET_CONNECTION_PACKET_HISTORY];
+	if (!packet.m_Valid || packet.m_Sequence != sequence || packet.m_Acked) return;
+	packet.m_Acked = true;
+
+	//  Each packet has its own sequence number, even when it carries data sent before, so every ack is a true round trip sample.
+	//  The resend timeout follows the smoothed round trip time and its variation, as TCP's does.
+	auto sample = time - packet.m_SendTime;
+	if (m_RoundTripTime == 0.0)
+	{
+		m_RoundTripTime = sample;
+		m_RoundTripVariance = sample / 2.0;
+	}
+	else
+	{
+		m_RoundTripVariance = 0.75 * m_RoundTripVariance + 0.25 * std::abs(m_RoundTripTime - sample);
+		m_RoundTripTime = 0.875 * m_RoundTripTime + 0.125 * sample;
+	}
+	m_ResendTime = std::min<double>(std::max<double>(m_RoundTripTime + 4.0 * m_RoundTripVariance, SOCKET_CONNECTION_MIN_RESEND_TIME), SOCKET_CONNECTION_MAX_RESEND_TIME);
+
+	for (auto iter = packet.m_Fragments.begin(); iter != packet.m_Fragments.end(); ++iter)
+	{
+		auto& message = m_Channels[iter->m_Channel].m_SendWindow[iter->m_MessageID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+		if (!message.m_Active || message.m_MessageID != iter->m_MessageID || message.m_FragmentAcked[iter->m_FragmentIndex]) continue;
+		message.m_FragmentAcked[iter->m_FragmentIndex] = true;
+		if (--message.m_UnackedCount > 0) continue;
+
+		message.m_Active = false;
+		message.m_Data = std::vector<char>();
+	}
+	packet.m_Fragments.clear();
+}
+
+inline void SocketConnection::FillSendWindows()
+{
+	//  Queued reliable messages move into their channel's send window as it has room
+	for (auto iter = m_Channels.begin(); iter != m_Channels.end(); ++iter)
+	{
+		if (!IsReliable(iter->m_Type)) continue;
+		while (!iter->m_Pending.empty() && uint16_t(iter->m_NextWindowID - iter->m_OldestUnackedID) < SOCKET_CONNECTION_MESSAGE_WINDOW)
+		{
+			auto& message = iter->m_SendWindow[iter->m_NextWindowID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+			message = std::move(iter->m_Pending.front());
+			message.m_FragmentSendTimes.assign(message.m_FragmentCount, -1.0);
+			message.m_FragmentAcked.assign(message.m_FragmentCount, false);
+			iter->m_Pending.pop_front();
+			++iter->m_NextWindowID;
+		}
+	}
+}
+
+inline int SocketConnection::WritePackets(DatagramBatch& batch, double time)
+{
+	//  Adds every packet due now to the batch, and returns how many that was. If the batch fills up first, send it and call again.
+	FillSendWindows();
+	std::vector<ChannelCursor> cursors(m_Channels.size(), ChannelCursor{ 0, 0 });
+
+	auto packetCount = 0;
+	while (batch.GetCount() < batch.GetCapacity())
+	{
+		auto packetFull = false;
+		auto size = WritePacket(time, cursors, packetFull);
+		if (size == 0) break;
+
+		batch.AddDatagram(m_Address, m_PacketData.data(), size);
+		++packetCount;
+		if (!packetFull) break;
+	}
+	return packetCount;
+}
+
+inline int SocketConnection::WritePacket(double time, std::vector<ChannelCursor>& cursors, bool& packetFull)
+{
+	//  Returns the size of the packet written into m_PacketData, or 0 if nothing needs sending. Channels are packed in order, so
+	//  lower channels go first when there is more to send than fits.
+	auto& record = m_SentPackets[m_NextSequence % SOCKET_CONNECTION_PACKET_HISTORY];
+	record.m_Fragments.clear();
+	auto headerSize = SOCKET_CONNECTION_HEADER_SIZE + (m_AttachToken ? SOCKET_CONNECTION_TOKEN_SIZE : 0);
+	auto size = headerSize;
+
+	for (auto channelIndex = 0; channelIndex < int(m_Channels.size()) && !packetFull; ++channelIndex)
+	{
+		auto& channel = m_Channels[channelIndex];
+		auto& cursor = cursors[channelIndex];
+
+		if (!IsReliable(channel.m_Type))
+		{
+			//  Unreliable fragments are each written once, and the message forgotten after its last one
+			while (!channel.m_Pending.empty())
+			{
+				auto& message = channel.m_Pending.front();
+				if (!WriteEntry(size, channelIndex, message, message.m_NextFragment))
+				{
+					packetFull = true;
+					break;
+				}
+				if (++message.m_NextFragment == message.m_FragmentCount) channel.m_Pending.pop_front();
+			}
+			continue;
+		}
+
+		//  Reliable fragments are written if they have never been sent, or have gone unacknowledged past the resend timeout
+		auto windowCount = int(uint16_t(channel.m_NextWindowID - channel.m_OldestUnackedID));
+		for (; cursor.m_WindowOffset < windowCount && !packetFull; ++cursor.m_WindowOffset, cursor.m_Fragment = 0)
+		{
+			auto messageID = uint16_t(channel.m_OldestUnackedID + cursor.m_WindowOffset);
+			auto& message = channel.m_SendWindow[messageID % SOCKET_CONNECTION_MESSAGE_WINDOW];
+			if (!message.m_Active || message.m_MessageID != messageID) continue;
+
+			for (; cursor.m_Fragment < message.m_FragmentCount; ++cursor.m_Fragment)
+			{
+				auto fragment = cursor.m_Fragment;
+				if (message.m_FragmentAcked[fragment]) continue;
+				auto sendTime = message.m_FragmentSendTimes[fragment];
+				if (sendTime >= 0.0 && time - sendTime < m_ResendTime) continue;
+
+				if (!WriteEntry(size, channelIndex, message, fragment))
+				{
+					packetFull = true;
+					break;
+				}
+				message.m_FragmentSendTimes[fragment] = time;
+				record.m_Fragments.push_back(FragmentReference{ uint8_t(channelIndex), messageID, uint16_t(fragment) });
+			}
+			if (packetFull) break;
+		}
+	}
+
+	//  With nothing else to send, a packet still goes out to carry acks, or to keep the connection alive
+	if (size == headerSize && !m_AckPending && time - m_LastSendTime < SOCKET_CONNECTION_KEEPALIVE_TIME) return 0;
+
+	auto packet = m_PacketData.data();
+	WriteUInt16(packet, SOCKET_CONNECTION_PROTOCOL_ID);
+	packet[2] = char((m_ReceivedAny ? 1 : 0) | (m_AttachToken ? 2 : 0));
+	WriteUInt16(packet + 3, m_NextSequence);
+	WriteUInt16(packet + 5, m_RemoteSequence);
+	WriteUInt32(packet + 7, m_ReceivedBits);
+	if (m_AttachToken) WriteUInt64(packet + SOCKET_CONNECTION_HEADER_SIZE, m_Token);
+
+	record.m_Sequence = m_NextSequence;
+	record.m_Valid = true;
+	record.m_Acked = false;
+	record.m_SendTime = time;
+	++m_NextSequence;
+	m_AckPending = false;
+	m_LastSendTime = time;
+	return size;
+}
+
+inline bool SocketConnection::WriteEntry(int& size, int channel, const OutgoingMessage& message, int fragmentIndex)
+{
+	//  Returns false, writing nothing, if the entry doesn't fit in what is left of the packet
+	auto fragmented = (message.m_FragmentCount > 1);
+	auto offset = fragmentIndex * SOCKET_CONNECTION_FRAGMENT_SIZE;
+	auto dataSize = std::min<int>(SOCKET_CONNECTION_FRAGMENT_SIZE, int(message.m_Data.size()) - offset);
+	auto entrySize = (fragmented ? SOCKET_CONNECTION_FRAGMENT_ENTRY_SIZE : SOCKET_CONNECTION_ENTRY_SIZE) + dataSize;
+	if (size + entrySize > DATAGRAM_MAX_SIZE) return false;
+
+	auto out = m_PacketData.data() + size;
+	*out++ = char(fragmented ? (channel | 0x80) : channel);
+	WriteUInt16(out, message.m_MessageID);
+	out += 2;
+	if (fragmented)
+	{
+		WriteUInt16(out, uint16_t(fragmentIndex));
+		WriteUInt16(out + 2, uint16_t(message.m_FragmentCount));
+		out += 4;
+	}
+	WriteUInt16(out, uint16_t(dataSize));
+	memcpy(out + 2, message.m_Data.data() + offset, dataSize);
+	size += entrySize;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "SocketBuffer.h"
+#include "SocketSIMD.h"
+
+#include <cstdint>
+#include <cstring>
+
+//  Any unchanged stretch shorter than this is sent inside the changed data around it, as it would cost more to describe it
+#define SOCKET_DELTA_MIN_UNCHANGED_RUN	4
+
+//  The largest snapshot a delta is decoded into unless the caller allows more, as the size comes from the peer
+#define SOCKET_DELTA_DEFAULT_MAX_SNAPSHOT_SIZE	(1024 * 1024 * 16) // 16MB
+
+//  Delta compression of a state snapshot against an earlier one the peer is known to hold (its baseline). The delta is:
+//
+//      varint baseline size, varint snapshot size, then until the snapshot is covered:
+//      varint unchanged byte count, varint changed byte count, the changed bytes XORed with the baseline
+//
+//  A baseline is treated as followed by zeros where the snapshot is longer, and can be left out entirely (nullptr) to send a
+//  snapshot with no baseline. The decoder refuses a delta made against a baseline of a different size, which catches most
+//  mix-ups of which baseline was acknowledged.
+class SocketDelta
+{
+public:
+	static int Encode(const SocketBuffer* baseline, const SocketBuffer* snapshot, SocketBuffer* delta);
+	static bool Decode(const SocketBuffer* baseline, SocketBuffer* delta, SocketBuffer* snapshot, int maximumSnapshotSize = SOCKET_DELTA_DEFAULT_MAX_SNAPSHOT_SIZE);
+
+private:
+	static int FindDifference(const unsigned char* snapshot, const unsigned char* baseline, int baselineSize, int start, int end);
+	static int FindUnchangedRun(const unsigned char* snapshot, const unsigned char* baseline, int baselineSize, int start, int end);
+	static void WriteVarUInt(SocketBuffer* buffer, unsigned int value);
+	static bool ReadVarUInt(SocketBuffer* buffer, unsigned int& value);
+};
+
+inline int SocketDelta::Encode(const SocketBuffer* baseline, const SocketBuffer* snapshot, SocketBuffer* delta)
+{
+	//  Appends the delta at the write position of the delta buffer, and returns the number of bytes it took
+	auto baselineData = (baseline != nullptr) ? reinterpret_cast<const unsigned char*>(baseline->m_BufferData) : nullptr;
+	auto baselineSize = (baseline != nullptr) ? baseline->m_BufferUtilizedCount : 0;
+	auto snapshotData = reinterpret_cast<const unsigned char*>(snapshot->m_BufferData);
+	auto snapshotSize = snapshot->m_BufferUtilizedCount;
+	auto startPosition = delta->m_WritePosition;
+
+	WriteVarUInt(delta, (unsigned int)(baselineSize));
+	WriteVarUInt(delta, (unsigned int)(snapshotSize));
+
+	auto position = 0;
+	while (position < snapshotSize)
+	{
+		auto changedStart = FindDifference(snapshotData, baselineData, baselineSize, position, snapshotSize);
+		auto changedEnd = FindUnchangedRun(snapshotData, baselineData, baselineSize, changedStart, snapshotSize);
+		auto changedCount = changedEnd - changedStart;
+
+		WriteVarUInt(delta, (unsigned int)(changedStart - position));
+		WriteVarUInt(delta, (unsigned int)(changedCount));
+		if (changedCount > 0)
+		{
+			delta->reserve_append(changedCount);
+			auto out = reinterpret_cast<unsigned char*>(delta->m_BufferData + delta->m_WritePosition);
+			for (auto i = 0; i < changedCount; ++i)
+			{
+				auto index = changedStart + i;
+				out[i] = snapshotData[index] ^ ((index < baselineSize) ? baselineData[index] : 0);
+			}
+			delta->m_WritePosition += changedCount;
+			if (delta->m_WritePosition > delta->m_BufferUtilizedCount) delta->m_BufferUtilizedCount = delta->m_WritePosition;
+		}
+		position = changedEnd;
+	}
+
+	return delta->m_WritePosition - startPosition;
+}
+
+inline bool SocketDelta::Decode(const SocketBuffer* baseline, SocketBuffer* delta, SocketBuffer* snapshot, int maximumSnapshotSize)
+{
+	//  Reads the delta from the read position of the delta buffer, and replaces the contents of the snapshot buffer. Snapshots
+	//  larger than the maximum are refused, and the snapshot buffer only grows as each run of the delta is found to be valid.
+	auto baselineData = (baseline != nullptr) ? reinterpret_cast<const unsigned char*>(baseline->m_BufferData) : nullptr;
+	auto baselineSize = (baseline != nullptr) ? baseline->m_BufferUtilizedCount : 0;
+
+	unsigned int expectedBaselineSize;
+	unsigned int snapshotSize;
+	if (!ReadVarUInt(delta, expectedBaselineSize) || !ReadVarUInt(delta, snapshotSize)) return false;
+	if (int(expectedBaselineSize) != baselineSize || snapshotSize > (unsigned int)(std::max<int>(maximumSnapshotSize, 0))) return false;
+
+	snapshot->clear();
+
+	auto position = 0;
+	while (position < int(snapshotSize))
+	{
+		unsigned int unchangedCount;
+		unsigned int changedCount;
+		if (!ReadVarUInt(delta, unchangedCount) || !ReadVarUInt(delta, changedCount)) return false;
+		if (unchangedCount > snapshotSize - (unsigned int)(position)) return false;
+		if (changedCount > snapshotSize - (unsigned int)(position) - unchangedCount) return false;
+		if (delta->bytesleft() < int(changedCount)) return false;
+
+		//  What has been decoded so far is marked as used, so growing the buffer keeps it
+		auto runEnd = position + int(unchangedCount) + int(changedCount);
+		snapshot->m_BufferUtilizedCount = position;
+		if (runEnd > snapshot->capacity()) snapshot->reserve(int(std::min<long long>(snapshotSize, std::max<long long>(runEnd, snapshot->capacity() * 2LL))));
+		auto out = reinterpret_cast<unsigned char*>(snapshot->m_BufferData);
+
+		//  Unchanged bytes come straight from the baseline (or are zero past its end)
+		auto copyCount = std::max<int>(0, std::min<int>(int(unchangedCount), baselineSize - position));
+		if (copyCount > 0) memcpy(out + position, baselineData + position, copyCount);
+		if (copyCount < int(unchangedCount)) memset(out + position + copyCount, 0, unchangedCount - copyCount);
+		position += int(unchangedCount);
+
+		auto changed = reinterpret_cast<const unsigned char*>(delta->m_BufferData + delta->m_ReadPosition);
+		for (auto i = 0; i < int(changedCount); ++i, ++position)
+			out[position] = changed[i] ^ ((position < baselineSize) ? baselineData[position] : 0);
+		delta->m_ReadPosition += int(changedCount);
+	}
+
+	snapshot->m_BufferUtilizedCount = int(snapshotSize);
+	snapshot->m_WritePosition = int(snapshotSize);
+	return true;
+}
+
+inline int SocketDelta::FindDifference(const unsigned char* snapshot, const unsigned char* baseline, int baselineSize, int start, int end)
+{
+	//  Finds the first byte at or after start that differs from the baseline, or end if there isn't one. Most of a snapshot is
+	//  usually unchanged, so this compares whole vectors (or words) at a time and only looks at single bytes near a difference.
+	auto index = start;
+	auto compareEnd = std::min<int>(end, baselineSize);
+
+#if SOCKET_SIMD_SSE2
+	for (; index + 16 <= compareEnd; index += 16)
+	{
+		auto snapshotBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(snapshot + index));
+		auto baselineBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(baseline + index));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(snapshotBlock, baselineBlock)) != 0xFFFF) break;
+	}
+#endif
+	for (; index + 8 <= compareEnd; index += 8)
+	{
+		uint64_t snapshotWord;
+		uint64_t baselineWord;
+		memcpy(&snapshotWord, snapshot + index, 8);
+		memcpy(&baselineWord, baseline + index, 8);
+		if (snapshotWord != baselineWord) break;
+	}
+	for (; index < compareEnd; ++index)
+		if (snapshot[index] != baseline[index]) return index;
+
+	//  Past the end of the baseline, a byte is unchanged if it is zero
+	for (; index < end; ++index)
+		if (snapshot[index] != 0) return index;
+	return end;
+}
+
+inline int SocketDelta::FindUnchangedRun(const unsigned char* snapshot, const unsigned char* baseline, int baselineSize, int start, int end)
+{
+	//  Finds where the next stretch of at least SOCKET_DELTA_MIN_UNCHANGED_RUN unchanged bytes begins, or end if there isn't one
+	auto runLength = 0;
+	for (auto index = start; index < end; ++index)
+	{
+		auto baselineByte = (index < baselineSize) ? baseline[index] : 0;
+		if (snapshot[index] != baselineByte)
+		{
+			runLength = 0;
+			continue;
+		}
+		if (++runLength == SOCKET_DELTA_MIN_UNCHANGED_RUN) return index + 1 - SOCKET_DELTA_MIN_UNCHANGED_RUN;
+	}
+	return end - runLength;
+}
+
+inline void SocketDelta::WriteVarUInt(SocketBuffer* buffer, unsigned int value)
+{
+	unsigned char bytes[5];
+	auto byteCount = 0;
+	do
+	{
+		auto group = (unsigned char)(value & 0x7F);
+		value >>= 7;
+		bytes[byteCount++] = (value != 0) ? (group | 0x80) : group;
+	} while (value != 0);
+	buffer->StreamWrite(bytes, byteCount);
+}
+
+inline bool SocketDelta::ReadVarUInt(SocketBuffer* buffer, unsigned int& value)
+{
+	value = 0;
+	for (auto shift = 0; shift < 35; shift += 7)
+	{
+		if (buffer->bytesleft() <= 0) return false;
+		auto group = (unsigned char)(buffer->m_BufferData[buffer->m_ReadPosition++]);
+		value |= (unsigned int)(group & 0x7F) << shift;
+		if ((group & 0x80) == 0) return true;
+	}
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "SocketPlatform.h"
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//  A read-only view of part of a file, mapped into memory so its bytes can be read (or sent) without copying them. The mapping
+//  has to start on an allocation boundary, so a little more than asked for may be mapped, starting just before the offset.
+//  The view owns its mapping and unmaps it when released or destroyed. The file itself can be closed while a view is mapped.
+class SocketFileView
+{
+public:
+#if defined(_WIN32)
+	typedef HANDLE NativeFile;
+#else
+	typedef int NativeFile;
+#endif
+
+	SocketFileView() : m_MappingBase(nullptr), m_MappingSize(0), m_Data(nullptr), m_Size(0) {}
+	~SocketFileView() { Unmap(); }
+
+	SocketFileView(const SocketFileView&) = delete;
+	SocketFileView& operator=(const SocketFileView&) = delete;
+
+	int Map(NativeFile file, long long offset, int size);
+	void Unmap();
+
+	bool IsMapped() const { return (m_Data != nullptr); }
+	const char* GetData() const { return m_Data; }
+	int GetSize() const { return m_Size; }
+
+private:
+	void* m_MappingBase;
+	size_t m_MappingSize;
+	const char* m_Data;
+	int m_Size;
+};
+
+inline int SocketFileView::Map(NativeFile file, long long offset, int size)
+{
+	//  Maps up to size bytes from offset, stopping at the end of the file. Returns the number of bytes in view, or -1 if the
+	//  offset isn't inside the file or the mapping fails.
+	Unmap();
+	if (offset < 0 || size <= 0) return -1;
+
+#if defined(_WIN32)
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || offset >= fileSize.QuadPart) return -1;
+	auto viewSize = int(std::min<long long>(size, fileSize.QuadPart - offset));
+
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	auto mappingOffset = offset - (offset % (long long)(systemInfo.dwAllocationGranularity));
+	auto mappingSize = size_t(offset - mappingOffset) + size_t(viewSize);
+
+	//  The view keeps the mapping object alive, so its handle can be closed straight away
+	auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) return -1;
+	auto mappingBase = MapViewOfFile(mapping, FILE_MAP_READ, DWORD(mappingOffset >> 32), DWORD(mappingOffset & 0xFFFFFFFF), mappingSize);
+	CloseHandle(mapping);
+	if (mappingBase == nullptr) return -1;
+#else
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) != 0 || offset >= (long long)(fileStatus.st_size)) return -1;
+	auto viewSize = int(std::min<long long>(size, (long long)(fileStatus.st_size) - offset));
+
+	auto pageSize = (long long)(sysconf(_SC_PAGESIZE));
+	auto mappingOffset = offset - (offset % pageSize);
+	auto mappingSize = size_t(offset - mappingOffset) + size_t(viewSize);
+
+	auto mappingBase = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, file, off_t(mappingOffset));
+	if (mappingBase == MAP_FAILED) return -1;
+
+	//  Recorded sessions are read front to back, so ask for aggressive read-ahead
+	madvise(mappingBase, mappingSize, MADV_SEQUENTIAL);
+#endif
+
+	m_MappingBase = mappingBase;
+	m_MappingSize = mappingSize;
+	m_Data = static_cast<const char*>(mappingBase) + (offset - mappingOffset);
+	m_Size = viewSize;
+	return viewSize;
+}
+
+inline void SocketFileView::Unmap()
+{
+	if (m_MappingBase == nullptr) return;
+#if defined(_WIN32)
+	UnmapViewOfFile(m_MappingBase);
+#else
+	munmap(m_MappingBase, m_MappingSize);
+#endif
+	m_MappingBase = nullptr;
+	m_MappingSize = 0;
+	m_Data = nullptr;
+	m_Size = 0;
+}
\ No newline at end of file
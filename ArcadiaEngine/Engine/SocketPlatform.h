@@ -0,0 +1,99 @@
+#pragma once
+
+//  Maps the handful of Winsock names used by Socket and WinsockWrapper onto their BSD socket equivalents, so the same code
+//  builds against Winsock on Windows and against POSIX sockets (with an epoll-backed SocketPoller on Linux) everywhere else.
+#if defined(_WIN32)
+
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+#define SOCKET_SEND_FLAGS	0
+
+typedef WSABUF SocketIOBuffer;
+inline void SetSocketIOBuffer(SocketIOBuffer& ioBuffer, const char* data, int size) { ioBuffer.buf = const_cast<CHAR*>(data); ioBuffer.len = ULONG(size); }
+inline int GetSocketIOBufferSize(const SocketIOBuffer& ioBuffer) { return int(ioBuffer.len); }
+inline const char* GetSocketIOBufferData(const SocketIOBuffer& ioBuffer) { return ioBuffer.buf; }
+
+//  Scatter/gather calls: one system call for any number of separate regions of memory
+inline int SendSocketIOBuffers(SOCKET socketID, SocketIOBuffer* ioBuffers, int ioBufferCount)
+{
+	DWORD sentCount = 0;
+	if (WSASend(socketID, ioBuffers, DWORD(ioBufferCount), &sentCount, 0, nullptr, nullptr) == SOCKET_ERROR) return SOCKET_ERROR;
+	return int(sentCount);
+}
+
+inline int ReceiveSocketIOBuffers(SOCKET socketID, SocketIOBuffer* ioBuffers, int ioBufferCount)
+{
+	DWORD receivedCount = 0;
+	DWORD flags = 0;
+	if (WSARecv(socketID, ioBuffers, DWORD(ioBufferCount), &receivedCount, &flags, nullptr, nullptr) == SOCKET_ERROR) return SOCKET_ERROR;
+	return int(receivedCount);
+}
+
+#else
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+typedef struct sockaddr SOCKADDR;
+typedef struct sockaddr* LPSOCKADDR;
+typedef struct sockaddr_in SOCKADDR_IN;
+typedef unsigned long u_long;
+
+#define INVALID_SOCKET		(-1)
+#define SOCKET_ERROR		(-1)
+#define WSAEWOULDBLOCK		EWOULDBLOCK
+#define WSAECONNRESET		ECONNRESET
+#define WSAEMSGSIZE			EMSGSIZE
+
+//  Writing to a socket the peer has closed must report an error, rather than raise SIGPIPE and end the process
+#define SOCKET_SEND_FLAGS	MSG_NOSIGNAL
+
+inline int WSAGetLastError() { return errno; }
+inline void WSASetLastError(int error) { errno = error; }
+inline int closesocket(SOCKET socketID) { return close(socketID); }
+inline int ioctlsocket(SOCKET socketID, long command, u_long* argument) { int value = int(*argument); auto result = ioctl(socketID, command, &value); *argument = u_long(value); return result; }
+
+typedef struct iovec SocketIOBuffer;
+inline void SetSocketIOBuffer(SocketIOBuffer& ioBuffer, const char* data, int size) { ioBuffer.iov_base = const_cast<char*>(data); ioBuffer.iov_len = size_t(size); }
+inline int GetSocketIOBufferSize(const SocketIOBuffer& ioBuffer) { return int(ioBuffer.iov_len); }
+inline const char* GetSocketIOBufferData(const SocketIOBuffer& ioBuffer) { return static_cast<const char*>(ioBuffer.iov_base); }
+
+//  Scatter/gather calls: one system call for any number of separate regions of memory. Sends go through sendmsg rather than
+//  writev so they can carry SOCKET_SEND_FLAGS.
+inline int SendSocketIOBuffers(SOCKET socketID, SocketIOBuffer* ioBuffers, int ioBufferCount)
+{
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = ioBuffers;
+	message.msg_iovlen = size_t(ioBufferCount);
+	return int(sendmsg(socketID, &message, SOCKET_SEND_FLAGS));
+}
+
+inline int ReceiveSocketIOBuffers(SOCKET socketID, SocketIOBuffer* ioBuffers, int ioBufferCount)
+{
+	return int(readv(socketID, ioBuffers, ioBufferCount));
+}
+
+#endif
+
+//  The most regions handed to a single scatter/gather call (POSIX guarantees at least 1024)
+#define SOCKET_IO_BUFFER_MAX_COUNT	512
+
+//  Linux can receive or send many datagrams in one system call (recvmmsg / sendmmsg). Elsewhere a batch is one call per datagram.
+#if defined(__linux__)
+#define SOCKET_BATCHED_DATAGRAMS	true
+#else
+#define SOCKET_BATCHED_DATAGRAMS	false
+#endif
\ No newline at end of file
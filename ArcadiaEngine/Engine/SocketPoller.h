@@ -0,0 +1,205 @@
+#pragma once
+
+#include "SocketPlatform.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//  Linux gets a kernel readiness queue (epoll), so a poll costs the same whether one socket or thousands are being watched.
+//  Other platforms fall back to a single poll() / WSAPoll() call across every watched socket.
+#if defined(__linux__)
+#define SOCKET_POLLER_USE_EPOLL true
+#include <sys/epoll.h>
+#else
+#define SOCKET_POLLER_USE_EPOLL false
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
+#endif
+
+#define SOCKET_POLLER_MAX_EVENTS 256
+
+//  Watches a set of sockets for incoming data (or an incoming connection, for a listening socket) and reports which are ready.
+//  Each socket is watched under the ID its owner uses for it, and those IDs are what a poll hands back. Readiness is level
+//  triggered, so a socket that still has unread data is reported again by the next poll.
+class SocketPoller
+{
+public:
+	SocketPoller();
+	~SocketPoller();
+
+	SocketPoller(const SocketPoller&) = delete;
+	SocketPoller& operator=(const SocketPoller&) = delete;
+
+	bool AddSocket(SOCKET socketHandle, int socketID);
+	bool RemoveSocket(SOCKET socketHandle);
+	int Poll(int timeoutMS, std::vector<int>& readySocketIDs);
+	void Shutdown();
+
+	inline int GetWatchedCount() const { return m_WatchedCount; }
+
+private:
+	int m_WatchedCount;
+
+#if SOCKET_POLLER_USE_EPOLL
+	bool Initialize();
+
+	int m_EpollHandle;
+	epoll_event m_Events[SOCKET_POLLER_MAX_EVENTS];
+#else
+#if defined(_WIN32)
+	typedef WSAPOLLFD PollDescriptor;
+#else
+	typedef pollfd PollDescriptor;
+#endif
+	std::vector<PollDescriptor> m_PollList;
+	std::vector<int> m_PollSocketIDs;
+#endif
+};
+
+#if SOCKET_POLLER_USE_EPOLL
+inline bool SocketPoller::Initialize()
+{
+	if (m_EpollHandle >= 0) return true;
+
+	m_EpollHandle = epoll_create1(EPOLL_CLOEXEC);
+	if (m_EpollHandle < 0)
+	{
+		printf("SocketPoller failed to create an epoll instance (error %d)\n", errno);
+		return false;
+	}
+	return true;
+}
+
+inline bool SocketPoller::AddSocket(SOCKET socketHandle, int socketID)
+{
+	if (socketHandle == INVALID_SOCKET || !Initialize()) return false;
+
+	epoll_event watchEvent;
+	memset(&watchEvent, 0, sizeof(watchEvent));
+	watchEvent.events = EPOLLIN | EPOLLRDHUP;
+	watchEvent.data.u32 = (uint32_t)(socketID);
+	if (epoll_ctl(m_EpollHandle, EPOLL_CTL_ADD, socketHandle, &watchEvent) != 0)
+	{
+		//  A socket being re-added under a new ID just has its ID updated
+		if (errno != EEXIST || epoll_ctl(m_EpollHandle, EPOLL_CTL_MOD, socketHandle, &watchEvent) != 0) return false;
+		return true;
+	}
+
+	++m_WatchedCount;
+	return true;
+}
+
+inline bool SocketPoller::RemoveSocket(SOCKET socketHandle)
+{
+	if (m_EpollHandle < 0 || socketHandle == INVALID_SOCKET) return false;
+
+	epoll_event unusedEvent;
+	if (epoll_ctl(m_EpollHandle, EPOLL_CTL_DEL, socketHandle, &unusedEvent) != 0) return false;
+	--m_WatchedCount;
+	return true;
+}
+
+inline int SocketPoller::Poll(int timeoutMS, std::vector<int>& readySocketIDs)
+{
+	readySocketIDs.clear();
+	if (m_EpollHandle < 0) return 0;
+
+	int eventCount;
+	do { eventCount = epoll_wait(m_EpollHandle, m_Events, SOCKET_POLLER_MAX_EVENTS, timeoutMS); } while (eventCount < 0 && errno == EINTR);
+	if (eventCount < 0) return -1;
+
+	//  Errors and hang-ups are reported as ready too, so the owner's next receive sees them
+	for (auto i = 0; i < eventCount; ++i) readySocketIDs.push_back(int(m_Events[i].data.u32));
+	return eventCount;
+}
+
+inline void SocketPoller::Shutdown()
+{
+	if (m_EpollHandle >= 0) close(m_EpollHandle);
+	m_EpollHandle = -1;
+	m_WatchedCount = 0;
+}
+
+inline SocketPoller::SocketPoller() :
+	m_WatchedCount(0),
+	m_EpollHandle(-1)
+{
+
+}
+#else
+inline bool SocketPoller::AddSocket(SOCKET socketHandle, int socketID)
+{
+	if (socketHandle == INVALID_SOCKET) return false;
+
+	for (auto i = 0; i < int(m_PollList.size()); ++i)
+	{
+		if (m_PollList[i].fd != socketHandle) continue;
+		m_PollSocketIDs[i] = socketID;
+		return true;
+	}
+
+	PollDescriptor descriptor;
+	memset(&descriptor, 0, sizeof(descriptor));
+	descriptor.fd = socketHandle;
+	descriptor.events = POLLIN;
+	m_PollList.push_back(descriptor);
+	m_PollSocketIDs.push_back(socketID);
+	++m_WatchedCount;
+	return true;
+}
+
+inline bool SocketPoller::RemoveSocket(SOCKET socketHandle)
+{
+	for (auto i = 0; i < int(m_PollList.size()); ++i)
+	{
+		if (m_PollList[i].fd != socketHandle) continue;
+
+		//  Order doesn't matter, so swap the last entry into the removed slot
+		m_PollList[i] = m_PollList.back();
+		m_PollSocketIDs[i] = m_PollSocketIDs.back();
+		m_PollList.pop_back();
+		m_PollSocketIDs.pop_back();
+		--m_WatchedCount;
+		return true;
+	}
+	return false;
+}
+
+inline int SocketPoller::Poll(int timeoutMS, std::vector<int>& readySocketIDs)
+{
+	readySocketIDs.clear();
+	if (m_PollList.empty()) return 0;
+
+#if defined(_WIN32)
+	auto readyCount = WSAPoll(m_PollList.data(), ULONG(m_PollList.size()), timeoutMS);
+#else
+	auto readyCount = poll(m_PollList.data(), nfds_t(m_PollList.size()), timeoutMS);
+#endif
+	if (readyCount <= 0) return readyCount;
+
+	for (auto i = 0; i < int(m_PollList.size()); ++i)
+		if (m_PollList[i].revents != 0) readySocketIDs.push_back(m_PollSocketIDs[i]);
+	return int(readySocketIDs.size());
+}
+
+inline void SocketPoller::Shutdown()
+{
+	m_PollList.clear();
+	m_PollSocketIDs.clear();
+	m_WatchedCount = 0;
+}
+
+inline SocketPoller::SocketPoller() :
+	m_WatchedCount(0)
+{
+
+}
+#endif
+
+inline SocketPoller::~SocketPoller()
+{
+	Shutdown();
+}
\ No newline at end of file
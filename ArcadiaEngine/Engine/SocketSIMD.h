@@ -0,0 +1,47 @@
+#pragma once
+
+//  Which vector instruction sets the networking helpers may use, decided at compile time from what the compiler is targeting.
+//  MSVC only announces AVX and up (with /arch), and SSE2 is always there on x64.
+#if defined(__AVX2__)
+#define SOCKET_SIMD_AVX2	true
+#else
+#define SOCKET_SIMD_AVX2	false
+#endif
+
+#if defined(__SSE4_2__) || defined(__AVX__)
+#define SOCKET_SIMD_SSE42	true
+#else
+#define SOCKET_SIMD_SSE42	false
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define SOCKET_SIMD_SSSE3	true
+#else
+#define SOCKET_SIMD_SSSE3	false
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOCKET_SIMD_SSE2	true
+#else
+#define SOCKET_SIMD_SSE2	false
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SOCKET_SIMD_NEON	true
+#else
+#define SOCKET_SIMD_NEON	false
+#endif
+
+#if SOCKET_SIMD_AVX2 || SOCKET_SIMD_SSE42 || SOCKET_SIMD_SSSE3 || SOCKET_SIMD_SSE2
+#include <immintrin.h>
+#endif
+#if SOCKET_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+//  Hosts are little endian unless the compiler says otherwise (MSVC only targets little endian machines)
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define SOCKET_HOST_BIG_ENDIAN	true
+#else
+#define SOCKET_HOST_BIG_ENDIAN	false
+#endif
\ No newline at end of file
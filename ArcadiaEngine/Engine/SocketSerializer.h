@@ -0,0 +1,129 @@
+#pragma once
+
+#include "SocketBuffer.h"
+
+#include <cstring>
+#include <type_traits>
+
+//  Compile-time serialization of structs into a SocketBuffer. A struct's fields are listed once, at namespace scope:
+//
+//      SOCKET_SERIALIZABLE(PlayerState, &PlayerState::m_ID, &PlayerState::m_Position, &PlayerState::m_Health);
+//
+//  after which SocketSerializer::Write / Read move the whole struct (or an array of them) with one size check and one reserve,
+//  each field landing at an offset known at compile time. Fields are written in the listed order with no padding between them,
+//  in the same byte order as writeint and the other scalar writes. A field may be any trivially copyable value (numbers, enums,
+//  fixed arrays of those), another serializable struct, or a fixed array of serializable structs. Pointers can't be serialized.
+
+//  Specialized by SOCKET_SERIALIZABLE to hold a struct's field list
+template <typename Type> struct SocketSerialization;
+
+template <typename Type, typename = void> struct IsSocketSerializable : std::false_type {};
+template <typename Type> struct IsSocketSerializable<Type, std::void_t<typename SocketSerialization<Type>::Fields>> : std::true_type {};
+
+#define SOCKET_SERIALIZABLE(Type, ...) template <> struct SocketSerialization<Type> { typedef SocketFieldList<__VA_ARGS__> Fields; }
+
+//  How a single field is written and read. Plain values are copied as they are, and serializable structs go through their own fields.
+template <typename FieldType, typename = void>
+struct SocketFieldCodec
+{
+	static_assert(std::is_trivially_copyable<FieldType>::value && !std::is_pointer<FieldType>::value, "Socket serialized fields must be trivially copyable values, or structs declared with SOCKET_SERIALIZABLE");
+
+	static constexpr int Size = int(sizeof(FieldType));
+	static void Write(char* out, const FieldType& value) { memcpy(out, &value, sizeof(FieldType)); }
+	static void Read(const char* in, FieldType& value) { memcpy(&value, in, sizeof(FieldType)); }
+};
+
+template <typename FieldType>
+struct SocketFieldCodec<FieldType, std::enable_if_t<IsSocketSerializable<FieldType>::value>>
+{
+	typedef typename SocketSerialization<FieldType>::Fields Fields;
+
+	static constexpr int Size = Fields::Size;
+	static void Write(char* out, const FieldType& value) { Fields::Write(out, value); }
+	static void Read(const char* in, FieldType& value) { Fields::Read(in, value); }
+};
+
+template <typename ElementType, size_t Count>
+struct SocketFieldCodec<ElementType[Count], std::enable_if_t<IsSocketSerializable<ElementType>::value>>
+{
+	typedef SocketFieldCodec<ElementType> ElementCodec;
+
+	static constexpr int Size = ElementCodec::Size * int(Count);
+	static void Write(char* out, const ElementType (&value)[Count]) { for (size_t i = 0; i < Count; ++i) ElementCodec::Write(out + i * ElementCodec::Size, value[i]); }
+	static void Read(const char* in, ElementType (&value)[Count]) { for (size_t i = 0; i < Count; ++i) ElementCodec::Read(in + i * ElementCodec::Size, value[i]); }
+};
+
+//  The type a pointer-to-member refers to
+template <typename MemberPointer> struct SocketMemberTypeOf;
+template <typename Owner, typename FieldType> struct SocketMemberTypeOf<FieldType Owner::*> { typedef FieldType Type; };
+template <auto Member> using SocketMemberType = typename SocketMemberTypeOf<decltype(Member)>::Type;
+
+template <auto... Members>
+struct SocketFieldList
+{
+	static constexpr int Size = (0 + ... + SocketFieldCodec<SocketMemberType<Members>>::Size);
+
+	//  Every size is a constant, so each field's offset folds down to a constant as well
+	template <typename Owner>
+	static void Write(char* out, const Owner& value)
+	{
+		auto offset = 0;
+		((SocketFieldCodec<SocketMemberType<Members>>::Write(out + offset, value.*Members), offset += SocketFieldCodec<SocketMemberType<Members>>::Size), ...);
+	}
+
+	template <typename Owner>
+	static void Read(const char* in, Owner& value)
+	{
+		auto offset = 0;
+		((SocketFieldCodec<SocketMemberType<Members>>::Read(in + offset, value.*Members), offset += SocketFieldCodec<SocketMemberType<Members>>::Size), ...);
+	}
+};
+
+class SocketSerializer
+{
+public:
+	//  The number of bytes one value of the type takes in a buffer
+	template <typename Type>
+	static constexpr int GetSize()
+	{
+		static_assert(IsSocketSerializable<Type>::value, "Type must be declared with SOCKET_SERIALIZABLE");
+		return SocketFieldCodec<Type>::Size;
+	}
+
+	template <typename Type> static int Write(SocketBuffer* buffer, const Type* values, int count = 1);
+	template <typename Type> static int Read(SocketBuffer* buffer, Type* values, int count = 1, bool peek = false);
+};
+
+template <typename Type>
+inline int SocketSerializer::Write(SocketBuffer* buffer, const Type* values, int count)
+{
+	//  Writes at the buffer's write position, like StreamWrite. Returns the number of bytes written.
+	constexpr auto valueSize = GetSize<Type>();
+	if (count <= 0) return 0;
+
+	auto size = valueSize * count;
+	buffer->reserve_append(size);
+	auto out = buffer->m_BufferData + buffer->m_WritePosition;
+	for (auto i = 0; i < count; ++i) SocketFieldCodec<Type>::Write(out + i * valueSize, values[i]);
+
+	buffer->m_WritePosition += size;
+	if (buffer->m_WritePosition > buffer->m_BufferUtilizedCount) buffer->m_BufferUtilizedCount = buffer->m_WritePosition;
+	return size;
+}
+
+template <typename Type>
+inline int SocketSerializer::Read(SocketBuffer* buffer, Type* values, int count, bool peek)
+{
+	//  Reads nothing (and returns 0) unless all of the values are in the buffer. Returns the number of bytes read.
+	constexpr auto valueSize = GetSize<Type>();
+	if (count <= 0) return 0;
+
+	auto size = valueSize * count;
+	if (buffer->bytesleft() < size) return 0;
+
+	auto in = buffer->m_BufferData + buffer->m_ReadPosition;
+	for (auto i = 0; i < count; ++i) SocketFieldCodec<Type>::Read(in + i * valueSize, values[i]);
+
+	if (!peek) buffer->m_ReadPosition += size;
+	return size;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+
+//  A handle is a slot index in its low bits and that slot's generation above it, keeping handles positive so -1 stays free
+//  to mean failure. A freshly made table hands out 0, 1, 2 ... just as a plain list would.
+#define SOCKET_SLOT_INDEX_BITS		20
+#define SOCKET_SLOT_GENERATION_BITS	11
+#define SOCKET_SLOT_INDEX_MASK		((1 << SOCKET_SLOT_INDEX_BITS) - 1)
+#define SOCKET_SLOT_GENERATION_MASK	((1 << SOCKET_SLOT_GENERATION_BITS) - 1)
+
+//  A table of objects (pointers or handles) looked up by versioned handle. Adding and removing take constant time: free slots
+//  are kept in a list threaded through the slots themselves. A slot's generation moves on each time it is freed, so a handle
+//  kept after its object was removed looks up nothing rather than whatever took the slot next. Freed slots are reused oldest
+//  first, which spreads reuse across the table and keeps any one slot's generations from wrapping around quickly.
+template <typename Type>
+class SocketSlotMap
+{
+public:
+	SocketSlotMap() : m_FirstFree(-1), m_LastFree(-1), m_Count(0) {}
+
+	int Add(Type value);
+	bool Remove(int handle);
+	void Clear();
+
+	//  Returns the object under the handle, or a null value if the handle is stale or was never handed out
+	Type operator[](int handle) const { auto index = GetSlotIndex(handle); return ((index >= 0) ? m_Slots[index].m_Value : Type()); }
+	bool Contains(int handle) const { return (GetSlotIndex(handle) >= 0); }
+	int GetCount() const { return m_Count; }
+
+	//  For walking every slot (to free everything at shutdown, for example). An empty slot holds a null value.
+	int GetSlotCount() const { return int(m_Slots.size()); }
+	Type GetSlot(int index) const { return m_Slots[index].m_Value; }
+	int GetHandle(int index) const { return (m_Slots[index].m_Used ? ((m_Slots[index].m_Generation << SOCKET_SLOT_INDEX_BITS) | index) : -1); }
+
+private:
+	struct Slot
+	{
+		Type m_Value;
+		int m_Generation;
+		int m_NextFree;
+		bool m_Used;
+	};
+
+	int GetSlotIndex(int handle) const;
+
+	std::vector<Slot> m_Slots;
+	int m_FirstFree;
+	int m_LastFree;
+	int m_Count;
+};
+
+template <typename Type>
+inline int SocketSlotMap<Type>::Add(Type value)
+{
+	//  Returns the new handle, or -1 if every possible slot is in use
+	int index;
+	if (m_FirstFree >= 0)
+	{
+		index = m_FirstFree;
+		m_FirstFree = m_Slots[index].m_NextFree;
+		if (m_FirstFree < 0) m_LastFree = -1;
+	}
+	else
+	{
+		if (int(m_Slots.size()) > SOCKET_SLOT_INDEX_MASK) return -1;
+		index = int(m_Slots.size());
+		m_Slots.push_back(Slot{ Type(), 0, -1, false });
+	}
+
+	auto& slot = m_Slots[index];
+	slot.m_Value = value;
+	slot.m_NextFree = -1;
+	slot.m_Used = true;
+	++m_Count;
+	return ((slot.m_Generation << SOCKET_SLOT_INDEX_BITS) | index);
+}
+
+template <typename Type>
+inline bool SocketSlotMap<Type>::Remove(int handle)
+{
+	auto index = GetSlotIndex(handle);
+	if (index < 0) return false;
+
+	auto& slot = m_Slots[index];
+	slot.m_Value = Type();
+	slot.m_Generation = (slot.m_Generation + 1) & SOCKET_SLOT_GENERATION_MASK;
+	slot.m_Used = false;
+	--m_Count;
+
+	if (m_LastFree >= 0) m_Slots[m_LastFree].m_NextFree = index;
+	else m_FirstFree = index;
+	m_LastFree = index;
+	return true;
+}
+
+template <typename Type>
+inline void SocketSlotMap<Type>::Clear()
+{
+	//  Starts over completely, so handles begin again from 0. The objects themselves are left to the owner to free first.
+	m_Slots.clear();
+	m_FirstFree = -1;
+	m_LastFree = -1;
+	m_Count = 0;
+}
+
+template <typename Type>
+inline int SocketSlotMap<Type>::GetSlotIndex(int handle) const
+{
+	if (handle < 0) return -1;
+	auto index = handle & SOCKET_SLOT_INDEX_MASK;
+	if (index >= int(m_Slots.size())) return -1;
+
+	auto& slot = m_Slots[index];
+	return ((slot.m_Used && slot.m_Generation == (handle >> SOCKET_SLOT_INDEX_BITS)) ? index : -1);
+}
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <unordered_map>
 
 #include "WindowManager.h"
+#include "GPUMemoryLedger.h"
 
 class TextureManager
 {
@@ -71,12 +72,21 @@ public:
 			//  Free the texture if it exists
 			if (m_Texture != nullptr)
 			{
+				gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_RENDERER_TEXTURE, uint64_t(uintptr_t(m_Texture)));
 				SDL_DestroyTexture(m_Texture);
 				m_Texture = nullptr;
+			}
+
+			//  Free the OpenGL texture if it exists
+			if (m_TextureID != 0)
+			{
+				gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_TEXTURE, uint64_t(m_TextureID));
+				glDeleteTextures(1, &m_TextureID);
 				m_TextureID = 0;
-				m_Width = 0;
-				m_Height = 0;
 			}
+
+			m_Width = 0;
+			m_Height = 0;
 		}
 
 		int getWidth() const { return m_Width; }
@@ -158,16 +168,27 @@ inline TextureManager::ManagedTexture* TextureManager::LoadTexture(const char* t
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+	//  Record the video memory held by both the OpenGL texture (a single mip level) and the SDL renderer's copy
+	gpuMemoryLedger.TrackResource(GPU_RESOURCE_TEXTURE, uint64_t(textureID), GPUMemoryLedger::ComputeTextureBytes(mode, GL_UNSIGNED_BYTE, width, height, 1), GPU_MEMORY_POOL_ID("TextureManager"));
+	Uint32 sdlTextureFormat = 0;
+	int sdlTextureWidth = 0;
+	int sdlTextureHeight = 0;
+	if (SDL_QueryTexture(sdlTexture, &sdlTextureFormat, nullptr, &sdlTextureWidth, &sdlTextureHeight) == 0)
+		gpuMemoryLedger.TrackResource(GPU_RESOURCE_RENDERER_TEXTURE, uint64_t(uintptr_t(sdlTexture)), size_t(SDL_BYTESPERPIXEL(sdlTextureFormat)) * size_t(sdlTextureWidth) * size_t(sdlTextureHeight), GPU_MEMORY_POOL_ID("TextureManager"));
+
 	//  Get rid of the old loaded surface
 	SDL_FreeSurface(sdlSurface);
 
 	//  Create a ManagedTexture with our new data, and stick it in the TextureList
+	MEMORY_SCOPE("TextureManager");
 	auto index = FirstFreeIndex();
-	MANAGE_MEMORY_NEW("TextureManager", sizeof(ManagedTexture));
 	auto managedTexture = new ManagedTexture(sdlTexture, textureID, width, height, index);
 	if (managedTexture == nullptr)
 	{
+		gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_TEXTURE, uint64_t(textureID));
+		gpuMemoryLedger.ReleaseResource(GPU_RESOURCE_RENDERER_TEXTURE, uint64_t(uintptr_t(sdlTexture)));
 		glDeleteTextures(1, &textureID);
+		SDL_DestroyTexture(sdlTexture);
 		printf("Unable to create ManagedTexture with data\n");
 		return nullptr;
 	}
@@ -201,7 +222,6 @@ inline void TextureManager::Shutdown()
 	while (!m_TextureList.empty())
 	{
 		m_TextureList.begin()->second->FreeTexture();
-		MANAGE_MEMORY_DELETE("TextureManager", sizeof(ManagedTexture));
 		delete m_TextureList.begin()->second;
 		m_TextureList.erase(m_TextureList.begin());
 	}
@@ -190,7 +190,7 @@ inline int WindowManager::CreateNewWindow(const char* title, int x, int y, int w
 	}
 
 	//  Create the WindowLink and assign the new data
-	MANAGE_MEMORY_NEW("WindowManager", sizeof(WindowLink));
+	MEMORY_SCOPE("WindowManager");
 	m_WindowList[index] = new WindowLink(newWindow, newContext, newRenderer, SDL_GetWindowID(newWindow), shown, w, h);
 	if ((m_WindowList.find(index) == m_WindowList.end()) || m_WindowList[index] == nullptr)
 	{
@@ -246,7 +246,6 @@ inline void WindowManager::Shutdown()
 	while (!m_WindowList.empty())
 	{
 		DestroyWindow(m_WindowList.begin()->second);
-		MANAGE_MEMORY_DELETE("WindowManager", sizeof(WindowLink));
 		delete m_WindowList.begin()->second;
 		m_WindowList.erase(m_WindowList.begin());
 	}
@@ -1,14 +1,34 @@
 #pragma once
 
 #include "Socket.h"
+#include "SocketBitStream.h"
 #include "SocketBuffer.h"
+#include "SocketChecksum.h"
+#include "SocketCipher.h"
+#include "SocketCompression.h"
+#include "SocketConnection.h"
+#include "SocketDelta.h"
+#include "SocketPoller.h"
+#include "SocketSerializer.h"
+#include "SocketSlotMap.h"
 #include "SimpleMD5.h"
 
+#if defined(_WIN32)
 #include <windows.h>
 #include <Wininet.h>
 #include <Iphlpapi.h>
-#include <vector>
 #include <minwindef.h>
+#else
+#include <cstdio>
+#include <ifaddrs.h>
+#include <net/if.h>
+#if defined(__linux__)
+#include <linux/if_packet.h>
+#endif
+#endif
+#include <chrono>
+#include <map>
+#include <vector>
 #include <assert.h>
 
 
@@ -16,6 +36,11 @@ class WinsockWrapper
 {
 public:
 	typedef unsigned long ulong;
+#if defined(_WIN32)
+	typedef HANDLE FileHandle;
+#else
+	typedef FILE* FileHandle;
+#endif
 
 	static WinsockWrapper& GetInstance() { static WinsockWrapper INSTANCE; return INSTANCE; }
 
@@ -37,9 +62,17 @@ public:
 
 	//  Miscelaneous
 	int SendMessagePacket(int socketID, const char* ipAddress, int port, int bufferID);
+	int SendMessagePackets(int socketID, const int* bufferIDs, int bufferCount);
+	int QueueMessagePacket(int socketID, int bufferID);
+	int FlushMessagePackets(int socketID);
 	int ReceiveMessagePacket(int socketID, int len, int bufferID, int length_specific = 0);
+	int ReceiveMessageView(int socketID, int bufferID, SocketBuffer::MessageView& view);
 	int PeekMessagePacket(int socketID, int len, int bufferID);
+	int ReceiveDatagrams(int socketID, DatagramBatch& batch);
+	int SendDatagrams(int socketID, DatagramBatch& batch, int first = 0);
 	int SetFormat(int socketID, int mode, char* separater);
+	int SetFrameLengthType(int socketID, int frameLengthType);
+	bool SetCompression(int socketID, bool enabled, int threshold = SOCKET_COMPRESSION_DEFAULT_THRESHOLD);
 	int SetSync(int socketID, int mode);
 	bool CloseSocket(int socketID);
 	int GetLastSocketError(int socketID);
@@ -50,10 +83,25 @@ public:
 	static std::string GetMyHostIP(char* hostName);
 	int GetSocketID(int socketID);
 
+	//  Readiness
+	const std::vector<int>& PollEvents(int timeoutMS = 0);
+
+	//  Connections with unreliable and reliable message channels over a UDP socket (see SocketConnection.h)
+	int CreateConnection(int socketID, const char* ipAddress, int port);
+	bool SetConnectionListen(int socketID, bool listen);
+	int AcceptConnection(int socketID);
+	int AddConnectionChannel(int connectionID, int channelType);
+	int SendConnectionMessage(int connectionID, int channel, int bufferID);
+	int ReceiveConnectionMessage(int connectionID, int channel, int bufferID);
+	int UpdateConnections(int socketID);
+	double GetConnectionRoundTripTime(int connectionID);
+	bool GetConnectionTimedOut(int connectionID);
+	bool FreeConnection(int connectionID);
+
 	//  IP Information
 	std::string GetExteriorIP(int socketID);
-	static char* GetLastInIP();
-	static double GetLastInPort();
+	std::string GetLastInIP(int socketID);
+	double GetLastInPort(int socketID);
 
 	// Buffer Write
 	int WriteChar(unsigned char val, int bufferID);
@@ -66,6 +114,9 @@ public:
 	int WriteDouble(double val, int bufferID);
 	int WriteString(char* val, int bufferID);
 	int WriteString(const char* val, int bufferID);
+	template <typename Type> int WriteStruct(const Type& val, int bufferID);
+	template <typename Type> int WriteStructs(const Type* vals, int count, int bufferID);
+	template <typename Type> int WriteArray(const Type* vals, int count, int bufferID, bool networkOrder = false);
 
 	// Buffer Read
 	unsigned char ReadChar(int bufferID, bool peek = false);
@@ -77,11 +128,17 @@ public:
 	float ReadFloat(int bufferID, bool peek = false);
 	double ReadDouble(int bufferID, bool peek = false);
 	char* ReadString(int bufferID, bool peek = false);
+	template <typename Type> bool ReadStruct(Type& val, int bufferID, bool peek = false);
+	template <typename Type> int ReadStructs(Type* vals, int count, int bufferID, bool peek = false);
+	template <typename Type> int ReadArray(Type* vals, int count, int bufferID, bool networkOrder = false, bool peek = false);
 
 	// Buffer Information
 	int GetBufferPosition(bool readWrite, int bufferID);
 	int ClearBuffer(int bufferID);
 	int GetBufferSize(int bufferID);
+	int GetBufferCapacity(int bufferID);
+	bool ReserveBuffer(int bufferID, int capacity);
+	bool ShrinkBuffer(int bufferID);
 	int SetBufferPosition(int pos, int bufferID);
 	int GetBytesLeft(int bufferID);
 	int CreateBuffer();
@@ -92,51 +149,107 @@ public:
 	static const char* GetStringMD5(char* str);
 	const char* GetBufferMD5(int bufferID) const;
 	bool EncryptBuffer(char* pass, int bufferID);
+	bool WriteCipherSalt(int bufferID);
+	int CreateCipher(const char* password, int saltBufferID, int direction, int cipherType = SOCKET_CIPHER_CHACHA20);
+	bool FreeCipher(int cipherID);
+	bool ApplyCipher(int cipherID, int bufferID);
+	bool ApplyCipher(int cipherID, int bufferID, unsigned long long packetNumber);
 	unsigned int GetBufferAdler32(int bufferID);
+	unsigned int GetBufferChecksum(int bufferID, int algorithm);
+	unsigned int GetBufferChecksum(int bufferID, int algorithm, unsigned int previousChecksum);
 	bool GetBufferExists(int bufferID);
+	SocketBuffer* GetBuffer(int bufferID) const;
+	int EncodeBufferDelta(int baselineID, int snapshotID, int deltaID);
+	bool DecodeBufferDelta(int baselineID, int deltaID, int snapshotID, int maximumSnapshotSize = SOCKET_DELTA_DEFAULT_MAX_SNAPSHOT_SIZE);
+	bool SetReceiveRing(int bufferID, int ringSize = RECEIVE_RING_DEFAULT_SIZE);
 
 	// File Read/Write
 	int FileOpen(char* name, int mode);
 	int FileClose(int fileID);
 	int FileWrite(int fileID, int bufferID);
 	int FileRead(int fileID, int bytes, int bufferID);
-	int FileGetPosition(int fileID);
-	int FileSetPosition(int fileID, int pos);
-	int FileGetSize(int fileID);
+	long long FileGetPosition(int fileID);
+	long long FileSetPosition(int fileID, long long pos);
+	long long FileGetSize(int fileID);
+	int FileReadAt(int fileID, long long offset, int bytes, int bufferID);
+	int FileWriteAt(int fileID, long long offset, int bufferID);
+	int FileMapView(int fileID, long long offset, int bytes, int bufferID);
 
 	int AddBuffer(SocketBuffer* b);
 	int AddSocket(Socket* b);
-	int AddFile(HANDLE b);
+	int AddFile(FileHandle b);
 
 private:
-	static HANDLE BinaryOpenFile(char* filename, int mode);
-	static bool BinaryCloseFile(HANDLE hwnd);
-	static int BinaryFileWrite(HANDLE hwnd, SocketBuffer* dataBuffer);
-	static int BinaryFileRead(HANDLE hwnd, int size, SocketBuffer* out);
-	static int BinaryGetPosition(HANDLE hwnd);
-	static int BinarySetPosition(HANDLE hwnd, int offset);
-	static int BinaryGetFileSize(HANDLE hwnd);
+	static FileHandle BinaryOpenFile(char* filename, int mode);
+	static bool BinaryCloseFile(FileHandle hwnd);
+	static int BinaryFileWrite(FileHandle hwnd, SocketBuffer* dataBuffer);
+	static int BinaryFileRead(FileHandle hwnd, int size, SocketBuffer* out);
+	static int BinaryFileReadAt(FileHandle hwnd, long long offset, int size, SocketBuffer* out);
+	static int BinaryFileWriteAt(FileHandle hwnd, long long offset, SocketBuffer* dataBuffer);
+	static int BinaryMapView(FileHandle hwnd, long long offset, int size, SocketBuffer* out);
+	static long long BinaryGetPosition(FileHandle hwnd);
+	static long long BinarySetPosition(FileHandle hwnd, long long offset);
+	static long long BinaryGetFileSize(FileHandle hwnd);
 
 	WinsockWrapper();
 	~WinsockWrapper();
 
-	std::vector<SocketBuffer*> m_BufferList;
-	std::vector<Socket*> m_SocketList;
-	std::vector<HANDLE>  m_FileList;
+	//  IDs handed out for buffers, sockets, files and ciphers are slot map handles, so an ID kept after a free finds nothing
+	SocketSlotMap<SocketBuffer*> m_BufferList;
+	SocketSlotMap<Socket*> m_SocketList;
+	SocketSlotMap<FileHandle> m_FileList;
+	SocketPoller m_SocketPoller;
+	std::vector<int> m_ReadySocketIDs;
+	std::vector<SocketBuffer*> m_GatherList;
+
+	//  Payloads in their compressed form on the way out of (or in to) a socket with compression on
+	std::vector<SocketBuffer*> m_CompressionBuffers;
+
+	SocketSlotMap<SocketCipher*> m_CipherList;
+	SocketBuffer* GetCompressionBuffer(int index);
+	bool UpdateCompressionNegotiation(Socket* socket);
+	void ReceiveCompressionControl(Socket* socket, int control);
+
+	//  Connections are found by socket and remote address when their packets arrive. A listening socket takes packets from new
+	//  addresses that carry the right token as new connections, which wait in the accepted list until AcceptConnection hands
+	//  them out. Tokens are made from the secret, so nothing has to be kept for a peer until it has one.
+	SocketSlotMap<SocketConnection*> m_ConnectionList;
+	std::map<std::pair<int, unsigned long long>, int> m_ConnectionAddresses;
+	std::vector<int> m_ListeningSocketIDs;
+	std::vector<int> m_AcceptedConnectionIDs;
+	std::vector<std::pair<SOCKADDR_IN, uint64_t>> m_ConnectionChallenges;
+	unsigned char m_ConnectionSecret[SOCKET_CIPHER_SALT_SIZE];
+	DatagramBatch* m_ConnectionBatch;
+	static double GetConnectionTime();
+	static unsigned long long GetAddressKey(const SOCKADDR_IN& address);
+	uint64_t GetConnectionToken(const SOCKADDR_IN& address, long long period) const;
+	void FlushConnectionBatch(Socket* socket);
 	bool m_WinsockInitialized;
 };
 
 inline bool WinsockWrapper::GetInternetConnected()
 {
+#if defined(_WIN32)
 	DWORD cstat;
 	return InternetGetConnectedState(&cstat, 0) != false;
+#else
+	//  Treat any running interface other than loopback as a connection
+	struct ifaddrs* interfaceList;
+	if (getifaddrs(&interfaceList) != 0) return false;
+
+	auto connected = false;
+	for (auto iter = interfaceList; iter != nullptr && !connected; iter = iter->ifa_next)
+		connected = ((iter->ifa_flags & IFF_UP) && (iter->ifa_flags & IFF_RUNNING) && !(iter->ifa_flags & IFF_LOOPBACK));
+	freeifaddrs(interfaceList);
+	return connected;
+#endif
 }
 
 inline unsigned int WinsockWrapper::ConvertIPtoUINT(const char* ipAddress)
 {
 	struct sockaddr_in sa;
 	inet_pton(AF_INET, ipAddress, &(sa.sin_addr));
-	return sa.sin_addr.S_un.S_addr;
+	return sa.sin_addr.s_addr;
 }
 
 inline std::string WinsockWrapper::ConvertUINTtoIP(unsigned int ipAddress)
@@ -151,9 +264,11 @@ inline void WinsockWrapper::WinsockInitialize(unsigned int bufferCount)
 	//  If we're already initialized, exit gracefully
 	if (m_WinsockInitialized) return;
 
+#if defined(_WIN32)
 	//  Start up the Winsock library, requesting version 2.2
 	WSADATA wsaData;
 	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
 
 	for (unsigned int i = 0; i < bufferCount; ++i)
 	{
@@ -169,23 +284,54 @@ inline void WinsockWrapper::WinsockShutdown()
 {
 	Socket::SockExit();
 
-	while (!m_BufferList.empty())
+	for (auto i = 0; i < m_BufferList.GetSlotCount(); ++i)
 	{
+		if (m_BufferList.GetSlot(i) == nullptr) continue;
 		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketBuffer));
-		delete (*m_BufferList.begin());
-		m_BufferList.erase(m_BufferList.begin());
+		delete m_BufferList.GetSlot(i);
+	}
+	for (auto i = 0; i < m_ConnectionList.GetSlotCount(); ++i)
+	{
+		if (m_ConnectionList.GetSlot(i) == nullptr) continue;
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketConnection));
+		delete m_ConnectionList.GetSlot(i);
 	}
-	while (!m_BufferList.empty())
+	if (m_ConnectionBatch != nullptr)
 	{
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(DatagramBatch));
+		delete m_ConnectionBatch;
+		m_ConnectionBatch = nullptr;
+	}
+	m_SocketPoller.Shutdown();
+	for (auto i = 0; i < m_SocketList.GetSlotCount(); ++i)
+	{
+		if (m_SocketList.GetSlot(i) == nullptr) continue;
 		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(Socket));
-		delete (*m_SocketList.begin());
-		m_SocketList.erase(m_SocketList.begin());
+		delete m_SocketList.GetSlot(i);
+	}
+	for (auto i = 0; i < m_FileList.GetSlotCount(); ++i)
+		if (m_FileList.GetSlot(i) != nullptr) BinaryCloseFile(m_FileList.GetSlot(i));
+	for (unsigned int i = 0; i < m_CompressionBuffers.size(); ++i)
+	{
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketBuffer));
+		delete m_CompressionBuffers[i];
+	}
+	for (auto i = 0; i < m_CipherList.GetSlotCount(); ++i)
+	{
+		if (m_CipherList.GetSlot(i) == nullptr) continue;
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketCipher));
+		delete m_CipherList.GetSlot(i);
 	}
-	for (unsigned int i = 0; i < m_FileList.size(); ++i) BinaryCloseFile(m_FileList[i]);
 
-	m_BufferList.clear();
-	m_SocketList.clear();
-	m_FileList.clear();
+	m_BufferList.Clear();
+	m_SocketList.Clear();
+	m_FileList.Clear();
+	m_CompressionBuffers.clear();
+	m_CipherList.Clear();
+	m_ConnectionList.Clear();
+	m_ConnectionAddresses.clear();
+	m_ListeningSocketIDs.clear();
+	m_AcceptedConnectionIDs.clear();
 }
 
 inline int WinsockWrapper::TCPConnect(const char* ipAddress, int port, int mode)
@@ -227,6 +373,7 @@ inline bool WinsockWrapper::TCPConnected(int socketID)
 
 inline int WinsockWrapper::UDPConnect(int port, int mode)
 {
+	MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(Socket));
 	auto socket = new Socket();
 	if (socket->udpconnect(port, mode)) return AddSocket(socket);
 
@@ -250,27 +397,140 @@ inline int WinsockWrapper::SendMessagePacket(int socketID, const char* ipAddress
 	auto buffer = m_BufferList[bufferID];
 	if (socket == nullptr) return -1;
 	if (buffer == nullptr) return -2;
+	UpdateCompressionNegotiation(socket);
+	if (socket->m_CompressionState.m_Sending)
+	{
+		auto compressed = GetCompressionBuffer(0);
+		SocketCompression::CompressBuffer(buffer, compressed, socket->compressionthreshold());
+		buffer = compressed;
+	}
 	auto size = socket->sendmessage(ipAddress, port, buffer);
 	if (size < 0) return -socket->lasterror();
 	return size;
 }
 
+inline int WinsockWrapper::SendMessagePackets(int socketID, const int* bufferIDs, int bufferCount)
+{
+	//  Sends several buffers to one TCP socket as separate framed messages, in as few system calls as possible
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+
+	UpdateCompressionNegotiation(socket);
+	m_GatherList.clear();
+	for (auto i = 0; i < bufferCount; ++i)
+	{
+		auto buffer = m_BufferList[bufferIDs[i]];
+		if (buffer == nullptr) return -2;
+		if (socket->m_CompressionState.m_Sending)
+		{
+			auto compressed = GetCompressionBuffer(i);
+			SocketCompression::CompressBuffer(buffer, compressed, socket->compressionthreshold());
+			buffer = compressed;
+		}
+		m_GatherList.push_back(buffer);
+	}
+
+	auto size = socket->sendgather(m_GatherList.data(), int(m_GatherList.size()));
+	if (size < 0) return -socket->lasterror();
+	return size;
+}
+
+inline int WinsockWrapper::QueueMessagePacket(int socketID, int bufferID)
+{
+	//  The buffer is sent by the next FlushMessagePackets, and must not be changed before then. Queued buffers are sent as they
+	//  are, so a socket with compression on (or still compressing until its STOP goes out) can't queue.
+	auto socket = m_SocketList[socketID];
+	auto buffer = m_BufferList[bufferID];
+	if (socket == nullptr || socket->compressionenabled() || socket->m_CompressionState.m_Sending) return -1;
+	if (buffer == nullptr) return -2;
+	socket->queuemessage(buffer);
+	return socket->queuedmessages();
+}
+
+inline int WinsockWrapper::FlushMessagePackets(int socketID)
+{
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+	auto size = socket->flushmessages();
+	if (size < 0) return -socket->lasterror();
+	return size;
+}
+
 inline int WinsockWrapper::ReceiveMessagePacket(int socketID, int len, int bufferID, int length_specific)
 {
+	//  Returns the size of the message received into the buffer, 0 if the connection closed, or a negative error (such as
+	//  -WSAEWOULDBLOCK while a framed message is still only partly received). Framed messages are never empty, as empty ones are
+	//  refused when sent and skipped when received, so 0 can't be mistaken for one.
 	auto socket = m_SocketList[socketID];
 	auto buffer = m_BufferList[bufferID];
 	if (socket == nullptr) return -1;
 	if (buffer == nullptr) return -2;
-	auto size = socket->receivemessage(len, buffer, length_specific);
-	if (size < 0)
+
+	//  Framed TCP messages may be the peer's compression control frames, which are acted on here rather than handed out
+	auto framed = (!socket->isudp() && socket->dataformat() == 0 && len == 0);
+	auto& compressionState = socket->m_CompressionState;
+	SocketBuffer* received;
+	int size;
+	while (true)
 	{
-		auto error = socket->lasterror();
-		if (error == 10054) return 0;
-		return -error;
+		received = compressionState.m_Receiving ? GetCompressionBuffer(0) : buffer;
+		size = socket->receivemessage(len, received, length_specific);
+		if (size < 0)
+		{
+			auto error = socket->lasterror();
+			if (error == WSAECONNRESET) return 0;
+			return -error;
+		}
+
+		auto control = framed ? SocketCompression::ReadControlFrame(received->m_BufferData, size) : 0;
+		if (control == 0) break;
+		ReceiveCompressionControl(socket, control);
+		received->clear();
+	}
+
+	if (received != buffer && size > 0)
+	{
+		//  With the negotiation, a payload that won't decompress means the stream itself is broken (or the peer is misbehaving),
+		//  so it's reported once rather than for every payload that follows
+		if (!SocketCompression::DecompressBuffer(received, buffer))
+		{
+			if (!compressionState.m_ErrorReported) printf("WinsockWrapper received a payload on socket %d that couldn't be decompressed. Further failures on it won't be reported.\n", socketID);
+			compressionState.m_ErrorReported = true;
+			return -WSAEMSGSIZE;
+		}
+		size = buffer->m_BufferUtilizedCount;
 	}
 	return size;
 }
 
+inline int WinsockWrapper::ReceiveMessageView(int socketID, int bufferID, SocketBuffer::MessageView& view)
+{
+	//  Receives into the buffer's receive ring (see SetReceiveRing) and hands the next message back in place, without copying it.
+	//  Returns 1 once the view holds a message (its size is in the view, and may be 0), 0 if the connection closed, or
+	//  -WSAEWOULDBLOCK while a message is still only partly received. Views are of the data as sent, so a socket with compression
+	//  on can't use them.
+	auto socket = m_SocketList[socketID];
+	auto buffer = m_BufferList[bufferID];
+	if (socket == nullptr || socket->compressionenabled() || socket->m_CompressionState.m_Receiving) return -1;
+	if (buffer == nullptr) return -2;
+	while (true)
+	{
+		auto result = socket->receivemessageview(buffer, view);
+		if (result < 0)
+		{
+			auto error = socket->lasterror();
+			if (error == WSAECONNRESET) return 0;
+			return -error;
+		}
+
+		//  The peer's compression control frames are acted on rather than handed out
+		auto control = (result > 0) ? SocketCompression::ReadControlFrame(view.m_Data, view.m_Size) : 0;
+		if (control == 0) return result;
+		ReceiveCompressionControl(socket, control);
+		if (socket->m_CompressionState.m_Receiving) return -1;
+	}
+}
+
 inline int WinsockWrapper::PeekMessagePacket(int socketID, int len, int bufferID)
 {
 	auto socket = m_SocketList[socketID];
@@ -281,17 +541,99 @@ inline int WinsockWrapper::PeekMessagePacket(int socketID, int len, int bufferID
 	if (size < 0)
 	{
 		auto error = socket->lasterror();
-		return ((error == 10054) ? 0 : -error);
+		return ((error == WSAECONNRESET) ? 0 : -error);
 	}
 	return size;
 }
 
+inline int WinsockWrapper::ReceiveDatagrams(int socketID, DatagramBatch& batch)
+{
+	//  Receives every waiting datagram (up to the batch's capacity) in one call. Each slot keeps the address it came from.
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+	auto count = socket->receivedatagrams(batch);
+	if (count < 0)
+	{
+		auto error = socket->lasterror();
+		return ((error == WSAECONNRESET) ? 0 : -error);
+	}
+	return count;
+}
+
+inline int WinsockWrapper::SendDatagrams(int socketID, DatagramBatch& batch, int first)
+{
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+	auto count = socket->senddatagrams(batch, first);
+	if (count < 0) return -socket->lasterror();
+	return count;
+}
+
 inline int WinsockWrapper::SetFormat(int socketID, int mode, char* separater)
 {
 	auto socket = m_SocketList[socketID];
 	return ((socket == nullptr) ? -1 : socket->SetFormat(mode, separater));
 }
 
+inline int WinsockWrapper::SetFrameLengthType(int socketID, int frameLengthType)
+{
+	auto socket = m_SocketList[socketID];
+	return ((socket == nullptr) ? -1 : socket->SetFrameLengthType(frameLengthType));
+}
+
+inline bool WinsockWrapper::SetCompression(int socketID, bool enabled, int threshold)
+{
+	//  Compression is negotiated with the peer (see SocketCompression.h), so it only begins once both ends have turned it on, and
+	//  a peer that never does just receives payloads as they are. Turning it off stops this end compressing what it sends.
+	//  Payloads smaller than the threshold are never compressed. Only framed TCP sockets (data format 0) can use it, as the
+	//  negotiation relies on the stream keeping the control frames in order with the payloads.
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr || socket->isudp() || socket->dataformat() != 0) return false;
+
+	auto wasEnabled = socket->compressionenabled();
+	socket->setcompression(enabled ? std::max<int>(threshold, 0) : -1);
+	if (enabled && !wasEnabled) socket->m_CompressionState.m_OfferPending = true;
+	UpdateCompressionNegotiation(socket);
+	return true;
+}
+
+inline bool WinsockWrapper::UpdateCompressionNegotiation(Socket* socket)
+{
+	//  Sends whichever control frames this end owes its peer. One that can't be sent yet stays owed, and payloads keep going
+	//  out in their current form until it has gone, so the peer always knows how to read them. Returns false while one is owed.
+	auto& compressionState = socket->m_CompressionState;
+	SocketBuffer control;
+	if (compressionState.m_OfferPending)
+	{
+		SocketCompression::WriteControlFrame(&control, SOCKET_COMPRESSION_CONTROL_OFFER);
+		if (socket->sendmessage("", 0, &control) < 0) return false;
+		compressionState.m_OfferPending = false;
+	}
+
+	auto sending = (socket->compressionenabled() && compressionState.m_PeerOffered);
+	if (sending != compressionState.m_Sending)
+	{
+		SocketCompression::WriteControlFrame(&control, sending ? SOCKET_COMPRESSION_CONTROL_START : SOCKET_COMPRESSION_CONTROL_STOP);
+		if (socket->sendmessage("", 0, &control) < 0) return false;
+		compressionState.m_Sending = sending;
+	}
+	return true;
+}
+
+inline void WinsockWrapper::ReceiveCompressionControl(Socket* socket, int control)
+{
+	auto& compressionState = socket->m_CompressionState;
+	switch (control)
+	{
+	case SOCKET_COMPRESSION_CONTROL_OFFER:	compressionState.m_PeerOffered = true;	break;
+	case SOCKET_COMPRESSION_CONTROL_START:	compressionState.m_Receiving = true;	break;
+	case SOCKET_COMPRESSION_CONTROL_STOP:	compressionState.m_Receiving = false;	break;
+	}
+
+	//  An offer from the peer may be what this end was waiting for to start compressing
+	UpdateCompressionNegotiation(socket);
+}
+
 inline int WinsockWrapper::SetSync(int socketID, int mode)
 {
 	if (socketID < 0) return -1;
@@ -306,9 +648,19 @@ inline bool WinsockWrapper::CloseSocket(int socketID)
 	if (socketID < 0) return false;
 	auto socket = m_SocketList[socketID];
 	if (socket == nullptr) return false;
+
+	//  Connections can't outlive the socket they run over
+	for (auto i = 0; i < m_ConnectionList.GetSlotCount(); ++i)
+	{
+		auto connection = m_ConnectionList.GetSlot(i);
+		if (connection != nullptr && connection->GetSocketID() == socketID) FreeConnection(m_ConnectionList.GetHandle(i));
+	}
+	SetConnectionListen(socketID, false);
+
+	m_SocketPoller.RemoveSocket(socket->m_SocketID);
 	MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(Socket));
 	delete socket;
-	m_SocketList[socketID] = nullptr;
+	m_SocketList.Remove(socketID);
 	return true;
 }
 
@@ -378,20 +730,287 @@ inline int WinsockWrapper::GetSocketID(int socketID)
 	return ((socket == nullptr) ? -1 : int(socket->m_SocketID));
 }
 
+inline const std::vector<int>& WinsockWrapper::PollEvents(int timeoutMS)
+{
+	//  Hands back the IDs of every open socket with data (or a connection, or a hang-up) waiting, in one call no matter how many
+	//  sockets are open. A timeout of zero returns immediately, and a negative timeout waits until something is ready.
+	if (m_SocketPoller.Poll(timeoutMS, m_ReadySocketIDs) < 0) m_ReadySocketIDs.clear();
+	return m_ReadySocketIDs;
+}
+
+inline int WinsockWrapper::CreateConnection(int socketID, const char* ipAddress, int port)
+{
+	//  Returns the ID of a connection to the address over a UDP socket (an existing one if there is already one to it), or -1.
+	//  Messages can be sent straight away, though a listening peer drops packets until it has challenged this end and been
+	//  answered, so unreliable ones sent in the first round trip are usually lost.
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+
+	SOCKADDR_IN address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	if (inet_pton(AF_INET, ipAddress, &address.sin_addr) != 1) return -1;
+
+	auto key = std::make_pair(socketID, GetAddressKey(address));
+	auto existing = m_ConnectionAddresses.find(key);
+	if (existing != m_ConnectionAddresses.end()) return existing->second;
+
+	MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(SocketConnection));
+	auto connection = new SocketConnection(socketID, address, GetConnectionTime(), true);
+	auto connectionID = m_ConnectionList.Add(connection);
+	if (connectionID < 0)
+	{
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketConnection));
+		delete connection;
+		return -1;
+	}
+	m_ConnectionAddresses[key] = connectionID;
+	return connectionID;
+}
+
+inline bool WinsockWrapper::SetConnectionListen(int socketID, bool listen)
+{
+	//  Only a listening socket turns packets from unknown addresses into new connections
+	auto iter = std::find(m_ListeningSocketIDs.begin(), m_ListeningSocketIDs.end(), socketID);
+	if (!listen)
+	{
+		if (iter != m_ListeningSocketIDs.end()) m_ListeningSocketIDs.erase(iter);
+		return true;
+	}
+
+	if (m_SocketList[socketID] == nullptr) return false;
+	if (iter == m_ListeningSocketIDs.end()) m_ListeningSocketIDs.push_back(socketID);
+	return true;
+}
+
+inline int WinsockWrapper::AcceptConnection(int socketID)
+{
+	//  Returns the next connection a listening socket has taken in since the last call, or -1 if there are none
+	for (auto iter = m_AcceptedConnectionIDs.begin(); iter != m_AcceptedConnectionIDs.end(); ++iter)
+	{
+		auto connection = m_ConnectionList[*iter];
+		if (connection == nullptr || connection->GetSocketID() != socketID) continue;
+		auto connectionID = *iter;
+		m_AcceptedConnectionIDs.erase(iter);
+		return connectionID;
+	}
+	return -1;
+}
+
+inline int WinsockWrapper::AddConnectionChannel(int connectionID, int channelType)
+{
+	auto connection = m_ConnectionList[connectionID];
+	return ((connection == nullptr) ? -1 : connection->AddChannel(channelType));
+}
+
+inline int WinsockWrapper::SendConnectionMessage(int connectionID, int channel, int bufferID)
+{
+	//  Queues the buffer as a message on the channel, and returns its message ID. It goes out with the next UpdateConnections.
+	auto connection = m_ConnectionList[connectionID];
+	auto buffer = m_BufferList[bufferID];
+	if (connection == nullptr) return -1;
+	if (buffer == nullptr) return -2;
+	return connection->QueueMessage(channel, buffer->m_BufferData, buffer->m_BufferUtilizedCount);
+}
+
+inline int WinsockWrapper::ReceiveConnectionMessage(int connectionID, int channel, int bufferID)
+{
+	//  Replaces the buffer with the next message delivered on the channel, and returns its size, or 0 if there isn't one
+	auto connection = m_ConnectionList[connectionID];
+	auto buffer = m_BufferList[bufferID];
+	if (connection == nullptr) return -1;
+	if (buffer == nullptr) return -2;
+	return connection->TakeMessage(channel, buffer);
+}
+
+inline int WinsockWrapper::UpdateConnections(int socketID)
+{
+	//  Reads every waiting packet into the socket's connections, then sends whatever they have due: new messages, resends, acks
+	//  and keep-alives. Call it every frame, on a non-blocking socket. Returns the number of connection packets read. Connections
+	//  that have timed out are freed here, so their IDs find nothing from then on.
+	auto socket = m_SocketList[socketID];
+	if (socket == nullptr) return -1;
+
+	if (m_ConnectionBatch == nullptr)
+	{
+		MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(DatagramBatch));
+		m_ConnectionBatch = new DatagramBatch;
+	}
+	auto& batch = *m_ConnectionBatch;
+	auto time = GetConnectionTime();
+	auto period = (long long)(std::floor(time / SOCKET_CONNECTION_TOKEN_PERIOD));
+	auto listening = (std::find(m_ListeningSocketIDs.begin(), m_ListeningSocketIDs.end(), socketID) != m_ListeningSocketIDs.end());
+	auto waitingCount = int(std::count_if(m_AcceptedConnectionIDs.begin(), m_AcceptedConnectionIDs.end(), [&](int connectionID) { auto connection = m_ConnectionList[connectionID]; return (connection != nullptr && connection->GetSocketID() == socketID); }));
+	m_ConnectionChallenges.clear();
+
+	auto packetCount = 0;
+	while (true)
+	{
+		auto count = socket->receivedatagrams(batch);
+		if (count <= 0)
+		{
+			auto error = (count < 0) ? socket->lasterror() : 0;
+			if (error != 0 && error != WSAEWOULDBLOCK && error != WSAECONNRESET) return -error;
+			break;
+		}
+
+		for (auto i = 0; i < count; ++i)
+		{
+			auto data = batch.GetData(i);
+			auto size = batch.GetSize(i);
+			if (!SocketConnection::IsConnectionPacket(data, size)) continue;
+
+			auto& address = batch.GetAddress(i);
+			auto key = std::make_pair(socketID, GetAddressKey(address));
+			auto existing = m_ConnectionAddresses.find(key);
+			if (existing != m_ConnectionAddresses.end())
+			{
+				auto connection = m_ConnectionList[existing->second];
+				if (connection != nullptr && connection->ReadPacket(data, size, time)) ++packetCount;
+				continue;
+			}
+
+			//  A new peer needs a token from this period or the last one. Without one it is sent a challenge with the token in,
+			//  which is no larger than the packet it answers, and nothing is kept.
+			uint64_t token;
+			if (!listening || !SocketConnection::GetPacketToken(data, size, token)) continue;
+			if (token != GetConnectionToken(address, period) && token != GetConnectionToken(address, period - 1))
+			{
+				if (int(m_ConnectionChallenges.size()) < batch.GetCapacity()) m_ConnectionChallenges.emplace_back(address, GetConnectionToken(address, period));
+				continue;
+			}
+			if (waitingCount >= SOCKET_CONNECTION_MAX_WAITING) continue;
+
+			MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(SocketConnection));
+			auto connection = new SocketConnection(socketID, address, time, false);
+			auto connectionID = connection->ReadPacket(data, size, time) ? m_ConnectionList.Add(connection) : -1;
+			if (connectionID < 0)
+			{
+				MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketConnection));
+				delete connection;
+				continue;
+			}
+			m_ConnectionAddresses[key] = connectionID;
+			m_AcceptedConnectionIDs.push_back(connectionID);
+			++waitingCount;
+			++packetCount;
+		}
+
+		//  A batch that wasn't filled means nothing more is waiting
+		if (count < batch.GetCapacity()) break;
+	}
+
+	batch.Clear();
+	for (auto iter = m_ConnectionChallenges.begin(); iter != m_ConnectionChallenges.end(); ++iter)
+		SocketConnection::WriteChallenge(batch.AddDatagram(iter->first, SOCKET_CONNECTION_CHALLENGE_SIZE), iter->second);
+
+	for (auto i = 0; i < m_ConnectionList.GetSlotCount(); ++i)
+	{
+		auto connection = m_ConnectionList.GetSlot(i);
+		if (connection == nullptr || connection->GetSocketID() != socketID) continue;
+		if (connection->GetTimedOut(time))
+		{
+			FreeConnection(m_ConnectionList.GetHandle(i));
+			continue;
+		}
+		while (true)
+		{
+			connection->WritePackets(batch, time);
+			if (batch.GetCount() < batch.GetCapacity()) break;
+			FlushConnectionBatch(socket);
+		}
+	}
+	FlushConnectionBatch(socket);
+	return packetCount;
+}
+
+inline double WinsockWrapper::GetConnectionRoundTripTime(int connectionID)
+{
+	//  The smoothed round trip time in seconds (0 until the first ack comes back)
+	auto connection = m_ConnectionList[connectionID];
+	return ((connection == nullptr) ? -1.0 : connection->GetRoundTripTime());
+}
+
+inline bool WinsockWrapper::GetConnectionTimedOut(int connectionID)
+{
+	//  True once nothing has been heard from the peer for SOCKET_CONNECTION_TIMEOUT seconds (or the connection doesn't exist, as
+	//  after the UpdateConnections that frees it)
+	auto connection = m_ConnectionList[connectionID];
+	return ((connection == nullptr) ? true : connection->GetTimedOut(GetConnectionTime()));
+}
+
+inline bool WinsockWrapper::FreeConnection(int connectionID)
+{
+	auto connection = m_ConnectionList[connectionID];
+	if (connection == nullptr) return false;
+	m_ConnectionAddresses.erase(std::make_pair(connection->GetSocketID(), GetAddressKey(connection->GetAddress())));
+	m_AcceptedConnectionIDs.erase(std::remove(m_AcceptedConnectionIDs.begin(), m_AcceptedConnectionIDs.end(), connectionID), m_AcceptedConnectionIDs.end());
+	MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketConnection));
+	delete connection;
+	m_ConnectionList.Remove(connectionID);
+	return true;
+}
+
+inline double WinsockWrapper::GetConnectionTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long long WinsockWrapper::GetAddressKey(const SOCKADDR_IN& address)
+{
+	return ((unsigned long long)(address.sin_addr.s_addr) << 16) | (unsigned long long)(address.sin_port);
+}
+
+inline uint64_t WinsockWrapper::GetConnectionToken(const SOCKADDR_IN& address, long long period) const
+{
+	//  The first eight bytes of SHA-256(secret, address, period). Never zero, as that is what a peer sends before it has one.
+	unsigned char input[SOCKET_CIPHER_SALT_SIZE + 16];
+	auto addressKey = GetAddressKey(address);
+	memcpy(input, m_ConnectionSecret, SOCKET_CIPHER_SALT_SIZE);
+	memcpy(input + SOCKET_CIPHER_SALT_SIZE, &addressKey, 8);
+	memcpy(input + SOCKET_CIPHER_SALT_SIZE + 8, &period, 8);
+
+	unsigned char digest[SHA256::DIGEST_SIZE];
+	SHA256 hash;
+	hash.init();
+	hash.update(input, sizeof(input));
+	hash.final(digest);
+
+	uint64_t token;
+	memcpy(&token, digest, sizeof(token));
+	return ((token == 0) ? 1 : token);
+}
+
+inline void WinsockWrapper::FlushConnectionBatch(Socket* socket)
+{
+	//  Whatever the socket won't take now is dropped, as the connections send it again if it matters
+	auto& batch = *m_ConnectionBatch;
+	for (auto first = 0; first < batch.GetCount();)
+	{
+		auto sentCount = socket->senddatagrams(batch, first);
+		if (sentCount <= 0) break;
+		first += sentCount;
+	}
+	batch.Clear();
+}
+
 inline std::string WinsockWrapper::GetExteriorIP(int socketID)
 {
 	auto socket = m_SocketList[socketID];
 	return socket->tcpip();
 }
 
-inline char* WinsockWrapper::GetLastInIP()
+inline std::string WinsockWrapper::GetLastInIP(int socketID)
 {
-	return Socket::lastinIP();
+	auto socket = m_SocketList[socketID];
+	return ((socket == nullptr) ? std::string() : socket->lastinIP());
 }
 
-inline double WinsockWrapper::GetLastInPort()
+inline double WinsockWrapper::GetLastInPort(int socketID)
 {
-	return Socket::lastinPort();
+	auto socket = m_SocketList[socketID];
+	return ((socket == nullptr) ? 0.0 : socket->lastinPort());
 }
 
 inline int WinsockWrapper::WriteChar(unsigned char val, int bufferID)
@@ -456,6 +1075,28 @@ inline int WinsockWrapper::WriteString(const char* val, int bufferID)
 	return ((buffer == nullptr) ? 0 : buffer->writestring(val));
 }
 
+template <typename Type>
+inline int WinsockWrapper::WriteStruct(const Type& val, int bufferID)
+{
+	//  Type must be declared with SOCKET_SERIALIZABLE (see SocketSerializer.h)
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : SocketSerializer::Write(buffer, &val));
+}
+
+template <typename Type>
+inline int WinsockWrapper::WriteStructs(const Type* vals, int count, int bufferID)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : SocketSerializer::Write(buffer, vals, count));
+}
+
+template <typename Type>
+inline int WinsockWrapper::WriteArray(const Type* vals, int count, int bufferID, bool networkOrder)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : buffer->WriteArray(vals, count, networkOrder));
+}
+
 inline unsigned char WinsockWrapper::ReadChar(int bufferID, bool peek)
 {
 	auto buffer = m_BufferList[bufferID];
@@ -510,6 +1151,27 @@ inline char* WinsockWrapper::ReadString(int bufferID, bool peek)
 	return ((buffer == nullptr) ? 0 : buffer->readstring(peek));
 }
 
+template <typename Type>
+inline bool WinsockWrapper::ReadStruct(Type& val, int bufferID, bool peek)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? false : (SocketSerializer::Read(buffer, &val, 1, peek) != 0));
+}
+
+template <typename Type>
+inline int WinsockWrapper::ReadStructs(Type* vals, int count, int bufferID, bool peek)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : SocketSerializer::Read(buffer, vals, count, peek));
+}
+
+template <typename Type>
+inline int WinsockWrapper::ReadArray(Type* vals, int count, int bufferID, bool networkOrder, bool peek)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : buffer->ReadArray(vals, count, networkOrder, peek));
+}
+
 inline int WinsockWrapper::GetBufferPosition(bool readWrite, int bufferID)
 {
 	auto buffer = m_BufferList[bufferID];
@@ -531,6 +1193,28 @@ inline int WinsockWrapper::GetBufferSize(int bufferID)
 	return ((buffer == nullptr) ? 0 : buffer->m_BufferUtilizedCount);
 }
 
+inline int WinsockWrapper::GetBufferCapacity(int bufferID)
+{
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? 0 : buffer->capacity());
+}
+
+inline bool WinsockWrapper::ReserveBuffer(int bufferID, int capacity)
+{
+	auto buffer = m_BufferList[bufferID];
+	if (buffer == nullptr) return false;
+	buffer->reserve(capacity);
+	return true;
+}
+
+inline bool WinsockWrapper::ShrinkBuffer(int bufferID)
+{
+	auto buffer = m_BufferList[bufferID];
+	if (buffer == nullptr) return false;
+	buffer->shrink_to_fit();
+	return true;
+}
+
 inline int WinsockWrapper::SetBufferPosition(int pos, int bufferID)
 {
 	auto buffer = m_BufferList[bufferID];
@@ -558,9 +1242,14 @@ inline bool WinsockWrapper::FreeBuffer(int bufferID)
 	if (bufferID == 0) return false;
 	auto buff = m_BufferList[bufferID];
 	if (buff == nullptr) return false;
+	for (auto i = 0; i < m_SocketList.GetSlotCount(); ++i)
+	{
+		auto socket = m_SocketList.GetSlot(i);
+		if (socket != nullptr && socket->queuedmessages() > 0) socket->unqueuemessages(buff);
+	}
 	MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketBuffer));
 	delete buff;
-	m_BufferList[bufferID] = nullptr;
+	m_BufferList.Remove(bufferID);
 	return true;
 }
 
@@ -587,6 +1276,7 @@ inline bool WinsockWrapper::CopyBuffer(int destinationID, int start, int len, in
 inline const char* WinsockWrapper::GetMacAddress() const
 {
 	static char mac_address[32];
+#if defined(_WIN32)
 	IP_ADAPTER_INFO AdapterInfo[16];
 	DWORD dwBufLen = sizeof(AdapterInfo);
 	auto dwStatus = GetAdaptersInfo(AdapterInfo, &dwBufLen);
@@ -596,6 +1286,25 @@ inline const char* WinsockWrapper::GetMacAddress() const
 
 	sprintf_s(mac_address, 31, "%02X-%02X-%02X-%02X-%02X-%02X", AdapterInfo->Address[0], AdapterInfo->Address[1], AdapterInfo->Address[2], AdapterInfo->Address[3], AdapterInfo->Address[4], AdapterInfo->Address[5]);
 	return mac_address;
+#elif defined(__linux__)
+	//  Use the hardware address of the first interface that isn't loopback
+	struct ifaddrs* interfaceList;
+	if (getifaddrs(&interfaceList) != 0) return nullptr;
+
+	const char* result = nullptr;
+	for (auto iter = interfaceList; iter != nullptr && result == nullptr; iter = iter->ifa_next)
+	{
+		if (iter->ifa_addr == nullptr || iter->ifa_addr->sa_family != AF_PACKET || (iter->ifa_flags & IFF_LOOPBACK)) continue;
+		auto address = (struct sockaddr_ll*)(iter->ifa_addr);
+		if (address->sll_halen < 6) continue;
+		snprintf(mac_address, 31, "%02X-%02X-%02X-%02X-%02X-%02X", address->sll_addr[0], address->sll_addr[1], address->sll_addr[2], address->sll_addr[3], address->sll_addr[4], address->sll_addr[5]);
+		result = mac_address;
+	}
+	freeifaddrs(interfaceList);
+	return result;
+#else
+	return nullptr;
+#endif
 }
 
 inline const char* WinsockWrapper::GetStringMD5(char* str)
@@ -611,66 +1320,100 @@ inline const char* WinsockWrapper::GetBufferMD5(int bufferID) const
 
 inline bool WinsockWrapper::EncryptBuffer(char* pass, int bufferID)
 {
+	//  Keys RC4 from the password on every call. A cipher from CreateCipher keys once and defaults to the much faster ChaCha20.
+	auto buffer = m_BufferList[bufferID];
+	if (buffer == nullptr) return false;
+	buffer->DetachFileView();
+	return SocketCipher::ApplyRC4(pass, buffer->m_BufferData, buffer->m_BufferUtilizedCount);
+}
+
+inline bool WinsockWrapper::WriteCipherSalt(int bufferID)
+{
+	//  Writes a new random salt (SOCKET_CIPHER_SALT_SIZE bytes) into the buffer, for one end to send the other in the clear at the
+	//  start of a session
 	auto buffer = m_BufferList[bufferID];
 	if (buffer == nullptr) return false;
+	unsigned char salt[SOCKET_CIPHER_SALT_SIZE];
+	SocketCipher::GenerateSalt(salt);
+	buffer->StreamWrite(salt, SOCKET_CIPHER_SALT_SIZE);
+	return true;
+}
 
+inline int WinsockWrapper::CreateCipher(const char* password, int saltBufferID, int direction, int cipherType)
+{
+	//  Returns the ID of a cipher keyed from the password and the session salt (the first SOCKET_CIPHER_SALT_SIZE bytes of the
+	//  buffer, from WriteCipherSalt), or -1 if any of them isn't usable. Each end needs one cipher per direction (see
+	//  SocketCipherDirections), as a cipher shared by both would encrypt them with the same key stream.
+	auto saltBuffer = m_BufferList[saltBufferID];
+	if (saltBuffer == nullptr || saltBuffer->m_BufferUtilizedCount < SOCKET_CIPHER_SALT_SIZE) return -1;
 
-	auto *inp = buffer->m_BufferData;
-	unsigned int inplen = buffer->m_BufferUtilizedCount;
-	char KeyBox[257];
-	auto keylen = std::min<int>(int(strlen(pass)), 256);
-	if (keylen <= 0) return false;
-	ulong i, j, t, x;
-	char temp;
-	j = t = 0;
-	for (i = 0; i < 256; i++)
-		KeyBox[i] = char(i);
-	for (i = 0; i < 256; i++)
+	MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(SocketCipher));
+	auto cipher = new SocketCipher;
+	if (!cipher->SetPassword(password, reinterpret_cast<const unsigned char*>(saltBuffer->m_BufferData), direction, cipherType))
 	{
-		j = (j + ulong(KeyBox[i]) + pass[i % keylen]) % 256;
-		temp = KeyBox[i];
-		KeyBox[i] = KeyBox[j];
-		KeyBox[j] = temp;
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketCipher));
+		delete cipher;
+		return -1;
 	}
-	i = j = 0;
-	for (x = 0; x < inplen; x++)
+
+	auto cipherID = m_CipherList.Add(cipher);
+	if (cipherID < 0)
 	{
-		i = (i + 1U) % 256;
-		j = (j + ulong(KeyBox[i])) % 256;
-		temp = KeyBox[i];
-		KeyBox[i] = KeyBox[j];
-		KeyBox[j] = temp;
-		t = (ulong(KeyBox[i]) + ulong(KeyBox[j])) % 256;
-		inp[x] = (inp[x] ^ KeyBox[t]);
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketCipher));
+		delete cipher;
 	}
+	return cipherID;
+}
 
+inline bool WinsockWrapper::FreeCipher(int cipherID)
+{
+	auto cipher = m_CipherList[cipherID];
+	if (cipher == nullptr) return false;
+	MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketCipher));
+	delete cipher;
+	m_CipherList.Remove(cipherID);
 	return true;
 }
 
-inline unsigned int WinsockWrapper::GetBufferAdler32(int bufferID)
+inline bool WinsockWrapper::ApplyCipher(int cipherID, int bufferID)
 {
+	//  Continues the cipher's key stream, so both ends must apply it to the same bytes in the same order (one TCP connection)
 	auto buffer = m_BufferList[bufferID];
-	if (buffer == nullptr) return 0;
+	auto cipher = m_CipherList[cipherID];
+	if (buffer == nullptr || cipher == nullptr) return false;
+	buffer->DetachFileView();
+	cipher->Apply(buffer->m_BufferData, buffer->m_BufferUtilizedCount);
+	return true;
+}
+
+inline bool WinsockWrapper::ApplyCipher(int cipherID, int bufferID, unsigned long long packetNumber)
+{
+	//  Each packet number gets its own key stream, for packets that may be lost or reordered. Never reuse a packet number.
+	auto buffer = m_BufferList[bufferID];
+	auto cipher = m_CipherList[cipherID];
+	if (buffer == nullptr || cipher == nullptr) return false;
+	buffer->DetachFileView();
+	cipher->ApplyToPacket(buffer->m_BufferData, buffer->m_BufferUtilizedCount, packetNumber);
+	return true;
+}
+
+inline unsigned int WinsockWrapper::GetBufferAdler32(int bufferID)
+{
+	return GetBufferChecksum(bufferID, SOCKET_CHECKSUM_ADLER32);
+}
 
-	auto bufferData = buffer->m_BufferData;
-	unsigned int len = buffer->m_BufferUtilizedCount;
-	unsigned int a = 1, b = 0;
-	while (len) {
-		auto tlen = len > 5550 ? 5550 : len;
-		len -= tlen;
-		do {
-			a += *bufferData++;
-			b += a;
-		} while (--tlen);
-		a = (a & 0xffff) + (a >> 16) * (65536 - 65521);
-		b = (b & 0xffff) + (b >> 16) * (65536 - 65521);
-	}
-	if (a >= 65521)
-		a -= 65521;
-	b = (b & 0xffff) + (b >> 16) * (65536 - 65521);
-	if (b >= 65521)
-		b -= 65521;
-	return b << 16 | a;
+inline unsigned int WinsockWrapper::GetBufferChecksum(int bufferID, int algorithm)
+{
+	//  Checksums the whole buffer with one of the SocketChecksumTypes
+	return GetBufferChecksum(bufferID, algorithm, SocketChecksum::GetInitialValue(algorithm));
+}
+
+inline unsigned int WinsockWrapper::GetBufferChecksum(int bufferID, int algorithm, unsigned int previousChecksum)
+{
+	//  Continues a checksum from earlier buffers, so a file sent in chunks can be checked as a whole as the chunks arrive
+	auto buffer = GetBuffer(bufferID);
+	if (buffer == nullptr) return 0;
+	return SocketChecksum::Update(algorithm, previousChecksum, buffer->m_BufferData, size_t(buffer->m_BufferUtilizedCount));
 }
 
 inline bool WinsockWrapper::GetBufferExists(int bufferID)
@@ -679,6 +1422,44 @@ inline bool WinsockWrapper::GetBufferExists(int bufferID)
 	return (buffer != nullptr);
 }
 
+inline SocketBuffer* WinsockWrapper::GetBuffer(int bufferID) const
+{
+	//  For helpers that work on a buffer directly, like SocketBitWriter and SocketBitReader
+	return m_BufferList[bufferID];
+}
+
+inline int WinsockWrapper::EncodeBufferDelta(int baselineID, int snapshotID, int deltaID)
+{
+	//  The baseline is the last snapshot the peer acknowledged, or -1 for none. Returns the size of the delta, or -1 on failure.
+	auto baseline = GetBuffer(baselineID);
+	auto snapshot = GetBuffer(snapshotID);
+	auto delta = GetBuffer(deltaID);
+	if (snapshot == nullptr || delta == nullptr || (baseline == nullptr && baselineID >= 0)) return -1;
+	return SocketDelta::Encode(baseline, snapshot, delta);
+}
+
+inline bool WinsockWrapper::DecodeBufferDelta(int baselineID, int deltaID, int snapshotID, int maximumSnapshotSize)
+{
+	//  Refuses (returning false) any delta describing a snapshot over the maximum size
+	auto baseline = GetBuffer(baselineID);
+	auto delta = GetBuffer(deltaID);
+	auto snapshot = GetBuffer(snapshotID);
+	if (snapshot == nullptr || delta == nullptr || (baseline == nullptr && baselineID >= 0)) return false;
+	return SocketDelta::Decode(baseline, delta, snapshot, maximumSnapshotSize);
+}
+
+inline bool WinsockWrapper::SetReceiveRing(int bufferID, int ringSize)
+{
+	auto buffer = m_BufferList[bufferID];
+	if (buffer == nullptr) return false;
+	if (ringSize <= 0)
+	{
+		buffer->DisableReceiveRing();
+		return true;
+	}
+	return buffer->EnableReceiveRing(ringSize);
+}
+
 inline int WinsockWrapper::FileOpen(char* name, int mode)
 {
 	auto file = BinaryOpenFile(name, mode);
@@ -689,7 +1470,7 @@ inline int WinsockWrapper::FileClose(int fileID)
 {
 	auto file = m_FileList[fileID];
 	if (file == nullptr) return -1;
-	m_FileList[fileID] = nullptr;
+	m_FileList.Remove(fileID);
 	return BinaryCloseFile(file);
 }
 
@@ -710,120 +1491,297 @@ inline int WinsockWrapper::FileRead(int fileID, int bytes, int bufferID)
 	return ((buffer == nullptr) ? -1 : BinaryFileRead(file, bytes, buffer));
 }
 
-inline int WinsockWrapper::FileGetPosition(int fileID)
+inline long long WinsockWrapper::FileGetPosition(int fileID)
 {
 	auto file = m_FileList[fileID];
 	return ((file == nullptr) ? -1 : BinaryGetPosition(file));
 }
 
-inline int WinsockWrapper::FileSetPosition(int fileID, int pos)
+inline long long WinsockWrapper::FileSetPosition(int fileID, long long pos)
 {
 	auto file = m_FileList[fileID];
 	return ((file == nullptr) ? -1 : BinarySetPosition(file, pos));
 }
 
-inline int WinsockWrapper::FileGetSize(int fileID)
+inline long long WinsockWrapper::FileGetSize(int fileID)
 {
 	auto file = m_FileList[fileID];
 	return ((file == nullptr) ? -1 : BinaryGetFileSize(file));
 }
 
-inline int WinsockWrapper::AddBuffer(SocketBuffer* b)
+inline int WinsockWrapper::FileReadAt(int fileID, long long offset, int bytes, int bufferID)
 {
-	for (unsigned int i = 0; i < m_BufferList.size(); i++)
-		if (m_BufferList[i] == nullptr)
-		{
-			m_BufferList[i] = b;
-			return i;
-		}
+	//  Appends up to bytes from the given offset to the buffer, without using or moving the file's position
+	auto file = m_FileList[fileID];
+	if (file == nullptr) return -1;
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? -1 : BinaryFileReadAt(file, offset, bytes, buffer));
+}
 
-	m_BufferList.push_back(b);
-	return int(m_BufferList.size()) - 1;
+inline int WinsockWrapper::FileWriteAt(int fileID, long long offset, int bufferID)
+{
+	//  Writes the buffer from its read position at the given offset, without using or moving the file's position
+	auto file = m_FileList[fileID];
+	if (file == nullptr) return -1;
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? -1 : BinaryFileWriteAt(file, offset, buffer));
+}
+
+inline int WinsockWrapper::FileMapView(int fileID, long long offset, int bytes, int bufferID)
+{
+	//  Makes the buffer a read-only view of up to bytes of the file from offset, with no copy. Returns the bytes in view. The
+	//  view stays valid after the file is closed, until the buffer is cleared, written to or freed.
+	auto file = m_FileList[fileID];
+	if (file == nullptr) return -1;
+	auto buffer = m_BufferList[bufferID];
+	return ((buffer == nullptr) ? -1 : BinaryMapView(file, offset, bytes, buffer));
+}
+
+inline int WinsockWrapper::AddBuffer(SocketBuffer* b)
+{
+	//  The wrapper owns what it is given, so anything that can't be added (the table is full) is freed
+	auto bufferID = m_BufferList.Add(b);
+	if (bufferID < 0)
+	{
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(SocketBuffer));
+		delete b;
+	}
+	return bufferID;
 }
 
 inline int WinsockWrapper::AddSocket(Socket* b)
 {
-	for (auto i = 0; i < int(m_SocketList.size()); i++)
-		if (m_SocketList[i] == nullptr)
-		{
-			m_SocketList[i] = b;
-			return i;
-		}
+	auto socketID = m_SocketList.Add(b);
+	if (socketID < 0)
+	{
+		MANAGE_MEMORY_DELETE("WinsockWrapper", sizeof(Socket));
+		delete b;
+		return -1;
+	}
 
-	m_SocketList.push_back(b);
-	return int(m_SocketList.size()) - 1;
+	m_SocketPoller.AddSocket(b->m_SocketID, socketID);
+	return socketID;
 }
 
-inline int WinsockWrapper::AddFile(HANDLE b)
+inline int WinsockWrapper::AddFile(FileHandle b)
 {
-	for (auto i = 0; i < int(m_FileList.size()); i++)
-		if (m_FileList[i] == nullptr)
-		{
-			m_FileList[i] = b;
-			return i;
-		}
+	auto fileID = m_FileList.Add(b);
+	if (fileID < 0) BinaryCloseFile(b);
+	return fileID;
+}
 
-	m_FileList.push_back(b);
-	return int(m_FileList.size()) - 1;
+inline SocketBuffer* WinsockWrapper::GetCompressionBuffer(int index)
+{
+	//  Kept between calls, so each one only grows to fit the largest payload it has held
+	while (int(m_CompressionBuffers.size()) <= index)
+	{
+		MANAGE_MEMORY_NEW("WinsockWrapper", sizeof(SocketBuffer));
+		m_CompressionBuffers.push_back(new SocketBuffer);
+	}
+	return m_CompressionBuffers[index];
 }
 
-inline HANDLE WinsockWrapper::BinaryOpenFile(char* filename, int mode)
+#if defined(_WIN32)
+inline WinsockWrapper::FileHandle WinsockWrapper::BinaryOpenFile(char* filename, int mode)
 {
 	DWORD access;
 	access = GENERIC_READ | GENERIC_WRITE;
 	if (mode == 0) access = GENERIC_READ;
 	if (mode == 1) access = GENERIC_WRITE;
-	return CreateFileA(filename, access, FILE_SHARE_READ,
+	auto file = CreateFileA(filename, access, FILE_SHARE_READ,
 		nullptr,
 		OPEN_ALWAYS,
 		FILE_ATTRIBUTE_NORMAL,
 		nullptr);
+	return ((file != INVALID_HANDLE_VALUE) ? file : nullptr);
 }
 
-inline bool WinsockWrapper::BinaryCloseFile(HANDLE hwnd)
+inline bool WinsockWrapper::BinaryCloseFile(FileHandle hwnd)
 {
 	if (hwnd == nullptr) return false;
 	return (CloseHandle(hwnd) != 0);
 }
 
-inline int WinsockWrapper::BinaryFileWrite(HANDLE hwnd, SocketBuffer* dataBuffer)
+inline int WinsockWrapper::BinaryFileWrite(FileHandle hwnd, SocketBuffer* dataBuffer)
 {
 	DWORD bytes_written;
 	WriteFile(hwnd, dataBuffer->m_BufferData + dataBuffer->m_ReadPosition, dataBuffer->m_BufferUtilizedCount - dataBuffer->m_ReadPosition, &bytes_written, nullptr);
 	return int(bytes_written);
 }
 
-inline int WinsockWrapper::BinaryFileRead(HANDLE hwnd, int size, SocketBuffer* out)
+inline int WinsockWrapper::BinaryFileRead(FileHandle hwnd, int size, SocketBuffer* out)
+{
+	//  Reads straight into the end of the buffer
+	if (size <= 0) return 0;
+	out->reserve_append(size);
+	DWORD bytes_read = 0;
+	if (!ReadFile(hwnd, out->m_BufferData + out->m_WritePosition, DWORD(size), &bytes_read, nullptr)) return -1;
+	out->m_WritePosition += int(bytes_read);
+	if (out->m_WritePosition > out->m_BufferUtilizedCount) out->m_BufferUtilizedCount = out->m_WritePosition;
+	return int(bytes_read);
+}
+
+inline int WinsockWrapper::BinaryFileReadAt(FileHandle hwnd, long long offset, int size, SocketBuffer* out)
+{
+	//  An OVERLAPPED offset reads from anywhere in the file, though on a handle opened for synchronous use it also moves the
+	//  file pointer, so the original position is put back afterwards
+	if (size <= 0 || offset < 0) return (size == 0) ? 0 : -1;
+	auto position = BinaryGetPosition(hwnd);
+	out->reserve_append(size);
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = DWORD(offset >> 32);
+	DWORD bytes_read = 0;
+	auto success = ReadFile(hwnd, out->m_BufferData + out->m_WritePosition, DWORD(size), &bytes_read, &overlapped);
+	BinarySetPosition(hwnd, position);
+	if (!success && GetLastError() != ERROR_HANDLE_EOF) return -1;
+	out->m_WritePosition += int(bytes_read);
+	if (out->m_WritePosition > out->m_BufferUtilizedCount) out->m_BufferUtilizedCount = out->m_WritePosition;
+	return int(bytes_read);
+}
+
+inline int WinsockWrapper::BinaryFileWriteAt(FileHandle hwnd, long long offset, SocketBuffer* dataBuffer)
+{
+	if (offset < 0) return -1;
+	auto position = BinaryGetPosition(hwnd);
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = DWORD(offset >> 32);
+	DWORD bytes_written = 0;
+	auto success = WriteFile(hwnd, dataBuffer->m_BufferData + dataBuffer->m_ReadPosition, DWORD(dataBuffer->m_BufferUtilizedCount - dataBuffer->m_ReadPosition), &bytes_written, &overlapped);
+	BinarySetPosition(hwnd, position);
+	return (success ? int(bytes_written) : -1);
+}
+
+inline int WinsockWrapper::BinaryMapView(FileHandle hwnd, long long offset, int size, SocketBuffer* out)
+{
+	return out->MapFileView(hwnd, offset, size);
+}
+
+inline long long WinsockWrapper::BinaryGetPosition(FileHandle hwnd)
+{
+	LARGE_INTEGER distance = {};
+	LARGE_INTEGER position;
+	return (SetFilePointerEx(hwnd, distance, &position, FILE_CURRENT) ? position.QuadPart : -1);
+}
+
+inline long long WinsockWrapper::BinarySetPosition(FileHandle hwnd, long long offset)
+{
+	LARGE_INTEGER distance;
+	distance.QuadPart = offset;
+	LARGE_INTEGER position;
+	return (SetFilePointerEx(hwnd, distance, &position, FILE_BEGIN) ? position.QuadPart : -1);
+}
+
+inline long long WinsockWrapper::BinaryGetFileSize(FileHandle hwnd)
+{
+	LARGE_INTEGER fileSize;
+	return (GetFileSizeEx(hwnd, &fileSize) ? fileSize.QuadPart : -1);
+}
+
+#else
+inline WinsockWrapper::FileHandle WinsockWrapper::BinaryOpenFile(char* filename, int mode)
+{
+	//  Matches OPEN_ALWAYS: an existing file is opened without truncating it, and a missing one is created
+	auto file = fopen(filename, (mode == 0) ? "rb" : "r+b");
+	if (file == nullptr && mode != 0) file = fopen(filename, "w+b");
+	return file;
+}
+
+inline bool WinsockWrapper::BinaryCloseFile(FileHandle hwnd)
 {
-	DWORD bytes_read;
-	MANAGE_MEMORY_NEW("WinsockWrapper", size);
-	auto b = new char[size];
-	ReadFile(hwnd, b, size, &bytes_read, nullptr);
-	out->StreamWrite(b, bytes_read);
-	MANAGE_MEMORY_DELETE("WinsockWrapper", size);
-	delete [] b;
+	if (hwnd == nullptr) return false;
+	return (fclose(hwnd) == 0);
+}
+
+inline int WinsockWrapper::BinaryFileWrite(FileHandle hwnd, SocketBuffer* dataBuffer)
+{
+	return int(fwrite(dataBuffer->m_BufferData + dataBuffer->m_ReadPosition, 1, dataBuffer->m_BufferUtilizedCount - dataBuffer->m_ReadPosition, hwnd));
+}
+
+inline int WinsockWrapper::BinaryFileRead(FileHandle hwnd, int size, SocketBuffer* out)
+{
+	//  Reads straight into the end of the buffer
+	if (size <= 0) return 0;
+	out->reserve_append(size);
+	auto bytes_read = fread(out->m_BufferData + out->m_WritePosition, 1, size_t(size), hwnd);
+	out->m_WritePosition += int(bytes_read);
+	if (out->m_WritePosition > out->m_BufferUtilizedCount) out->m_BufferUtilizedCount = out->m_WritePosition;
 	return int(bytes_read);
 }
 
-inline int WinsockWrapper::BinaryGetPosition(HANDLE hwnd)
+inline int WinsockWrapper::BinaryFileReadAt(FileHandle hwnd, long long offset, int size, SocketBuffer* out)
 {
-	return SetFilePointer(hwnd, 0, nullptr, FILE_CURRENT);
+	//  pread works on the descriptor under the stream, so anything the stream is holding is flushed first (which also drops
+	//  anything it had read ahead). The stream's position is left alone.
+	if (size <= 0 || offset < 0) return (size == 0) ? 0 : -1;
+	fflush(hwnd);
+	out->reserve_append(size);
+
+	auto totalRead = 0;
+	while (totalRead < size)
+	{
+		auto bytesRead = pread(fileno(hwnd), out->m_BufferData + out->m_WritePosition + totalRead, size_t(size - totalRead), off_t(offset + totalRead));
+		if (bytesRead < 0 && errno == EINTR) continue;
+		if (bytesRead < 0) return -1;
+		if (bytesRead == 0) break;
+		totalRead += int(bytesRead);
+	}
+
+	out->m_WritePosition += totalRead;
+	if (out->m_WritePosition > out->m_BufferUtilizedCount) out->m_BufferUtilizedCount = out->m_WritePosition;
+	return totalRead;
 }
 
-inline int WinsockWrapper::BinarySetPosition(HANDLE hwnd, int offset)
+inline int WinsockWrapper::BinaryFileWriteAt(FileHandle hwnd, long long offset, SocketBuffer* dataBuffer)
 {
-	return SetFilePointer(hwnd, offset, nullptr, FILE_BEGIN);
+	if (offset < 0) return -1;
+	fflush(hwnd);
+
+	auto data = dataBuffer->m_BufferData + dataBuffer->m_ReadPosition;
+	auto size = dataBuffer->m_BufferUtilizedCount - dataBuffer->m_ReadPosition;
+	auto totalWritten = 0;
+	while (totalWritten < size)
+	{
+		auto bytesWritten = pwrite(fileno(hwnd), data + totalWritten, size_t(size - totalWritten), off_t(offset + totalWritten));
+		if (bytesWritten < 0 && errno == EINTR) continue;
+		if (bytesWritten <= 0) return ((totalWritten > 0) ? totalWritten : -1);
+		totalWritten += int(bytesWritten);
+	}
+	return totalWritten;
+}
+
+inline int WinsockWrapper::BinaryMapView(FileHandle hwnd, long long offset, int size, SocketBuffer* out)
+{
+	//  Whatever the stream has buffered has to reach the file before the file is mapped
+	fflush(hwnd);
+	return out->MapFileView(fileno(hwnd), offset, size);
 }
 
-inline int WinsockWrapper::BinaryGetFileSize(HANDLE hwnd)
+inline long long WinsockWrapper::BinaryGetPosition(FileHandle hwnd)
 {
-	return GetFileSize(hwnd, nullptr);
+	return (long long)(ftello(hwnd));
 }
 
+inline long long WinsockWrapper::BinarySetPosition(FileHandle hwnd, long long offset)
+{
+	return ((fseeko(hwnd, off_t(offset), SEEK_SET) == 0) ? offset : -1);
+}
+
+inline long long WinsockWrapper::BinaryGetFileSize(FileHandle hwnd)
+{
+	//  fstat sees what has reached the file, so anything still buffered in the stream is flushed first
+	fflush(hwnd);
+	struct stat fileStatus;
+	return ((fstat(fileno(hwnd), &fileStatus) == 0) ? (long long)(fileStatus.st_size) : -1);
+}
+#endif
+
 inline WinsockWrapper::WinsockWrapper() :
+	m_ConnectionBatch(nullptr),
 	m_WinsockInitialized(false)
 {
-
+	SocketCipher::GenerateSalt(m_ConnectionSecret);
 }
 
 inline WinsockWrapper::~WinsockWrapper()
@@ -15,18 +15,14 @@ public:
 
 	const RapidXML_Doc* LoadXMLFile( const char* filename )
 	{
+		MEMORY_SCOPE("XMLWrapper");
 		RapidXML_File* newFile;
 		auto hash = md5( std::string( filename ) );
 		
 		XMLListType::const_iterator findIter = m_LoadedXMLList.find( hash );
 		if (findIter != m_LoadedXMLList.end()) newFile = (*findIter).second;
-		else
-		{
-			MANAGE_MEMORY_NEW("XMLWrapper", sizeof(RapidXML_File));
-			newFile = new RapidXML_File(filename);
-		}
+		else newFile = new RapidXML_File(filename);
 
-		MANAGE_MEMORY_NEW("XMLWrapper", sizeof(RapidXML_Doc));
 		auto newDoc = new RapidXML_Doc;
 		newDoc->parse<0>(newFile->data());
 		
@@ -40,7 +36,6 @@ public:
 		XMLListType::const_iterator findIter = m_LoadedXMLList.find( hash );
 		if (findIter != m_LoadedXMLList.end())
 		{
-			MANAGE_MEMORY_DELETE("XMLWrapper", sizeof(RapidXML_File));
 			delete (*findIter).second;
 			m_LoadedXMLList.erase(findIter);
 			return true;
@@ -51,7 +46,6 @@ public:
 
 	static void UnloadXMLDoc(const RapidXML_Doc* document)
 	{
-		MANAGE_MEMORY_DELETE("XMLWrapper", sizeof(RapidXML_Doc));
 		delete document;
 	}
 
@@ -60,7 +54,6 @@ public:
 		//  Unload all XML data
 		while (!m_LoadedXMLList.empty())
 		{
-			MANAGE_MEMORY_DELETE("XMLWrapper", sizeof(RapidXML_File));
 			delete m_LoadedXMLList.begin()->second;
 			m_LoadedXMLList.erase(m_LoadedXMLList.begin());
 		}
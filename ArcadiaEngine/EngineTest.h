@@ -33,7 +33,7 @@ void CreateInitializationData()
 	debugConsole->GetListbox()->SetTemplateData(int(ScreenWidth) - 20, 0, 12, 12, 12, 12, 12);
 
 	//  Create the first test dialogue and add it to the scene
-	currentDialogue = new World3DExample(ScreenWidth, ScreenHeight);
+	currentDialogue = guiManager.CreateSceneDialogue<World3DExample>(ScreenWidth, ScreenHeight);
 	guiManager.GetBaseNode()->AddChild(currentDialogue);
 
 	//  Create the container that holds the showcase choice drop-down and button
@@ -67,11 +67,11 @@ void CreateInitializationData()
 		currentDialogue->SetToDestroy(guiManager.GetDestroyList());
 		switch (showcaseDropdown->GetSelectedIndex())
 		{
-		case 0:			currentDialogue = new World3DExample(ScreenWidth, ScreenHeight);	break;
-		case 1:			currentDialogue = new UIShowcaseDialogue;							break;
-		case 2:			currentDialogue = new SoundShowcaseDialogue;						break;
-		case 3:			currentDialogue = new MemoryShowcaseDialogue;						break;
-		case 4:			currentDialogue = new TopDownExample;								break;
+		case 0:			currentDialogue = guiManager.CreateSceneDialogue<World3DExample>(ScreenWidth, ScreenHeight);	break;
+		case 1:			currentDialogue = guiManager.CreateSceneDialogue<UIShowcaseDialogue>();							break;
+		case 2:			currentDialogue = guiManager.CreateSceneDialogue<SoundShowcaseDialogue>();						break;
+		case 3:			currentDialogue = guiManager.CreateSceneDialogue<MemoryShowcaseDialogue>();						break;
+		case 4:			currentDialogue = guiManager.CreateSceneDialogue<TopDownExample>();								break;
 		default:break;
 		}
 		guiManager.GetBaseNode()->AddChild(currentDialogue);
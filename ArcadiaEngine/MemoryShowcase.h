@@ -16,12 +16,23 @@ private:
 
 	GUIListBox* m_MemoryDataListBox;
 	unsigned int m_MemoryPoolDisplayCount;
+
+#if MEMORY_MANAGER_ACTIVE
+	MemorySnapshot m_MemorySnapshots[2];
+	int m_CurrentSnapshotIndex;
+	MemorySnapshotDiff m_MemorySnapshotDiff;
+#endif
 };
 
 inline MemoryShowcaseDialogue::MemoryShowcaseDialogue() :
 	m_MemoryDataListBox(nullptr),
 	m_MemoryPoolDisplayCount(0)
 {
+#if MEMORY_MANAGER_ACTIVE
+	memset(m_MemorySnapshots, 0, sizeof(m_MemorySnapshots));
+	m_CurrentSnapshotIndex = 0;
+#endif
+
 	//  Create the label that acts as an explanation of the current showcase UI
 	auto introductionLabel = GUILabel::CreateLabel(fontManager.GetFont("Arial"), "This is a basic showcase of the Memory Manager system.", 10, 10, 300, 32);
 	AddChild(introductionLabel);
@@ -52,24 +63,34 @@ inline void MemoryShowcaseDialogue::UpdateMemoryListBox()
 	if (m_MemoryDataListBox == nullptr) return;
 
 #if MEMORY_MANAGER_ACTIVE
-	auto currentMemoryPoolCount = memoryManager.GetMemoryPoolCount();
+	//  Take this frame's snapshot and compare it against last frame's, so only the pools that changed need their labels updated
+	auto& previousSnapshot = m_MemorySnapshots[m_CurrentSnapshotIndex];
+	m_CurrentSnapshotIndex = 1 - m_CurrentSnapshotIndex;
+	auto& currentSnapshot = m_MemorySnapshots[m_CurrentSnapshotIndex];
+	memoryManager.TakeSnapshot(currentSnapshot);
+	MemoryManager::DiffSnapshots(previousSnapshot, currentSnapshot, m_MemorySnapshotDiff);
+	if (m_MemorySnapshotDiff.m_ChangedPoolCount == 0) return;
 
 	//  Make sure we add to the amount of Labels until we have enough to show all of the current memory pools
-	while (m_MemoryPoolDisplayCount < currentMemoryPoolCount)
+	while (m_MemoryPoolDisplayCount < (unsigned int)(currentSnapshot.m_PoolCount))
 	{
 		auto newLabel = GUILabel::CreateLabel(fontManager.GetFont("Arial"), "", 10, 4, 300, 22);
 		m_MemoryDataListBox->AddItem(newLabel);
 		m_MemoryPoolDisplayCount++;
 	}
 
-	for (unsigned int i = 0; i < m_MemoryPoolDisplayCount; ++i)
+	for (auto i = 0; i < currentSnapshot.m_PoolCount; ++i)
 	{
+		auto& poolDelta = m_MemorySnapshotDiff.m_Pools[i];
+		if (i < previousSnapshot.m_PoolCount && poolDelta.m_LiveBytesDelta == 0 && poolDelta.m_AllocationCountDelta == 0) continue;
+
 		m_MemoryDataListBox->SetSelectedIndex(i);
 		auto label = static_cast<GUILabel*>(m_MemoryDataListBox->GetSelectedItem());
 
-		char amountStringBuffer[32];
-		_itoa_s(memoryManager.GetMemoryPoolAmountAtIndex(i), amountStringBuffer, 10);
-		label->SetText(std::string(memoryManager.GetMemoryPoolNameAtIndex(i) + std::string(":  ") + std::string(amountStringBuffer)));
+		auto& poolStats = currentSnapshot.m_Pools[i];
+		char labelText[128];
+		snprintf(labelText, sizeof(labelText), "%s:  %lld  (peak %lld)", poolStats.m_Name, (long long)(poolStats.m_LiveBytes), (long long)(poolStats.m_PeakBytes));
+		label->SetText(labelText);
 	}
 #endif
 }
\ No newline at end of file
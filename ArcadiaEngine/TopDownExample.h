@@ -262,8 +262,8 @@ inline void TopDownExample::Render(int xOffset, int yOffset)
 	rect.y = int(m_Characters[0]->GetCharacterY());
 	rect.w = m_Characters[0]->GetCharacterWidth();
 	rect.h = m_Characters[0]->GetCharacterHeight();
-	char* pixels = new char[m_Characters[0]->GetCharacterWidth() * m_Characters[0]->GetCharacterHeight()];
-	int readPixelSuccess = SDL_RenderReadPixels(renderer, &rect, SDL_PIXELFORMAT_ABGR8888, (void*)(pixels), 4);
+	auto pixels = frameArena.AllocateArray<char>(rect.w * rect.h * 4);
+	int readPixelSuccess = SDL_RenderReadPixels(renderer, &rect, SDL_PIXELFORMAT_ABGR8888, (void*)(pixels), rect.w * 4);
 	std::cout << (unsigned char)(pixels[0]) << std::endl;
 
 	return;